@@ -70,15 +70,18 @@ using ::aidl::android::security::authorization::IKeystoreAuthorization;
 Credential::Credential(CipherSuite cipherSuite, const std::string& dataPath,
                        const std::string& credentialName, uid_t callingUid,
                        HardwareInformation hwInfo, sp<IIdentityCredentialStore> halStoreBinder,
-                       sp<IPresentationSession> halSessionBinder, int halApiVersion)
+                       sp<IPresentationSession> halSessionBinder, int halApiVersion,
+                       sp<CredentialDataCache> dataCache)
     : cipherSuite_(cipherSuite), dataPath_(dataPath), credentialName_(credentialName),
       callingUid_(callingUid), hwInfo_(std::move(hwInfo)), halStoreBinder_(halStoreBinder),
-      halSessionBinder_(halSessionBinder), halApiVersion_(halApiVersion) {}
+      halSessionBinder_(halSessionBinder), halApiVersion_(halApiVersion),
+      dataCache_(std::move(dataCache)) {}
 
 Credential::~Credential() {}
 
 Status Credential::ensureOrReplaceHalBinder() {
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -119,7 +122,8 @@ Status Credential::getCredentialKeyCertificateChain(std::vector<uint8_t>* _aidl_
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
                                                 "Cannot be used with session");
     }
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -136,7 +140,8 @@ Status Credential::selectAuthKey(bool allowUsingExhaustedKeys, bool allowUsingEx
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
                                                 "Cannot be used with session");
     }
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -250,7 +255,8 @@ Status Credential::getEntries(const vector<uint8_t>& requestMessage,
                               GetEntriesResultParcel* _aidl_return) {
     GetEntriesResultParcel ret;
 
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -308,7 +314,7 @@ Status Credential::getEntries(const vector<uint8_t>& requestMessage,
                 numEntriesInNsToRequest++;
             }
 
-            optional<EntryData> eData = data->getEntryData(rns.namespaceName, rep.name);
+            optional<EntryData> eData = data->getEntryMetadata(rns.namespaceName, rep.name);
             if (eData) {
                 for (int32_t id : eData.value().accessControlProfileIds) {
                     if (id < 0 || id >= 32) {
@@ -448,7 +454,7 @@ Status Credential::getEntries(const vector<uint8_t>& requestMessage,
         RequestNamespace ns;
         ns.namespaceName = rns.namespaceName;
         for (const RequestEntryParcel& rep : rns.entries) {
-            optional<EntryData> entryData = data->getEntryData(rns.namespaceName, rep.name);
+            optional<EntryData> entryData = data->getEntryMetadata(rns.namespaceName, rep.name);
             if (entryData) {
                 RequestDataItem di;
                 di.name = rep.name;
@@ -537,21 +543,16 @@ Status Credential::getEntries(const vector<uint8_t>& requestMessage,
                 return halStatusToGenericError(status);
             }
 
-            vector<uint8_t> value;
-            for (const auto& encryptedChunk : eData.value().encryptedChunks) {
-                vector<uint8_t> chunk;
-                status = halBinder->retrieveEntryValue(encryptedChunk, &chunk);
-                if (!status.isOk()) {
-                    return halStatusToGenericError(status);
-                }
-                value.insert(value.end(), chunk.begin(), chunk.end());
+            status = retrieveEntryValue(halBinder.get(), eData.value().encryptedChunks,
+                                        eData.value().size, &resultEntryParcel.value);
+            if (!status.isOk()) {
+                return halStatusToGenericError(status);
             }
 
             resultEntryParcel.status = STATUS_OK;
-            resultEntryParcel.value = value;
-            resultNamespaceParcel.entries.push_back(resultEntryParcel);
+            resultNamespaceParcel.entries.push_back(std::move(resultEntryParcel));
         }
-        ret.resultNamespaces.push_back(resultNamespaceParcel);
+        ret.resultNamespaces.push_back(std::move(resultNamespaceParcel));
     }
 
     // API version 5 (feature version 202301) supports both MAC and ECDSA signature.
@@ -571,13 +572,13 @@ Status Credential::getEntries(const vector<uint8_t>& requestMessage,
 
     // Ensure useCount is updated on disk.
     if (updateUseCountOnDisk) {
-        if (!data->saveToDisk()) {
+        if (!data->saveJournalToDisk()) {
             return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
                                                     "Error saving data");
         }
     }
 
-    *_aidl_return = ret;
+    *_aidl_return = std::move(ret);
     return Status::ok();
 }
 
@@ -589,7 +590,8 @@ Status Credential::deleteCredential(vector<uint8_t>* _aidl_return) {
 
     vector<uint8_t> proofOfDeletionSignature;
 
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -622,7 +624,8 @@ Status Credential::deleteWithChallenge(const vector<uint8_t>& challenge,
 
     vector<uint8_t> proofOfDeletionSignature;
 
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -710,7 +713,8 @@ Status Credential::setAvailableAuthenticationKeys(int32_t keyCount, int32_t maxU
                                                 "Cannot be used with session");
     }
 
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -730,7 +734,8 @@ Status Credential::getAuthKeysNeedingCertification(vector<AuthKeyParcel>* _aidl_
                                                 "Cannot be used with session");
     }
 
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -763,7 +768,8 @@ Status Credential::storeStaticAuthenticationData(const AuthKeyParcel& authentica
                                                 "Cannot be used with session");
     }
 
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -776,7 +782,7 @@ Status Credential::storeStaticAuthenticationData(const AuthKeyParcel& authentica
             "Error finding authentication key to store static "
             "authentication data for");
     }
-    if (!data->saveToDisk()) {
+    if (!data->saveJournalToDisk()) {
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
                                                 "Error saving data");
     }
@@ -792,7 +798,8 @@ Credential::storeStaticAuthenticationDataWithExpiration(const AuthKeyParcel& aut
                                                 "Cannot be used with session");
     }
 
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -805,7 +812,7 @@ Credential::storeStaticAuthenticationDataWithExpiration(const AuthKeyParcel& aut
             "Error finding authentication key to store static "
             "authentication data for");
     }
-    if (!data->saveToDisk()) {
+    if (!data->saveJournalToDisk()) {
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
                                                 "Error saving data");
     }
@@ -818,7 +825,8 @@ Status Credential::getAuthenticationDataUsageCount(vector<int32_t>* _aidl_return
                                                 "Cannot be used with session");
     }
 
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -839,7 +847,8 @@ Status Credential::getAuthenticationDataExpirations(vector<int64_t>* _aidl_retur
                                                 "Cannot be used with session");
     }
 
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -886,7 +895,8 @@ Status Credential::update(sp<IWritableCredential>* _aidl_return) {
                                                 "Cannot be used with session");
     }
 
-    sp<CredentialData> data = new CredentialData(dataPath_, callingUid_, credentialName_);
+    sp<CredentialData> data =
+        new CredentialData(dataPath_, callingUid_, credentialName_, dataCache_);
     if (!data->loadFromDisk()) {
         LOG(ERROR) << "Error loading data for credential";
         return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
@@ -911,8 +921,9 @@ Status Credential::update(sp<IWritableCredential>* _aidl_return) {
     //
     // It is because of this we need to set the CredentialKey certificate chain,
     // keyCount, and maxUsesPerKey below.
-    sp<WritableCredential> writableCredential = new WritableCredential(
-        dataPath_, credentialName_, docType.value(), true, hwInfo_, halWritableCredential);
+    sp<WritableCredential> writableCredential =
+        new WritableCredential(dataPath_, credentialName_, docType.value(), true, hwInfo_,
+                               halWritableCredential, dataCache_);
 
     writableCredential->setAttestationCertificate(data->getAttestationCertificate());
     auto [keyCount, maxUsesPerKey, minValidTimeMillis] = data->getAvailableAuthenticationKeys();
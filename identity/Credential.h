@@ -48,7 +48,8 @@ class Credential : public BnCredential {
     Credential(CipherSuite cipherSuite, const string& dataPath, const string& credentialName,
                uid_t callingUid, HardwareInformation hwInfo,
                sp<IIdentityCredentialStore> halStoreBinder,
-               sp<IPresentationSession> halSessionBinder, int halApiVersion);
+               sp<IPresentationSession> halSessionBinder, int halApiVersion,
+               sp<CredentialDataCache> dataCache);
     ~Credential();
 
     Status ensureOrReplaceHalBinder();
@@ -105,6 +106,7 @@ class Credential : public BnCredential {
 
     sp<IIdentityCredential> halBinder_;
     int halApiVersion_;
+    sp<CredentialDataCache> dataCache_;
 
     // This is used to cache the selected AuthKey to ensure the same AuthKey is used across
     // multiple getEntries() calls.
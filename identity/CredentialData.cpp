@@ -16,6 +16,7 @@
 
 #define LOG_TAG "credstore"
 
+#include <algorithm>
 #include <chrono>
 
 #include <fcntl.h>
@@ -41,6 +42,57 @@ namespace identity {
 
 using std::optional;
 
+// Credential files used to be a single CBOR map. Files are now written in an indexed format
+// instead, which starts with kIndexedMagic and the size of a CBOR map as a big-endian uint32.
+// The map has the same members as before, except that "entryData" is replaced by "entryIndex",
+// which maps each "namespace:name" to
+//
+//   [size, [accessControlProfileId, ...], chunksOffset, [chunkSize, ...]]
+//
+// The encrypted chunks of all entries follow the map (the chunk area), so that a request reads
+// only the chunks of the entries it asks for. Files in the old format are still read, and are
+// converted the next time they are saved.
+//
+// A file in the old format starts with a CBOR map header, which can't be mistaken for the magic.
+constexpr uint8_t kIndexedMagic[4] = {'C', 'R', 'D', '2'};
+constexpr size_t kIndexedHeaderOffset = sizeof(kIndexedMagic) + sizeof(uint32_t);
+
+// Changes to auth keys made while presenting a credential are appended to a journal next to the
+// credential file instead of rewriting the whole file, see saveJournalToDisk(). The journal is a
+// sequence of CBOR arrays, starting with
+//
+//   ["journal", journalId]
+//
+// where |journalId| matches the "journalId" of the credential file the journal applies to, so a
+// journal left behind by a crash while the credential file was replaced is ignored. It is
+// followed by records, which are replayed in order:
+//
+//   ["useCount", authKeyIndex, useCount]
+//   ["authKeyData", authKeyIndex, AuthKeyData]
+//
+// The journal is folded into the credential file by the next saveToDisk(), which also happens
+// once the journal reaches kMaxJournalSize.
+constexpr size_t kJournalIdSize = 16;
+constexpr size_t kMaxJournalSize = 64 * 1024;
+
+string journalFileName(const string& fileName) {
+    return fileName + ".journal";
+}
+
+cppbor::Array authKeyDataToCbor(const AuthKeyData& data) {
+    cppbor::Array array;
+    // Fields 0-6 was in the original version in Android 11
+    array.add(data.certificate);
+    array.add(data.keyBlob);
+    array.add(data.staticAuthenticationData);
+    array.add(data.pendingCertificate);
+    array.add(data.pendingKeyBlob);
+    array.add(data.useCount);
+    // Field 7 was added in Android 12
+    array.add(data.expirationDateMillisSinceEpoch);
+    return array;
+}
+
 string CredentialData::calculateCredentialFileName(const string& dataPath, uid_t ownerUid,
                                                    const string& name) {
     return android::base::StringPrintf(
@@ -48,8 +100,10 @@ string CredentialData::calculateCredentialFileName(const string& dataPath, uid_t
         android::hardware::identity::support::encodeHex(name).c_str());
 }
 
-CredentialData::CredentialData(const string& dataPath, uid_t ownerUid, const string& name)
-    : dataPath_(dataPath), ownerUid_(ownerUid), name_(name), secureUserId_(0) {
+CredentialData::CredentialData(const string& dataPath, uid_t ownerUid, const string& name,
+                               sp<CredentialDataCache> cache)
+    : dataPath_(dataPath), ownerUid_(ownerUid), name_(name), cache_(std::move(cache)),
+      secureUserId_(0) {
     fileName_ = calculateCredentialFileName(dataPath_, ownerUid_, name_);
 }
 
@@ -71,11 +125,19 @@ void CredentialData::addSecureAccessControlProfile(
 }
 
 void CredentialData::addEntryData(const string& namespaceName, const string& entryName,
-                                  const EntryData& data) {
-    idToEncryptedChunks_[namespaceName + ":" + entryName] = data;
+                                  EntryData data) {
+    idToEncryptedChunks_[namespaceName + ":" + entryName] = std::move(data);
 }
 
-bool CredentialData::saveToDisk() const {
+bool CredentialData::saveToDisk() {
+    // A new journal is started for the new file.
+    optional<vector<uint8_t>> journalId =
+        android::hardware::identity::support::getRandom(kJournalIdSize);
+    if (!journalId) {
+        LOG(ERROR) << "Error generating journal id";
+        return false;
+    }
+
     cppbor::Map map;
 
     map.add("secureUserId", secureUserId_);
@@ -98,46 +160,112 @@ bool CredentialData::saveToDisk() const {
     }
     map.add("secureAccessControlProfiles", std::move(sacpArray));
 
-    cppbor::Map encryptedBlobsMap;
+    uint64_t chunkAreaSize = 0;
+    cppbor::Map entryIndexMap;
     for (auto const& [nsAndName, entryData] : idToEncryptedChunks_) {
-        cppbor::Array encryptedChunkArray;
-        for (const vector<uint8_t>& encryptedChunk : entryData.encryptedChunks) {
-            encryptedChunkArray.add(encryptedChunk);
-        }
-        cppbor::Array entryDataArray;
-        entryDataArray.add(entryData.size);
+        cppbor::Array entryIndexArray;
+        entryIndexArray.add(entryData.size);
         cppbor::Array idsArray;
         for (int32_t id : entryData.accessControlProfileIds) {
             idsArray.add(id);
         }
-        entryDataArray.add(std::move(idsArray));
-        entryDataArray.add(std::move(encryptedChunkArray));
-        encryptedBlobsMap.add(nsAndName, std::move(entryDataArray));
+        entryIndexArray.add(std::move(idsArray));
+        entryIndexArray.add(chunkAreaSize);
+        cppbor::Array chunkSizesArray;
+        if (entryData.chunksOnDisk) {
+            for (uint64_t chunkSize : entryData.chunkSizes) {
+                chunkSizesArray.add(chunkSize);
+                chunkAreaSize += chunkSize;
+            }
+        } else {
+            for (const vector<uint8_t>& encryptedChunk : entryData.encryptedChunks) {
+                chunkSizesArray.add(uint64_t(encryptedChunk.size()));
+                chunkAreaSize += encryptedChunk.size();
+            }
+        }
+        entryIndexArray.add(std::move(chunkSizesArray));
+        entryIndexMap.add(nsAndName, std::move(entryIndexArray));
     }
-    map.add("entryData", std::move(encryptedBlobsMap));
+    map.add("entryIndex", std::move(entryIndexMap));
     map.add("authKeyCount", keyCount_);
     map.add("maxUsesPerAuthKey", maxUsesPerKey_);
     map.add("minValidTimeMillis", minValidTimeMillis_);
 
     cppbor::Array authKeyDatasArray;
     for (const AuthKeyData& data : authKeyDatas_) {
-        cppbor::Array array;
-        // Fields 0-6 was in the original version in Android 11
-        array.add(data.certificate);
-        array.add(data.keyBlob);
-        array.add(data.staticAuthenticationData);
-        array.add(data.pendingCertificate);
-        array.add(data.pendingKeyBlob);
-        array.add(data.useCount);
-        // Field 7 was added in Android 12
-        array.add(data.expirationDateMillisSinceEpoch);
-        authKeyDatasArray.add(std::move(array));
+        authKeyDatasArray.add(authKeyDataToCbor(data));
     }
     map.add("authKeyData", std::move(authKeyDatasArray));
+    map.add("journalId", journalId.value());
+
+    vector<uint8_t> header = map.encode();
+    if (header.size() > UINT32_MAX) {
+        LOG(ERROR) << "CredentialData header too large: " << header.size();
+        return false;
+    }
+
+    vector<uint8_t> prefix(std::begin(kIndexedMagic), std::end(kIndexedMagic));
+    uint32_t headerSize = header.size();
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        prefix.push_back(uint8_t(headerSize >> shift));
+    }
+
+    // The chunk area is written in the order of the index. Chunks that are not in memory are
+    // copied over from the file they were loaded or staged in, without reading them all first.
+    auto writeContents = [&](int fd) {
+        if (!fileWriteAll(fd, prefix.data(), prefix.size()) ||
+            !fileWriteAll(fd, header.data(), header.size())) {
+            return false;
+        }
+        for (auto const& [nsAndName, entryData] : idToEncryptedChunks_) {
+            if (entryData.chunksOnDisk) {
+                uint64_t size = 0;
+                for (uint64_t chunkSize : entryData.chunkSizes) {
+                    size += chunkSize;
+                }
+                if (chunkFile_ == nullptr ||
+                    !fileCopyRange(chunkFile_->get(), chunkAreaOffset_ + entryData.chunksOffset,
+                                   size, fd)) {
+                    LOG(ERROR) << "Error copying encrypted chunks of " << nsAndName;
+                    return false;
+                }
+                continue;
+            }
+            for (const vector<uint8_t>& encryptedChunk : entryData.encryptedChunks) {
+                if (!fileWriteAll(fd, encryptedChunk.data(), encryptedChunk.size())) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+    if (!fileSetContents(fileName_, writeContents)) {
+        return false;
+    }
 
-    vector<uint8_t> credentialData = map.encode();
+    journalId_ = std::move(journalId.value());
+    journalSize_ = 0;
+    journalIdentity_.reset();
+    pendingJournal_.clear();
+    string journalName = journalFileName(fileName_);
+    if (unlink(journalName.c_str()) != 0 && errno != ENOENT) {
+        // Harmless, as the journal doesn't match the new file.
+        PLOG(WARNING) << "Error deleting " << journalName;
+        journalIdentity_ = FileIdentity::of(journalName);
+    }
 
-    return fileSetContents(fileName_, credentialData);
+    if (cache_ != nullptr) {
+        // Caching data which reads its chunks from a staging file would keep the staging file
+        // around, so the credential is loaded from the new file next time instead.
+        bool staged = chunkFile_ != nullptr && chunkAreaOffset_ == 0;
+        optional<FileIdentity> identity = FileIdentity::of(fileName_);
+        if (identity && !staged) {
+            cache_->put(identity.value(), journalIdentity_, *this);
+        } else {
+            cache_->remove(fileName_);
+        }
+    }
+    return true;
 }
 
 optional<SecureAccessControlProfile> parseSacp(const cppbor::Item& item) {
@@ -245,7 +373,88 @@ optional<vector<vector<uint8_t>>> parseEncryptedChunks(const cppbor::Item& item)
     return encryptedChunks;
 }
 
+optional<EntryData> parseIndexedEntryData(const cppbor::Item& item, uint64_t chunkAreaSize) {
+    const cppbor::Array* array = item.asArray();
+    if (array == nullptr || array->size() < 4) {
+        LOG(ERROR) << "Value item in entryIndex map is not an array with at least four elements";
+        return {};
+    }
+    const cppbor::Int* itemSize = ((*array)[0])->asInt();
+    const cppbor::Int* itemChunksOffset = ((*array)[2])->asInt();
+    const cppbor::Array* itemChunkSizes = ((*array)[3])->asArray();
+    if (itemSize == nullptr || itemChunksOffset == nullptr || itemChunkSizes == nullptr ||
+        itemChunksOffset->value() < 0) {
+        LOG(ERROR) << "One or more items in entryIndex array in CBOR is of wrong type";
+        return {};
+    }
+
+    EntryData data;
+    data.size = itemSize->value();
+    data.accessControlProfileIds = parseAccessControlProfileIds(*(*array)[1]);
+    data.chunksOnDisk = true;
+    data.chunksOffset = itemChunksOffset->value();
+    uint64_t end = data.chunksOffset;
+    for (size_t n = 0; n < itemChunkSizes->size(); n++) {
+        const cppbor::Int* itemChunkSize = ((*itemChunkSizes)[n])->asInt();
+        if (itemChunkSize == nullptr || itemChunkSize->value() < 0) {
+            LOG(ERROR) << "An item in the chunk sizes array is not a number";
+            return {};
+        }
+        data.chunkSizes.push_back(itemChunkSize->value());
+        if (__builtin_add_overflow(end, data.chunkSizes.back(), &end)) {
+            LOG(ERROR) << "Overflow computing end of entry chunks";
+            return {};
+        }
+    }
+    if (end > chunkAreaSize) {
+        LOG(ERROR) << "Entry chunks end at " << end << ", beyond the chunk area of size "
+                   << chunkAreaSize;
+        return {};
+    }
+    return data;
+}
+
 bool CredentialData::loadFromDisk() {
+    if (cache_ == nullptr) {
+        return parseFromDisk_();
+    }
+
+    // Get the identities before reading the files. Should either file change in between, the
+    // data is cached under the old identities and reloaded on the next call.
+    optional<FileIdentity> identity = FileIdentity::of(fileName_);
+    optional<FileIdentity> journalIdentity = FileIdentity::of(journalFileName(fileName_));
+    if (identity && cache_->get(identity.value(), journalIdentity, this)) {
+        return true;
+    }
+    if (!parseFromDisk_()) {
+        cache_->remove(fileName_);
+        return false;
+    }
+    if (identity) {
+        cache_->put(identity.value(), journalIdentity, *this);
+    }
+    return true;
+}
+
+void CredentialData::copyFrom(const CredentialData& other) {
+    secureUserId_ = other.secureUserId_;
+    credentialData_ = other.credentialData_;
+    attestationCertificate_ = other.attestationCertificate_;
+    secureAccessControlProfiles_ = other.secureAccessControlProfiles_;
+    idToEncryptedChunks_ = other.idToEncryptedChunks_;
+    keyCount_ = other.keyCount_;
+    maxUsesPerKey_ = other.maxUsesPerKey_;
+    minValidTimeMillis_ = other.minValidTimeMillis_;
+    authKeyDatas_ = other.authKeyDatas_;
+    chunkFile_ = other.chunkFile_;
+    chunkAreaOffset_ = other.chunkAreaOffset_;
+    stagedSize_ = other.stagedSize_;
+    journalId_ = other.journalId_;
+    journalSize_ = other.journalSize_;
+    journalIdentity_ = other.journalIdentity_;
+}
+
+bool CredentialData::parseFromDisk_() {
     // Reset all data.
     credentialData_.clear();
     attestationCertificate_.clear();
@@ -255,8 +464,55 @@ bool CredentialData::loadFromDisk() {
     keyCount_ = 0;
     maxUsesPerKey_ = 1;
     minValidTimeMillis_ = 0;
-
-    optional<vector<uint8_t>> data = fileGetContents(fileName_);
+    chunkFile_.reset();
+    chunkAreaOffset_ = 0;
+    stagedSize_ = 0;
+    journalId_.clear();
+    journalSize_ = 0;
+    journalIdentity_.reset();
+    pendingJournal_.clear();
+
+    android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(fileName_.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        PLOG(ERROR) << "Error opening " << fileName_;
+        return false;
+    }
+    struct stat statbuf;
+    if (fstat(fd.get(), &statbuf) != 0) {
+        PLOG(ERROR) << "Error statting " << fileName_;
+        return false;
+    }
+    uint64_t fileSize = statbuf.st_size;
+
+    // For the indexed format only the header is read here, see kIndexedMagic.
+    bool indexed = false;
+    uint64_t chunkAreaOffset = 0;
+    uint64_t chunkAreaSize = 0;
+    optional<vector<uint8_t>> data;
+    if (fileSize >= kIndexedHeaderOffset) {
+        optional<vector<uint8_t>> prefix = fileReadRange(fd.get(), 0, kIndexedHeaderOffset);
+        if (!prefix) {
+            LOG(ERROR) << "Error loading data";
+            return false;
+        }
+        indexed = std::equal(std::begin(kIndexedMagic), std::end(kIndexedMagic), prefix->begin());
+        if (indexed) {
+            uint32_t headerSize = 0;
+            for (size_t n = sizeof(kIndexedMagic); n < kIndexedHeaderOffset; n++) {
+                headerSize = (headerSize << 8) | prefix.value()[n];
+            }
+            chunkAreaOffset = kIndexedHeaderOffset + uint64_t(headerSize);
+            if (chunkAreaOffset > fileSize) {
+                LOG(ERROR) << "Header of " << fileName_ << " extends beyond the end of the file";
+                return false;
+            }
+            chunkAreaSize = fileSize - chunkAreaOffset;
+            data = fileReadRange(fd.get(), kIndexedHeaderOffset, headerSize);
+        }
+    }
+    if (!indexed) {
+        data = fileReadRange(fd.get(), 0, fileSize);
+    }
     if (!data) {
         LOG(ERROR) << "Error loading data";
         return false;
@@ -369,6 +625,27 @@ bool CredentialData::loadFromDisk() {
                 idToEncryptedChunks_[ecId] = data;
             }
 
+        } else if (key == "entryIndex" && indexed) {
+            const cppbor::Map* map = valueItem->asMap();
+            if (map == nullptr) {
+                LOG(ERROR) << "Value for entryIndex is not an map";
+                return false;
+            }
+            for (size_t m = 0; m < map->size(); m++) {
+                auto& [eiKeyItem, eiValueItem] = (*map)[m];
+                const cppbor::Tstr* eiTstr = eiKeyItem->asTstr();
+                if (eiTstr == nullptr) {
+                    LOG(ERROR) << "Key item in entryIndex map is not a tstr";
+                    return false;
+                }
+                optional<EntryData> data = parseIndexedEntryData(*eiValueItem, chunkAreaSize);
+                if (!data) {
+                    LOG(ERROR) << "Error parsing entryIndex";
+                    return false;
+                }
+                idToEncryptedChunks_[eiTstr->value()] = std::move(data.value());
+            }
+
         } else if (key == "authKeyData") {
             const cppbor::Array* array = valueItem->asArray();
             if (array == nullptr) {
@@ -408,6 +685,14 @@ bool CredentialData::loadFromDisk() {
                 return false;
             }
             minValidTimeMillis_ = number->value();
+
+        } else if (key == "journalId") {
+            const cppbor::Bstr* bstr = valueItem->asBstr();
+            if (bstr == nullptr) {
+                LOG(ERROR) << "Value for journalId is not a bstr";
+                return false;
+            }
+            journalId_ = bstr->value();
         }
     }
 
@@ -427,6 +712,275 @@ bool CredentialData::loadFromDisk() {
         return false;
     }
 
+    if (!replayJournal_()) {
+        return false;
+    }
+
+    if (indexed) {
+        chunkFile_ = std::make_shared<android::base::unique_fd>(std::move(fd));
+        chunkAreaOffset_ = chunkAreaOffset;
+    }
+    return true;
+}
+
+bool CredentialData::replayJournal_() {
+    string journalName = journalFileName(fileName_);
+    android::base::unique_fd fd(
+        TEMP_FAILURE_RETRY(open(journalName.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        if (errno == ENOENT) {
+            return true;
+        }
+        PLOG(ERROR) << "Error opening " << journalName;
+        return false;
+    }
+    struct stat statbuf;
+    if (fstat(fd.get(), &statbuf) != 0) {
+        PLOG(ERROR) << "Error statting " << journalName;
+        return false;
+    }
+    journalIdentity_ = FileIdentity::of(statbuf);
+    optional<vector<uint8_t>> journal = fileReadRange(fd.get(), 0, statbuf.st_size);
+    if (!journal) {
+        LOG(ERROR) << "Error loading " << journalName;
+        return false;
+    }
+
+    // Records are only applied up to the first one which can't be parsed, which is expected if
+    // credstore died while appending it. |journalSize_| ends up covering the records applied, and
+    // anything after them is dropped by the next saveJournalToDisk().
+    const uint8_t* pos = journal->data();
+    const uint8_t* end = journal->data() + journal->size();
+    bool first = true;
+    while (pos < end) {
+        auto [item, newPos, message] = cppbor::parse(pos, end);
+        const cppbor::Array* array = item != nullptr ? item->asArray() : nullptr;
+        const cppbor::Tstr* type =
+            array != nullptr && array->size() >= 2 ? ((*array)[0])->asTstr() : nullptr;
+        if (type == nullptr) {
+            LOG(WARNING) << "Ignoring rest of " << journalName << " from offset "
+                         << (pos - journal->data());
+            break;
+        }
+
+        if (first) {
+            const cppbor::Bstr* journalId = ((*array)[1])->asBstr();
+            if (type->value() != "journal" || journalId == nullptr || journalId_.empty() ||
+                journalId->value() != journalId_) {
+                LOG(WARNING) << "Ignoring " << journalName << ", which is for another version "
+                             << "of the credential";
+                break;
+            }
+            first = false;
+            pos = newPos;
+            journalSize_ = pos - journal->data();
+            continue;
+        }
+
+        const cppbor::Int* itemIndex = ((*array)[1])->asInt();
+        if (itemIndex == nullptr || itemIndex->value() < 0 ||
+            uint64_t(itemIndex->value()) >= authKeyDatas_.size() || array->size() < 3) {
+            LOG(ERROR) << "Invalid record in " << journalName;
+            return false;
+        }
+        AuthKeyData& authKeyData = authKeyDatas_[itemIndex->value()];
+        if (type->value() == "useCount") {
+            const cppbor::Int* itemUseCount = ((*array)[2])->asInt();
+            if (itemUseCount == nullptr) {
+                LOG(ERROR) << "Value for useCount in " << journalName << " is not a number";
+                return false;
+            }
+            authKeyData.useCount = itemUseCount->value();
+        } else if (type->value() == "authKeyData") {
+            optional<AuthKeyData> data = parseAuthKeyData(*(*array)[2]);
+            if (!data) {
+                LOG(ERROR) << "Error parsing AuthKeyData in " << journalName;
+                return false;
+            }
+            authKeyData = std::move(data.value());
+        } else {
+            LOG(ERROR) << "Unknown record type " << type->value() << " in " << journalName;
+            return false;
+        }
+        pos = newPos;
+        journalSize_ = pos - journal->data();
+    }
+    return true;
+}
+
+bool CredentialData::saveJournalToDisk() {
+    if (pendingJournal_.empty()) {
+        return true;
+    }
+    // Files written before journals were introduced have no journal id.
+    if (journalId_.empty() || journalSize_ + pendingJournal_.size() > kMaxJournalSize) {
+        return saveToDisk();
+    }
+
+    string journalName = journalFileName(fileName_);
+    android::base::unique_fd fd(TEMP_FAILURE_RETRY(
+        open(journalName.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR)));
+    if (fd == -1) {
+        PLOG(ERROR) << "Error opening " << journalName;
+        return false;
+    }
+    // Another CredentialData for the same credential, e.g. one loaded through the other
+    // CredentialStore, may have appended to the journal since this one was loaded. Truncating the
+    // journal would drop those records, so the whole credential is written instead, which is what
+    // happened for every change before journals were introduced.
+    struct stat statbuf;
+    if (fstat(fd.get(), &statbuf) != 0) {
+        PLOG(ERROR) << "Error statting " << journalName;
+        return false;
+    }
+    if (journalIdentity_ ? !(FileIdentity::of(statbuf) == journalIdentity_.value())
+                         : statbuf.st_size != 0) {
+        LOG(INFO) << journalName << " changed since it was loaded, rewriting credential";
+        fd.reset();
+        return saveToDisk();
+    }
+    // Drops a partially written record, or the journal of another version of the credential.
+    if (TEMP_FAILURE_RETRY(ftruncate(fd.get(), journalSize_)) != 0 ||
+        lseek(fd.get(), journalSize_, SEEK_SET) == -1) {
+        PLOG(ERROR) << "Error truncating " << journalName;
+        return false;
+    }
+    vector<uint8_t> records;
+    if (journalSize_ == 0) {
+        cppbor::Array array;
+        array.add("journal");
+        array.add(journalId_);
+        records = array.encode();
+    }
+    records.insert(records.end(), pendingJournal_.begin(), pendingJournal_.end());
+    if (!fileWriteAll(fd.get(), records.data(), records.size())) {
+        LOG(ERROR) << "Error writing to " << journalName;
+        return false;
+    }
+    if (TEMP_FAILURE_RETRY(fsync(fd.get())) != 0) {
+        PLOG(ERROR) << "Error fsyncing " << journalName;
+        return false;
+    }
+    journalSize_ += records.size();
+    pendingJournal_.clear();
+    if (fstat(fd.get(), &statbuf) != 0) {
+        PLOG(ERROR) << "Error statting " << journalName;
+        return false;
+    }
+    journalIdentity_ = FileIdentity::of(statbuf);
+
+    // The credential file itself is unchanged, so the cached data has to be replaced explicitly.
+    if (cache_ != nullptr) {
+        optional<FileIdentity> identity = FileIdentity::of(fileName_);
+        if (identity) {
+            cache_->put(identity.value(), journalIdentity_, *this);
+        } else {
+            cache_->remove(fileName_);
+        }
+    }
+    return true;
+}
+
+void CredentialData::addJournalRecord_(const AuthKeyData* authKeyData, bool useCountOnly) {
+    cppbor::Array array;
+    array.add(useCountOnly ? "useCount" : "authKeyData");
+    array.add(int64_t(authKeyData - authKeyDatas_.data()));
+    if (useCountOnly) {
+        array.add(authKeyData->useCount);
+    } else {
+        array.add(authKeyDataToCbor(*authKeyData));
+    }
+    vector<uint8_t> record = array.encode();
+    pendingJournal_.insert(pendingJournal_.end(), record.begin(), record.end());
+}
+
+bool CredentialData::createStagingFile() {
+    if (chunkFile_ != nullptr && chunkAreaOffset_ == 0) {
+        return true;
+    }
+    if (chunkFile_ != nullptr) {
+        LOG(ERROR) << "Encrypted chunks are already read from a file";
+        return false;
+    }
+    string tempNameStr = dataPath_ + "/staging.XXXXXX";
+    vector<char> tempName(tempNameStr.begin(), tempNameStr.end());
+    tempName.push_back('\0');
+    android::base::unique_fd fd(mkostemp(tempName.data(), O_CLOEXEC));
+    if (fd == -1) {
+        PLOG(ERROR) << "Error creating staging file in " << dataPath_;
+        return false;
+    }
+    // Nothing is left behind if credstore dies before the credential is saved.
+    if (unlink(tempName.data()) != 0) {
+        PLOG(ERROR) << "Error unlinking staging file " << tempName.data();
+        return false;
+    }
+    chunkFile_ = std::make_shared<android::base::unique_fd>(std::move(fd));
+    chunkAreaOffset_ = 0;
+    stagedSize_ = 0;
+    return true;
+}
+
+bool CredentialData::stageEncryptedChunk(const vector<uint8_t>& encryptedChunk, EntryData* data) {
+    if (chunkFile_ == nullptr || chunkAreaOffset_ != 0) {
+        LOG(ERROR) << "No staging file";
+        return false;
+    }
+    if (!data->chunksOnDisk) {
+        if (!data->encryptedChunks.empty()) {
+            LOG(ERROR) << "Entry already has encrypted chunks in memory";
+            return false;
+        }
+        data->chunksOnDisk = true;
+        data->chunksOffset = stagedSize_;
+        data->chunkSizes.clear();
+    }
+    // The chunks of an entry are read back as one contiguous range.
+    uint64_t entryEnd = data->chunksOffset;
+    for (uint64_t chunkSize : data->chunkSizes) {
+        entryEnd += chunkSize;
+    }
+    if (entryEnd != stagedSize_) {
+        LOG(ERROR) << "Chunks of another entry were staged in between";
+        return false;
+    }
+    if (!fileWriteAll(chunkFile_->get(), encryptedChunk.data(), encryptedChunk.size())) {
+        LOG(ERROR) << "Error writing to staging file";
+        return false;
+    }
+    data->chunkSizes.push_back(encryptedChunk.size());
+    stagedSize_ += encryptedChunk.size();
+    return true;
+}
+
+bool CredentialData::readEncryptedChunks_(EntryData* data) const {
+    if (!data->chunksOnDisk) {
+        return true;
+    }
+    if (chunkFile_ == nullptr) {
+        LOG(ERROR) << "No file to read encrypted chunks from";
+        return false;
+    }
+    // The sizes were checked against the size of the chunk area when the index was parsed.
+    uint64_t totalSize = 0;
+    for (uint64_t chunkSize : data->chunkSizes) {
+        totalSize += chunkSize;
+    }
+    optional<vector<uint8_t>> chunks =
+        fileReadRange(chunkFile_->get(), chunkAreaOffset_ + data->chunksOffset, totalSize);
+    if (!chunks) {
+        LOG(ERROR) << "Error reading encrypted chunks from " << fileName_;
+        return false;
+    }
+    data->encryptedChunks.clear();
+    auto begin = chunks->begin();
+    for (uint64_t chunkSize : data->chunkSizes) {
+        data->encryptedChunks.emplace_back(begin, begin + chunkSize);
+        begin += chunkSize;
+    }
+    data->chunksOnDisk = false;
+    data->chunksOffset = 0;
+    data->chunkSizes.clear();
     return true;
 }
 
@@ -462,14 +1016,38 @@ optional<EntryData> CredentialData::getEntryData(const string& namespaceName,
     if (iter == idToEncryptedChunks_.end()) {
         return {};
     }
-    return iter->second;
+    EntryData data = iter->second;
+    if (!readEncryptedChunks_(&data)) {
+        return {};
+    }
+    return data;
+}
+
+optional<EntryData> CredentialData::getEntryMetadata(const string& namespaceName,
+                                                     const string& entryName) const {
+    string id = namespaceName + ":" + entryName;
+    auto iter = idToEncryptedChunks_.find(id);
+    if (iter == idToEncryptedChunks_.end()) {
+        return {};
+    }
+    EntryData data;
+    data.size = iter->second.size;
+    data.accessControlProfileIds = iter->second.accessControlProfileIds;
+    return data;
 }
 
 bool CredentialData::deleteCredential() {
+    if (cache_ != nullptr) {
+        cache_->remove(fileName_);
+    }
     if (unlink(fileName_.c_str()) != 0) {
         PLOG(ERROR) << "Error deleting " << fileName_;
         return false;
     }
+    string journalName = journalFileName(fileName_);
+    if (unlink(journalName.c_str()) != 0 && errno != ENOENT) {
+        PLOG(WARNING) << "Error deleting " << journalName;
+    }
     return true;
 }
 
@@ -572,6 +1150,7 @@ const AuthKeyData* CredentialData::selectAuthKey(bool allowUsingExhaustedKeys,
 
     if (incrementUsageCount) {
         candidate->useCount += 1;
+        addJournalRecord_(candidate, true /* useCountOnly */);
     }
     return candidate;
 }
@@ -627,6 +1206,7 @@ bool CredentialData::storeStaticAuthenticationData(const vector<uint8_t>& authen
             data.pendingCertificate.clear();
             data.pendingKeyBlob.clear();
             data.useCount = 0;
+            addJournalRecord_(&data, false /* useCountOnly */);
             return true;
         }
     }
@@ -21,13 +21,17 @@
 #include <unistd.h>
 
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <android-base/unique_fd.h>
 #include <android/hardware/identity/IIdentityCredential.h>
 #include <android/hardware/identity/SecureAccessControlProfile.h>
 
+#include "CredentialDataCache.h"
+
 namespace android {
 namespace security {
 namespace identity {
@@ -47,6 +51,13 @@ struct EntryData {
     uint64_t size = 0;
     vector<int32_t> accessControlProfileIds;
     vector<vector<uint8_t>> encryptedChunks;
+
+    // Set for entries loaded from a file in the indexed format, whose |encryptedChunks| are
+    // only read from the file by CredentialData::getEntryData(). The chunks are stored back to
+    // back at |chunksOffset| in the chunk area of the file.
+    bool chunksOnDisk = false;
+    uint64_t chunksOffset = 0;
+    vector<uint64_t> chunkSizes;
 };
 
 struct AuthKeyData {
@@ -63,7 +74,10 @@ struct AuthKeyData {
 
 class CredentialData : public RefBase {
   public:
-    CredentialData(const string& dataPath, uid_t ownerUid, const string& name);
+    // If |cache| is set, loadFromDisk() uses the data cached for this credential if the file
+    // has not changed since, and saveToDisk() and deleteCredential() keep the cache up to date.
+    CredentialData(const string& dataPath, uid_t ownerUid, const string& name,
+                   sp<CredentialDataCache> cache = nullptr);
 
     static string calculateCredentialFileName(const string& dataPath, uid_t ownerUid,
                                               const string& name);
@@ -80,12 +94,31 @@ class CredentialData : public RefBase {
     void
     addSecureAccessControlProfile(const SecureAccessControlProfile& secureAccessControlProfile);
 
-    void addEntryData(const string& namespaceName, const string& entryName, const EntryData& data);
+    void addEntryData(const string& namespaceName, const string& entryName, EntryData data);
+
+    // Writes the whole credential to disk, folding in its journal.
+    bool saveToDisk();
+
+    // Saves the changes to auth keys made by selectAuthKey() and storeStaticAuthenticationData()
+    // since the credential was loaded, by appending them to a journal, which is cheaper than
+    // saveToDisk(). Other changes are not saved.
+    bool saveJournalToDisk();
 
-    bool saveToDisk() const;
+    // Creates a staging file, which is unlinked from the start, for the encrypted chunks of new
+    // entries, so they don't have to be held in memory until saveToDisk() is called. Does nothing
+    // if there is a staging file already. Can't be used for credentials loaded from disk.
+    bool createStagingFile();
+
+    // Appends |encryptedChunk| of the entry |data| to the staging file. The chunks of an entry
+    // must be staged one after another, and the entry is added with addEntryData() after its
+    // last chunk has been staged.
+    bool stageEncryptedChunk(const vector<uint8_t>& encryptedChunk, EntryData* data);
 
     bool loadFromDisk();
 
+    // Copies everything stored on disk from |other|, which must be for the same credential.
+    void copyFrom(const CredentialData& other);
+
     bool deleteCredential();
 
     void setAvailableAuthenticationKeys(int keyCount, int maxUsesPerKey,
@@ -93,6 +126,14 @@ class CredentialData : public RefBase {
 
     // Getters
 
+    const string& getDataPath() const { return dataPath_; }
+
+    uid_t getOwnerUid() const { return ownerUid_; }
+
+    const string& getName() const { return name_; }
+
+    const string& getFileName() const { return fileName_; }
+
     int64_t getSecureUserId();
 
     const vector<uint8_t>& getCredentialData() const;
@@ -103,8 +144,13 @@ class CredentialData : public RefBase {
 
     bool hasEntryData(const string& namespaceName, const string& entryName) const;
 
+    // Returns the entry including its encrypted chunks, which may have to be read from disk.
     optional<EntryData> getEntryData(const string& namespaceName, const string& entryName) const;
 
+    // Like getEntryData(), but without the encrypted chunks.
+    optional<EntryData> getEntryMetadata(const string& namespaceName,
+                                         const string& entryName) const;
+
     const vector<AuthKeyData>& getAuthKeyDatas() const;
 
     tuple<int /* keyCount */, int /*maxUsersPerKey */, int64_t /* minValidTimeMillis */>
@@ -125,11 +171,20 @@ class CredentialData : public RefBase {
   private:
     AuthKeyData* findAuthKey_(bool allowUsingExhaustedKeys, bool allowUsingExpiredKeys);
 
+    bool parseFromDisk_();
+
+    bool readEncryptedChunks_(EntryData* data) const;
+
+    bool replayJournal_();
+
+    void addJournalRecord_(const AuthKeyData* authKeyData, bool useCountOnly);
+
     // Set by constructor.
     //
     string dataPath_;
     uid_t ownerUid_;
     string name_;
+    sp<CredentialDataCache> cache_;
 
     // Calculated at construction time, from |dataPath_|, |ownerUid_|, |name_|.
     string fileName_;
@@ -146,6 +201,26 @@ class CredentialData : public RefBase {
     int maxUsesPerKey_ = 1;
     int64_t minValidTimeMillis_ = 0;
     vector<AuthKeyData> authKeyDatas_;  // Always |keyCount_| long.
+
+    // The file the encrypted chunks of entries with |chunksOnDisk| set are read from. It is kept
+    // open, so the chunks are read from the same version of the file as the index even if the
+    // file has been replaced since. Shared with copies of this object.
+    std::shared_ptr<android::base::unique_fd> chunkFile_;
+    // 0 for a staging file, which has no header.
+    uint64_t chunkAreaOffset_ = 0;
+    // The number of bytes written to |chunkFile_| if it is a staging file.
+    uint64_t stagedSize_ = 0;
+
+    // Identifies the journal belonging to the credential file, empty for files written before
+    // journals were introduced.
+    vector<uint8_t> journalId_;
+    // The size of the records in the journal when it was last loaded or written, which excludes
+    // a record torn by a crash.
+    uint64_t journalSize_ = 0;
+    // The identity of the journal when it was last loaded or written, empty if there was none.
+    optional<FileIdentity> journalIdentity_;
+    // Encoded journal records not saved yet.
+    vector<uint8_t> pendingJournal_;
 };
 
 }  // namespace identity
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "credstore"
+
+#include <sys/stat.h>
+
+#include <android-base/logging.h>
+
+#include "CredentialData.h"
+#include "CredentialDataCache.h"
+
+namespace android {
+namespace security {
+namespace identity {
+
+optional<FileIdentity> FileIdentity::of(const string& fileName) {
+    struct stat statbuf;
+    if (stat(fileName.c_str(), &statbuf) != 0) {
+        if (errno != ENOENT) {
+            PLOG(ERROR) << "Error getting information about " << fileName;
+        }
+        return {};
+    }
+    return of(statbuf);
+}
+
+FileIdentity FileIdentity::of(const struct stat& statbuf) {
+    FileIdentity identity;
+    identity.device = statbuf.st_dev;
+    identity.inode = statbuf.st_ino;
+    identity.size = statbuf.st_size;
+    identity.mtimeNanos = int64_t(statbuf.st_mtim.tv_sec) * 1000000000 + statbuf.st_mtim.tv_nsec;
+    return identity;
+}
+
+bool CredentialDataCache::get(const FileIdentity& identity,
+                              const optional<FileIdentity>& journalIdentity, CredentialData* data) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = entries_.find(data->getFileName());
+    if (it == entries_.end()) {
+        return false;
+    }
+    if (!(it->second->identity == identity) ||
+        !(it->second->journalIdentity == journalIdentity)) {
+        // The file was replaced, or the journal appended to, behind our back.
+        lru_.erase(it->second);
+        entries_.erase(it);
+        return false;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    data->copyFrom(*it->second->data);
+    return true;
+}
+
+void CredentialDataCache::put(const FileIdentity& identity,
+                              const optional<FileIdentity>& journalIdentity,
+                              const CredentialData& data) {
+    // The copy does not refer back to the cache.
+    sp<CredentialData> copy = new CredentialData(data.getDataPath(), data.getOwnerUid(),
+                                                 data.getName(), nullptr /* cache */);
+    copy->copyFrom(data);
+
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = entries_.find(data.getFileName());
+    if (it != entries_.end()) {
+        lru_.erase(it->second);
+        entries_.erase(it);
+    }
+    if (maxEntries_ == 0) {
+        return;
+    }
+    while (lru_.size() >= maxEntries_) {
+        entries_.erase(lru_.back().fileName);
+        lru_.pop_back();
+    }
+    lru_.push_front(Entry{data.getFileName(), identity, journalIdentity, std::move(copy)});
+    entries_[data.getFileName()] = lru_.begin();
+}
+
+void CredentialDataCache::remove(const string& fileName) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = entries_.find(fileName);
+    if (it != entries_.end()) {
+        lru_.erase(it->second);
+        entries_.erase(it);
+    }
+}
+
+}  // namespace identity
+}  // namespace security
+}  // namespace android
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_SECURITY_CREDENTIAL_DATA_CACHE_H_
+#define SYSTEM_SECURITY_CREDENTIAL_DATA_CACHE_H_
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include <utils/RefBase.h>
+
+namespace android {
+namespace security {
+namespace identity {
+
+using ::std::optional;
+using ::std::string;
+
+class CredentialData;
+
+// Identifies a version of a file. Files are replaced by renaming a new file over them, see
+// fileSetContents(), so a changed file has at least a different inode.
+struct FileIdentity {
+    dev_t device = 0;
+    ino_t inode = 0;
+    off_t size = 0;
+    int64_t mtimeNanos = 0;
+
+    static optional<FileIdentity> of(const string& fileName);
+    static FileIdentity of(const struct stat& statbuf);
+
+    bool operator==(const FileIdentity& other) const {
+        return device == other.device && inode == other.inode && size == other.size &&
+               mtimeNanos == other.mtimeNanos;
+    }
+};
+
+// Keeps parsed CredentialData of recently used credentials, so that the binder calls of a
+// presentation don't each read and parse the credential file again.
+//
+// Entries are keyed by file name, which is derived from the owner uid and the credential name,
+// and are only used while the file on disk, and its journal, still have the identities they had
+// when the entry was cached. The journal is part of the key because appending to it leaves the
+// credential file unchanged, and more than one cache may load the same credential.
+// CredentialData::saveToDisk() and saveJournalToDisk() update the entry in place.
+//
+class CredentialDataCache : public RefBase {
+  public:
+    static constexpr size_t kDefaultMaxEntries = 16;
+
+    explicit CredentialDataCache(size_t maxEntries = kDefaultMaxEntries)
+        : maxEntries_(maxEntries) {}
+
+    // Copies the cached data for |data|'s file into |data| if the file and its journal still
+    // have the given identities, where an empty |journalIdentity| stands for no journal. Returns
+    // false otherwise.
+    bool get(const FileIdentity& identity, const optional<FileIdentity>& journalIdentity,
+             CredentialData* data);
+
+    // Caches a copy of |data| as the contents of its file and journal, which have the given
+    // identities. The least recently used entry is evicted if the cache is full.
+    void put(const FileIdentity& identity, const optional<FileIdentity>& journalIdentity,
+             const CredentialData& data);
+
+    void remove(const string& fileName);
+
+  private:
+    struct Entry {
+        string fileName;
+        FileIdentity identity;
+        optional<FileIdentity> journalIdentity;
+        sp<CredentialData> data;
+    };
+
+    const size_t maxEntries_;
+
+    std::mutex lock_;
+    // Most recently used first.
+    std::list<Entry> lru_;
+    std::map<string, std::list<Entry>::iterator> entries_;
+};
+
+}  // namespace identity
+}  // namespace security
+}  // namespace android
+
+#endif  // SYSTEM_SECURITY_CREDENTIAL_DATA_CACHE_H_
@@ -45,7 +45,7 @@ using ::android::security::rkp::support::getRpcKey;
 }  // namespace
 
 CredentialStore::CredentialStore(const std::string& dataPath, sp<IIdentityCredentialStore> hal)
-    : dataPath_(dataPath), hal_(hal) {}
+    : dataPath_(dataPath), dataCache_(new CredentialDataCache()), hal_(hal) {}
 
 bool CredentialStore::init() {
     Status status = hal_->getHardwareInformation(&hwInfo_);
@@ -120,8 +120,9 @@ Status CredentialStore::createCredential(const std::string& credentialName,
         }
     }
 
-    sp<IWritableCredential> writableCredential = new WritableCredential(
-        dataPath_, credentialName, docType, false, hwInfo_, halWritableCredential);
+    sp<IWritableCredential> writableCredential =
+        new WritableCredential(dataPath_, credentialName, docType, false, hwInfo_,
+                               halWritableCredential, dataCache_);
     *_aidl_return = writableCredential;
     return Status::ok();
 }
@@ -147,7 +148,7 @@ Status CredentialStore::getCredentialCommon(const std::string& credentialName, i
     // HAL is manually kept in sync. So this cast is safe.
     sp<Credential> credential =
         new Credential(CipherSuite(cipherSuite), dataPath_, credentialName, callingUid, hwInfo_,
-                       hal_, halSessionBinder, halApiVersion_);
+                       hal_, halSessionBinder, halApiVersion_, dataCache_);
 
     Status loadStatus = credential->ensureOrReplaceHalBinder();
     if (!loadStatus.isOk()) {
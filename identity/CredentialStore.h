@@ -23,6 +23,8 @@
 #include <android/hardware/identity/IIdentityCredentialStore.h>
 #include <android/security/identity/BnCredentialStore.h>
 
+#include "CredentialDataCache.h"
+
 namespace android {
 namespace security {
 namespace identity {
@@ -69,6 +71,9 @@ class CredentialStore : public BnCredentialStore {
 
     string dataPath_;
 
+    // Shared by all credentials and writable credentials handed out by this store.
+    sp<CredentialDataCache> dataCache_;
+
     sp<IIdentityCredentialStore> hal_;
     int halApiVersion_;
 
@@ -16,6 +16,8 @@
 
 #define LOG_TAG "credstore"
 
+#include <algorithm>
+
 #include <fcntl.h>
 #include <stdlib.h>
 #include <sys/stat.h>
@@ -27,6 +29,7 @@
 
 #include <android/security/identity/ICredentialStore.h>
 
+#include "CredentialData.h"
 #include "Util.h"
 
 namespace android {
@@ -80,7 +83,71 @@ optional<vector<uint8_t>> fileGetContents(const string& path) {
     return data;
 }
 
+bool fileWriteAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t numWritten = TEMP_FAILURE_RETRY(write(fd, data, size));
+        if (numWritten <= 0) {
+            PLOG(ERROR) << "Failed writing " << size << " bytes";
+            return false;
+        }
+        data += numWritten;
+        size -= numWritten;
+    }
+    return true;
+}
+
+bool fileCopyRange(int fromFd, uint64_t offset, uint64_t size, int toFd) {
+    constexpr size_t kBufferSize = 64 * 1024;
+    vector<uint8_t> buffer(std::min(size, uint64_t(kBufferSize)));
+    while (size > 0) {
+        size_t toRead = std::min(size, uint64_t(buffer.size()));
+        ssize_t numRead = TEMP_FAILURE_RETRY(pread64(fromFd, buffer.data(), toRead, offset));
+        if (numRead < 0) {
+            PLOG(ERROR) << "Failed reading " << size << " bytes at offset " << offset;
+            return false;
+        }
+        if (numRead == 0) {
+            LOG(ERROR) << "Unexpected end of file copying " << size << " bytes at offset "
+                       << offset;
+            return false;
+        }
+        if (!fileWriteAll(toFd, buffer.data(), numRead)) {
+            return false;
+        }
+        offset += numRead;
+        size -= numRead;
+    }
+    return true;
+}
+
+optional<vector<uint8_t>> fileReadRange(int fd, uint64_t offset, size_t size) {
+    vector<uint8_t> data(size);
+    uint8_t* p = data.data();
+    size_t remaining = data.size();
+    while (remaining > 0) {
+        ssize_t numRead = TEMP_FAILURE_RETRY(pread64(fd, p, remaining, offset));
+        if (numRead < 0) {
+            PLOG(ERROR) << "Failed reading " << size << " bytes at offset " << offset;
+            return {};
+        }
+        if (numRead == 0) {
+            LOG(ERROR) << "Unexpected end of file reading " << size << " bytes at offset "
+                       << offset;
+            return {};
+        }
+        p += numRead;
+        offset += numRead;
+        remaining -= numRead;
+    }
+    return data;
+}
+
 bool fileSetContents(const string& path, const vector<uint8_t>& data) {
+    return fileSetContents(path,
+                           [&data](int fd) { return fileWriteAll(fd, data.data(), data.size()); });
+}
+
+bool fileSetContents(const string& path, const std::function<bool(int fd)>& writeContents) {
     char tempName[4096];
     int fd;
 
@@ -97,17 +164,11 @@ bool fileSetContents(const string& path, const vector<uint8_t>& data) {
         return false;
     }
 
-    const uint8_t* p = data.data();
-    size_t remaining = data.size();
-    while (remaining > 0) {
-        ssize_t numWritten = TEMP_FAILURE_RETRY(write(fd, p, remaining));
-        if (numWritten <= 0) {
-            PLOG(ERROR) << "Failed writing into temp file for '" << path << "'";
-            close(fd);
-            return false;
-        }
-        p += numWritten;
-        remaining -= numWritten;
+    if (!writeContents(fd)) {
+        LOG(ERROR) << "Failed writing into temp file for '" << path << "'";
+        close(fd);
+        unlink(tempName);
+        return false;
     }
 
     if (TEMP_FAILURE_RETRY(fsync(fd))) {
@@ -126,6 +187,66 @@ bool fileSetContents(const string& path, const vector<uint8_t>& data) {
     return true;
 }
 
+Status retrieveEntryValue(IIdentityCredential* halBinder,
+                          const vector<vector<uint8_t>>& encryptedChunks, uint64_t size,
+                          vector<uint8_t>* value) {
+    value->clear();
+    // The common single chunk entry is decrypted in place.
+    if (encryptedChunks.size() == 1) {
+        return halBinder->retrieveEntryValue(encryptedChunks[0], value);
+    }
+
+    // Each chunk is at least as large encrypted as it is in plaintext, which bounds the
+    // reservation if |size| is bogus.
+    uint64_t encryptedSize = 0;
+    for (const vector<uint8_t>& encryptedChunk : encryptedChunks) {
+        encryptedSize += encryptedChunk.size();
+    }
+    value->reserve(std::min(size, encryptedSize));
+
+    vector<uint8_t> chunk;
+    for (const vector<uint8_t>& encryptedChunk : encryptedChunks) {
+        Status status = halBinder->retrieveEntryValue(encryptedChunk, &chunk);
+        if (!status.isOk()) {
+            return status;
+        }
+        value->insert(value->end(), chunk.begin(), chunk.end());
+    }
+    return Status::ok();
+}
+
+Status addEntryValue(IWritableIdentityCredential* halBinder, const vector<uint8_t>& value,
+                     size_t chunkSize, CredentialData* data, EntryData* entryData) {
+    vector<uint8_t> encryptedChunk;
+    if (value.size() <= chunkSize) {
+        Status status = halBinder->addEntryValue(value, &encryptedChunk);
+        if (!status.isOk()) {
+            return halStatusToGenericError(status);
+        }
+        entryData->encryptedChunks.push_back(std::move(encryptedChunk));
+        return Status::ok();
+    }
+
+    if (!data->createStagingFile()) {
+        return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
+                                                "Error creating staging file");
+    }
+    vector<uint8_t> chunk;
+    for (size_t pos = 0; pos < value.size(); pos += chunkSize) {
+        size_t size = std::min(chunkSize, value.size() - pos);
+        chunk.assign(value.begin() + pos, value.begin() + pos + size);
+        Status status = halBinder->addEntryValue(chunk, &encryptedChunk);
+        if (!status.isOk()) {
+            return halStatusToGenericError(status);
+        }
+        if (!data->stageEncryptedChunk(encryptedChunk, entryData)) {
+            return Status::fromServiceSpecificError(ICredentialStore::ERROR_GENERIC,
+                                                    "Error staging encrypted data");
+        }
+    }
+    return Status::ok();
+}
+
 }  // namespace identity
 }  // namespace security
 }  // namespace android
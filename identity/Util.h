@@ -17,9 +17,12 @@
 #ifndef SYSTEM_SECURITY_IDENTITY_UTIL_H_
 #define SYSTEM_SECURITY_IDENTITY_UTIL_H_
 
+#include <functional>
 #include <string>
 #include <vector>
 
+#include <android/hardware/identity/IIdentityCredential.h>
+#include <android/hardware/identity/IWritableIdentityCredential.h>
 #include <binder/Status.h>
 
 namespace android {
@@ -31,6 +34,11 @@ using ::std::string;
 using ::std::vector;
 
 using ::android::binder::Status;
+using ::android::hardware::identity::IIdentityCredential;
+using ::android::hardware::identity::IWritableIdentityCredential;
+
+class CredentialData;
+struct EntryData;
 
 // Converts a HAL status to a credstore service-specific error with code
 // ICredentialStore::ERROR_GENERIC.
@@ -45,12 +53,56 @@ Status halStatusToError(const Status& halStatus, int credStoreError);
 //
 bool fileSetContents(const string& path, const vector<uint8_t>& data);
 
+// Like fileSetContents(), but the contents are written by |writeContents| into the file
+// descriptor passed to it, so they don't have to be held in memory all at once.
+//
+// |writeContents| returns false on error, and so does this function.
+//
+bool fileSetContents(const string& path, const std::function<bool(int fd)>& writeContents);
+
+// Helper function which writes |size| bytes at |data| to the file open as |fd|.
+//
+// Returns true on success, false on error.
+//
+bool fileWriteAll(int fd, const uint8_t* data, size_t size);
+
+// Helper function which copies |size| bytes at |offset| of the file open as |fromFd| to the file
+// open as |toFd|.
+//
+// Returns true on success, false on error or if |fromFd| ends early.
+//
+bool fileCopyRange(int fromFd, uint64_t offset, uint64_t size, int toFd);
+
 // Helper function which reads contents offile at |path| into |data|.
 //
 // Returns nothing on error, the content on success.
 //
 optional<vector<uint8_t>> fileGetContents(const string& path);
 
+// Helper function which reads |size| bytes at |offset| of the file open as |fd|.
+//
+// Returns nothing on error or if the file ends early, the content on success.
+//
+optional<vector<uint8_t>> fileReadRange(int fd, uint64_t offset, size_t size);
+
+// Decrypts the |encryptedChunks| of an entry with |halBinder|, on which startRetrieveEntryValue()
+// has been called for the entry, and stores the plaintext of |size| bytes in |value|.
+//
+// Returns the status of the first failing HAL call, if any.
+//
+Status retrieveEntryValue(IIdentityCredential* halBinder,
+                          const vector<vector<uint8_t>>& encryptedChunks, uint64_t size,
+                          vector<uint8_t>* value);
+
+// Encrypts |value| in chunks of |chunkSize| bytes with |halBinder|, on which beginAddEntry() has
+// been called for the entry, and stores the encrypted chunks in |entryData|. The chunks of values
+// larger than one chunk are streamed into the staging file of |data| as they are encrypted.
+//
+// Returns a credstore error on failure.
+//
+Status addEntryValue(IWritableIdentityCredential* halBinder, const vector<uint8_t>& value,
+                     size_t chunkSize, CredentialData* data, EntryData* entryData);
+
 }  // namespace identity
 }  // namespace security
 }  // namespace android
@@ -36,14 +36,13 @@ using ::std::pair;
 
 using ::android::hardware::identity::SecureAccessControlProfile;
 
-using ::android::hardware::identity::support::chunkVector;
-
 WritableCredential::WritableCredential(const string& dataPath, const string& credentialName,
                                        const string& docType, bool isUpdate,
                                        HardwareInformation hwInfo,
-                                       sp<IWritableIdentityCredential> halBinder)
+                                       sp<IWritableIdentityCredential> halBinder,
+                                       sp<CredentialDataCache> dataCache)
     : dataPath_(dataPath), credentialName_(credentialName), docType_(docType), isUpdate_(isUpdate),
-      hwInfo_(std::move(hwInfo)), halBinder_(halBinder) {}
+      hwInfo_(std::move(hwInfo)), halBinder_(halBinder), dataCache_(std::move(dataCache)) {}
 
 WritableCredential::~WritableCredential() {}
 
@@ -177,7 +176,7 @@ WritableCredential::personalize(const vector<AccessControlProfileParcel>& access
     }
 
     uid_t callingUid = android::IPCThreadState::self()->getCallingUid();
-    CredentialData data = CredentialData(dataPath_, callingUid, credentialName_);
+    CredentialData data = CredentialData(dataPath_, callingUid, credentialName_, dataCache_);
 
     // Note: The value 0 is used to convey that no user-authentication is needed for this
     // credential. This is to allow creating credentials w/o user authentication on devices
@@ -225,8 +224,6 @@ WritableCredential::personalize(const vector<AccessControlProfileParcel>& access
 
     for (const EntryNamespaceParcel& ensParcel : entryNamespaces) {
         for (const EntryParcel& eParcel : ensParcel.entries) {
-            vector<vector<uint8_t>> chunks = chunkVector(eParcel.value, hwInfo_.dataChunkSize);
-
             vector<int32_t> ids;
             std::copy(eParcel.accessControlProfileIds.begin(),
                       eParcel.accessControlProfileIds.end(), std::back_inserter(ids));
@@ -237,20 +234,15 @@ WritableCredential::personalize(const vector<AccessControlProfileParcel>& access
                 return halStatusToGenericError(status);
             }
 
-            vector<vector<uint8_t>> encryptedChunks;
-            for (const auto& chunk : chunks) {
-                vector<uint8_t> encryptedChunk;
-                status = halBinder_->addEntryValue(chunk, &encryptedChunk);
-                if (!status.isOk()) {
-                    return halStatusToGenericError(status);
-                }
-                encryptedChunks.push_back(encryptedChunk);
-            }
             EntryData eData;
             eData.size = eParcel.value.size();
             eData.accessControlProfileIds = std::move(ids);
-            eData.encryptedChunks = std::move(encryptedChunks);
-            data.addEntryData(ensParcel.namespaceName, eParcel.name, eData);
+            status = addEntryValue(halBinder_.get(), eParcel.value, hwInfo_.dataChunkSize, &data,
+                                   &eData);
+            if (!status.isOk()) {
+                return status;
+            }
+            data.addEntryData(ensParcel.namespaceName, eParcel.name, std::move(eData));
         }
     }
 
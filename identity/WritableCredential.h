@@ -40,7 +40,8 @@ class WritableCredential : public BnWritableCredential {
   public:
     WritableCredential(const string& dataPath, const string& credentialName, const string& docType,
                        bool isUpdate, HardwareInformation hwInfo,
-                       sp<IWritableIdentityCredential> halBinder);
+                       sp<IWritableIdentityCredential> halBinder,
+                       sp<CredentialDataCache> dataCache);
     ~WritableCredential();
 
     // Used when updating a credential
@@ -66,6 +67,7 @@ class WritableCredential : public BnWritableCredential {
     bool isUpdate_;
     HardwareInformation hwInfo_;
     sp<IWritableIdentityCredential> halBinder_;
+    sp<CredentialDataCache> dataCache_;
 
     vector<uint8_t> attestationCertificate_;
     int keyCount_ = 0;
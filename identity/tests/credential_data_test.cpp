@@ -0,0 +1,454 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <cppbor.h>
+#include <gtest/gtest.h>
+
+#include "../CredentialData.h"
+#include "../CredentialDataCache.h"
+#include "../Util.h"
+
+namespace android {
+namespace security {
+namespace identity {
+
+namespace {
+
+constexpr uid_t kOwnerUid = 1000;
+constexpr char kName[] = "credential";
+
+// The members of the header that every credential file has.
+void addCommonMembers(cppbor::Map* map, cppbor::Array authKeyData = cppbor::Array()) {
+    map->add("secureUserId", int64_t(42));
+    map->add("credentialData", vector<uint8_t>{1, 2, 3});
+    map->add("attestationCertificate", vector<uint8_t>{4, 5});
+    map->add("secureAccessControlProfiles", cppbor::Array());
+    map->add("authKeyCount", int64_t(authKeyData.size()));
+    map->add("maxUsesPerAuthKey", 1);
+    map->add("minValidTimeMillis", 0);
+    map->add("authKeyData", std::move(authKeyData));
+}
+
+cppbor::Array makeIds(const vector<int32_t>& ids) {
+    cppbor::Array array;
+    for (int32_t id : ids) {
+        array.add(id);
+    }
+    return array;
+}
+
+// Builds a file in the indexed format by hand, with the given index and chunk area.
+vector<uint8_t> makeIndexedFile(cppbor::Map entryIndex, const vector<uint8_t>& chunkArea) {
+    cppbor::Map map;
+    addCommonMembers(&map);
+    map.add("entryIndex", std::move(entryIndex));
+    vector<uint8_t> header = map.encode();
+    vector<uint8_t> file = {'C', 'R', 'D', '2'};
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        file.push_back(uint8_t(header.size() >> shift));
+    }
+    file.insert(file.end(), header.begin(), header.end());
+    file.insert(file.end(), chunkArea.begin(), chunkArea.end());
+    return file;
+}
+
+cppbor::Array makeIndexEntry(uint64_t size, int64_t chunksOffset,
+                             const vector<int64_t>& chunkSizes) {
+    cppbor::Array entry;
+    entry.add(size);
+    entry.add(makeIds({1}));
+    entry.add(chunksOffset);
+    cppbor::Array sizes;
+    for (int64_t chunkSize : chunkSizes) {
+        sizes.add(chunkSize);
+    }
+    entry.add(std::move(sizes));
+    return entry;
+}
+
+int totalUseCount(const CredentialData& data) {
+    int total = 0;
+    for (const AuthKeyData& authKeyData : data.getAuthKeyDatas()) {
+        total += authKeyData.useCount;
+    }
+    return total;
+}
+
+class CredentialDataTest : public ::testing::Test {
+  protected:
+    sp<CredentialData> newData(sp<CredentialDataCache> cache = nullptr) {
+        return new CredentialData(dir_.path, kOwnerUid, kName, cache);
+    }
+
+    string fileName() const {
+        return CredentialData::calculateCredentialFileName(dir_.path, kOwnerUid, kName);
+    }
+
+    string journalName() const { return fileName() + ".journal"; }
+
+    // Writes a credential with two certified auth keys, the second of which has a pending
+    // certificate, |pendingCertificate|, too.
+    void writeCredentialWithAuthKeys() {
+        cppbor::Array authKeyData;
+        for (uint8_t n = 0; n < 2; n++) {
+            authKeyData.add(cppbor::Array(vector<uint8_t>{uint8_t(0x10 + n)} /* certificate */,
+                                          vector<uint8_t>{n} /* keyBlob */,
+                                          vector<uint8_t>{} /* staticAuthenticationData */,
+                                          n == 1 ? pendingCertificate : vector<uint8_t>{},
+                                          vector<uint8_t>{} /* pendingKeyBlob */,
+                                          0 /* useCount */, INT64_MAX /* expiration */));
+        }
+        cppbor::Map map;
+        addCommonMembers(&map, std::move(authKeyData));
+        ASSERT_TRUE(fileSetContents(fileName(), map.encode()));
+
+        // Rewriting the file gives it a journal id.
+        sp<CredentialData> data = newData();
+        ASSERT_TRUE(data->loadFromDisk());
+        ASSERT_TRUE(data->saveToDisk());
+    }
+
+    // Uses an auth key and saves that to the journal.
+    void useAuthKey(CredentialData* data) {
+        ASSERT_NE(data->selectAuthKey(true /* allowUsingExhaustedKeys */,
+                                      false /* allowUsingExpiredKeys */,
+                                      true /* incrementUsageCount */),
+                  nullptr);
+        ASSERT_TRUE(data->saveJournalToDisk());
+    }
+
+    const vector<uint8_t> pendingCertificate = {0x20};
+
+    TemporaryDir dir_;
+};
+
+}  // namespace
+
+TEST_F(CredentialDataTest, LegacyFileIsConvertedToIndexedFormat) {
+    // A file in the single map format, as written before the indexed format was introduced.
+    cppbor::Map map;
+    addCommonMembers(&map);
+    cppbor::Map entryData;
+    for (const auto& [name, chunks] :
+         {std::pair<string, vector<vector<uint8_t>>>{"a", {{1, 2, 3}, {4}}},
+          std::pair<string, vector<vector<uint8_t>>>{"b", {{5, 6}}}}) {
+        cppbor::Array entry;
+        entry.add(uint64_t(chunks.size() * 10));
+        entry.add(makeIds({1, 2}));
+        cppbor::Array chunksArray;
+        for (const auto& chunk : chunks) {
+            chunksArray.add(chunk);
+        }
+        entry.add(std::move(chunksArray));
+        entryData.add("ns:" + name, std::move(entry));
+    }
+    map.add("entryData", std::move(entryData));
+    ASSERT_TRUE(fileSetContents(fileName(), map.encode()));
+
+    sp<CredentialData> legacy = newData();
+    ASSERT_TRUE(legacy->loadFromDisk());
+    EXPECT_EQ(legacy->getSecureUserId(), 42);
+    ASSERT_TRUE(legacy->saveToDisk());
+
+    optional<vector<uint8_t>> contents = fileGetContents(fileName());
+    ASSERT_TRUE(contents);
+    ASSERT_GE(contents->size(), 4u);
+    EXPECT_EQ(vector<uint8_t>(contents->begin(), contents->begin() + 4),
+              (vector<uint8_t>{'C', 'R', 'D', '2'}));
+
+    sp<CredentialData> indexed = newData();
+    ASSERT_TRUE(indexed->loadFromDisk());
+    EXPECT_EQ(indexed->getSecureUserId(), 42);
+    EXPECT_EQ(indexed->getCredentialData(), (vector<uint8_t>{1, 2, 3}));
+    EXPECT_EQ(indexed->getAttestationCertificate(), (vector<uint8_t>{4, 5}));
+
+    optional<EntryData> a = indexed->getEntryData("ns", "a");
+    ASSERT_TRUE(a);
+    EXPECT_EQ(a->size, 20u);
+    EXPECT_EQ(a->accessControlProfileIds, (vector<int32_t>{1, 2}));
+    EXPECT_EQ(a->encryptedChunks, (vector<vector<uint8_t>>{{1, 2, 3}, {4}}));
+    optional<EntryData> b = indexed->getEntryData("ns", "b");
+    ASSERT_TRUE(b);
+    EXPECT_EQ(b->encryptedChunks, (vector<vector<uint8_t>>{{5, 6}}));
+    EXPECT_FALSE(indexed->getEntryData("ns", "c"));
+}
+
+TEST_F(CredentialDataTest, GetEntryDataReadsChunksFromFile) {
+    sp<CredentialData> data = newData();
+    data->setCredentialData({1});
+    data->setAttestationCertificate({2});
+    vector<vector<uint8_t>> chunks = {vector<uint8_t>(100, 0xaa), vector<uint8_t>(7, 0xbb)};
+    EntryData entry;
+    entry.size = 107;
+    entry.accessControlProfileIds = {3};
+    entry.encryptedChunks = chunks;
+    data->addEntryData("ns", "big", entry);
+    EntryData small;
+    small.size = 1;
+    small.encryptedChunks = {{0xcc}};
+    data->addEntryData("ns", "small", small);
+    ASSERT_TRUE(data->saveToDisk());
+
+    sp<CredentialData> loaded = newData();
+    ASSERT_TRUE(loaded->loadFromDisk());
+
+    // Only the index is loaded.
+    optional<EntryData> metadata = loaded->getEntryMetadata("ns", "big");
+    ASSERT_TRUE(metadata);
+    EXPECT_EQ(metadata->size, 107u);
+    EXPECT_EQ(metadata->accessControlProfileIds, (vector<int32_t>{3}));
+    EXPECT_TRUE(metadata->encryptedChunks.empty());
+
+    // The chunks are read from the file that was loaded, which is kept open, even once the
+    // credential file is gone.
+    ASSERT_EQ(unlink(fileName().c_str()), 0);
+    optional<EntryData> big = loaded->getEntryData("ns", "big");
+    ASSERT_TRUE(big);
+    EXPECT_EQ(big->encryptedChunks, chunks);
+    optional<EntryData> read = loaded->getEntryData("ns", "small");
+    ASSERT_TRUE(read);
+    EXPECT_EQ(read->encryptedChunks, (vector<vector<uint8_t>>{{0xcc}}));
+}
+
+TEST_F(CredentialDataTest, AcceptsChunksEndingAtChunkArea) {
+    cppbor::Map entryIndex;
+    entryIndex.add("ns:a", makeIndexEntry(3, 1, {2, 1}));
+    ASSERT_TRUE(fileSetContents(fileName(), makeIndexedFile(std::move(entryIndex), {9, 8, 7, 6})));
+
+    sp<CredentialData> data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    optional<EntryData> entry = data->getEntryData("ns", "a");
+    ASSERT_TRUE(entry);
+    EXPECT_EQ(entry->encryptedChunks, (vector<vector<uint8_t>>{{8, 7}, {6}}));
+}
+
+TEST_F(CredentialDataTest, RejectsChunksOffsetOutOfBounds) {
+    cppbor::Map entryIndex;
+    entryIndex.add("ns:a", makeIndexEntry(1, 5, {1}));
+    ASSERT_TRUE(fileSetContents(fileName(), makeIndexedFile(std::move(entryIndex), {9, 8, 7, 6})));
+    EXPECT_FALSE(newData()->loadFromDisk());
+}
+
+TEST_F(CredentialDataTest, RejectsNegativeChunksOffset) {
+    cppbor::Map entryIndex;
+    entryIndex.add("ns:a", makeIndexEntry(1, -1, {1}));
+    ASSERT_TRUE(fileSetContents(fileName(), makeIndexedFile(std::move(entryIndex), {9, 8, 7, 6})));
+    EXPECT_FALSE(newData()->loadFromDisk());
+}
+
+TEST_F(CredentialDataTest, RejectsChunkSizesOutOfBounds) {
+    cppbor::Map entryIndex;
+    entryIndex.add("ns:a", makeIndexEntry(5, 1, {2, 2}));
+    ASSERT_TRUE(fileSetContents(fileName(), makeIndexedFile(std::move(entryIndex), {9, 8, 7, 6})));
+    EXPECT_FALSE(newData()->loadFromDisk());
+}
+
+TEST_F(CredentialDataTest, RejectsNegativeChunkSize) {
+    cppbor::Map entryIndex;
+    entryIndex.add("ns:a", makeIndexEntry(1, 2, {2, -1}));
+    ASSERT_TRUE(fileSetContents(fileName(), makeIndexedFile(std::move(entryIndex), {9, 8, 7, 6})));
+    EXPECT_FALSE(newData()->loadFromDisk());
+}
+
+TEST_F(CredentialDataTest, RejectsChunkSizesOverflowing) {
+    cppbor::Map entryIndex;
+    entryIndex.add("ns:a", makeIndexEntry(1, 1, {INT64_MAX, INT64_MAX, 2}));
+    ASSERT_TRUE(fileSetContents(fileName(), makeIndexedFile(std::move(entryIndex), {9, 8, 7, 6})));
+    EXPECT_FALSE(newData()->loadFromDisk());
+}
+
+TEST_F(CredentialDataTest, RejectsTruncatedHeader) {
+    cppbor::Map entryIndex;
+    entryIndex.add("ns:a", makeIndexEntry(1, 0, {1}));
+    vector<uint8_t> file = makeIndexedFile(std::move(entryIndex), {});
+
+    // The header is declared to be longer than the file.
+    file.resize(file.size() - 1);
+    ASSERT_TRUE(fileSetContents(fileName(), file));
+    EXPECT_FALSE(newData()->loadFromDisk());
+
+    // Not even the size of the header is complete.
+    file.resize(6);
+    ASSERT_TRUE(fileSetContents(fileName(), file));
+    EXPECT_FALSE(newData()->loadFromDisk());
+}
+
+TEST_F(CredentialDataTest, JournalIsReplayed) {
+    writeCredentialWithAuthKeys();
+    optional<vector<uint8_t>> contents = fileGetContents(fileName());
+    ASSERT_TRUE(contents);
+
+    for (int n = 0; n < 3; n++) {
+        sp<CredentialData> data = newData();
+        ASSERT_TRUE(data->loadFromDisk());
+        EXPECT_EQ(totalUseCount(*data), n);
+        useAuthKey(data.get());
+    }
+    sp<CredentialData> data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    EXPECT_EQ(totalUseCount(*data), 3);
+
+    // Only the journal was written to.
+    EXPECT_EQ(fileGetContents(fileName()), contents);
+    EXPECT_EQ(access(journalName().c_str(), F_OK), 0);
+}
+
+TEST_F(CredentialDataTest, JournalReplaysStaticAuthenticationData) {
+    writeCredentialWithAuthKeys();
+    sp<CredentialData> data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    ASSERT_TRUE(data->storeStaticAuthenticationData(pendingCertificate, 1234, {0xaa}));
+    ASSERT_TRUE(data->saveJournalToDisk());
+
+    sp<CredentialData> loaded = newData();
+    ASSERT_TRUE(loaded->loadFromDisk());
+    const AuthKeyData& authKeyData = loaded->getAuthKeyDatas()[1];
+    EXPECT_EQ(authKeyData.certificate, pendingCertificate);
+    EXPECT_TRUE(authKeyData.pendingCertificate.empty());
+    EXPECT_EQ(authKeyData.staticAuthenticationData, (vector<uint8_t>{0xaa}));
+    EXPECT_EQ(authKeyData.expirationDateMillisSinceEpoch, 1234);
+}
+
+TEST_F(CredentialDataTest, TornJournalTailIsDropped) {
+    writeCredentialWithAuthKeys();
+    sp<CredentialData> data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    useAuthKey(data.get());
+
+    // The start of a record, as left behind by a crash while appending it.
+    optional<vector<uint8_t>> journal = fileGetContents(journalName());
+    ASSERT_TRUE(journal);
+    journal->push_back(0x83);
+    ASSERT_TRUE(fileSetContents(journalName(), journal.value()));
+
+    data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    EXPECT_EQ(totalUseCount(*data), 1);
+    useAuthKey(data.get());
+
+    data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    EXPECT_EQ(totalUseCount(*data), 2);
+}
+
+TEST_F(CredentialDataTest, StaleJournalIsIgnored) {
+    writeCredentialWithAuthKeys();
+    sp<CredentialData> data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    useAuthKey(data.get());
+    useAuthKey(data.get());
+    optional<vector<uint8_t>> staleJournal = fileGetContents(journalName());
+    ASSERT_TRUE(staleJournal);
+
+    // A crash after the credential file was replaced but before the journal was deleted.
+    data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    data->setAvailableAuthenticationKeys(2, 1, 0);
+    ASSERT_TRUE(data->saveToDisk());
+    EXPECT_NE(access(journalName().c_str(), F_OK), 0);
+    ASSERT_TRUE(fileSetContents(journalName(), staleJournal.value()));
+
+    // The journal of the previous version isn't applied twice, and is replaced on the next save.
+    data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    EXPECT_EQ(totalUseCount(*data), 2);
+    useAuthKey(data.get());
+    data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    EXPECT_EQ(totalUseCount(*data), 3);
+}
+
+TEST_F(CredentialDataTest, JournalIsCompacted) {
+    writeCredentialWithAuthKeys();
+    sp<CredentialData> data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+
+    // Each use count record takes a dozen bytes, so the journal outgrows its limit of 64 KiB
+    // after a couple of rounds.
+    int uses = 0;
+    for (int round = 0; round < 4; round++) {
+        for (int n = 0; n < 2000; n++, uses++) {
+            ASSERT_NE(data->selectAuthKey(true, false, true), nullptr);
+        }
+        ASSERT_TRUE(data->saveJournalToDisk());
+        if (access(journalName().c_str(), F_OK) != 0) {
+            break;
+        }
+    }
+    // The credential file was rewritten instead, deleting the journal.
+    EXPECT_NE(access(journalName().c_str(), F_OK), 0);
+
+    data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    EXPECT_EQ(totalUseCount(*data), uses);
+}
+
+TEST_F(CredentialDataTest, CachesSeeJournalAppendsThroughOtherCaches) {
+    writeCredentialWithAuthKeys();
+    // The default and the direct access CredentialStore each have a cache.
+    sp<CredentialDataCache> cacheA = new CredentialDataCache();
+    sp<CredentialDataCache> cacheB = new CredentialDataCache();
+    ASSERT_TRUE(newData(cacheA)->loadFromDisk());
+    ASSERT_TRUE(newData(cacheB)->loadFromDisk());
+
+    sp<CredentialData> data = newData(cacheA);
+    ASSERT_TRUE(data->loadFromDisk());
+    useAuthKey(data.get());
+    data = newData(cacheB);
+    ASSERT_TRUE(data->loadFromDisk());
+    EXPECT_EQ(totalUseCount(*data), 1);
+    useAuthKey(data.get());
+    data = newData(cacheA);
+    ASSERT_TRUE(data->loadFromDisk());
+    EXPECT_EQ(totalUseCount(*data), 2);
+    useAuthKey(data.get());
+
+    data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    EXPECT_EQ(totalUseCount(*data), 3);
+}
+
+TEST_F(CredentialDataTest, StaleDataDoesNotTruncateJournal) {
+    writeCredentialWithAuthKeys();
+    sp<CredentialData> stale = newData();
+    ASSERT_TRUE(stale->loadFromDisk());
+
+    sp<CredentialData> data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    useAuthKey(data.get());
+    useAuthKey(data.get());
+
+    // Appending after the records |stale| doesn't know about would lose track of them, and
+    // truncating the journal would drop them, so the credential file is rewritten instead.
+    optional<vector<uint8_t>> contents = fileGetContents(fileName());
+    useAuthKey(stale.get());
+    EXPECT_NE(fileGetContents(fileName()), contents);
+    EXPECT_NE(access(journalName().c_str(), F_OK), 0);
+
+    data = newData();
+    ASSERT_TRUE(data->loadFromDisk());
+    EXPECT_EQ(totalUseCount(*data), 1);
+}
+
+}  // namespace identity
+}  // namespace security
+}  // namespace android
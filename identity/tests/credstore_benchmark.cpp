@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <malloc.h>
+#include <stdlib.h>
+
+#include <atomic>
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+#include <android/hardware/identity/IIdentityCredential.h>
+#include <android/hardware/identity/IWritableIdentityCredential.h>
+
+#include "../CredentialData.h"
+#include "../Util.h"
+
+using ::android::sp;
+using ::android::binder::Status;
+using ::android::hardware::identity::IIdentityCredentialDefault;
+using ::android::hardware::identity::IWritableIdentityCredentialDefault;
+using ::android::security::identity::addEntryValue;
+using ::android::security::identity::CredentialData;
+using ::android::security::identity::EntryData;
+using ::android::security::identity::retrieveEntryValue;
+using ::std::vector;
+
+// The number of bytes currently allocated with operator new, and the most there have been since
+// the last reset, to compare how much memory each way of adding entries needs.
+static std::atomic<size_t> gAllocatedBytes;
+static std::atomic<size_t> gPeakAllocatedBytes;
+
+void* operator new(size_t size) {
+    void* p = malloc(size);
+    if (p == nullptr) {
+        abort();
+    }
+    size_t allocated = gAllocatedBytes += malloc_usable_size(p);
+    size_t peak = gPeakAllocatedBytes;
+    while (allocated > peak && !gPeakAllocatedBytes.compare_exchange_weak(peak, allocated)) {
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    if (p != nullptr) {
+        gAllocatedBytes -= malloc_usable_size(p);
+        free(p);
+    }
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+namespace {
+
+// AES-GCM nonce and tag, which the HAL adds to every chunk.
+constexpr size_t kEncryptionOverhead = 12 + 16;
+
+// Stands in for the HAL, without any IPC or decryption, so only the cost of credstore's own
+// handling of the chunks is measured.
+class FakeIdentityCredential : public IIdentityCredentialDefault {
+  public:
+    Status retrieveEntryValue(const vector<uint8_t>& encryptedContent,
+                              vector<uint8_t>* _aidl_return) override {
+        _aidl_return->assign(encryptedContent.begin() + kEncryptionOverhead,
+                             encryptedContent.end());
+        return Status::ok();
+    }
+};
+
+vector<vector<uint8_t>> makeEncryptedChunks(size_t entrySize, size_t chunkSize) {
+    vector<vector<uint8_t>> encryptedChunks;
+    for (size_t offset = 0; offset < entrySize; offset += chunkSize) {
+        size_t size = std::min(chunkSize, entrySize - offset);
+        encryptedChunks.emplace_back(size + kEncryptionOverhead, 0x5a);
+    }
+    return encryptedChunks;
+}
+
+// The way entries were retrieved before retrieveEntryValue(), for comparison.
+void BM_RetrieveEntryValueConcatenate(benchmark::State& state) {
+    sp<FakeIdentityCredential> hal = new FakeIdentityCredential();
+    auto encryptedChunks = makeEncryptedChunks(state.range(0), state.range(1));
+    for (auto _ : state) {
+        vector<uint8_t> value;
+        for (const auto& encryptedChunk : encryptedChunks) {
+            vector<uint8_t> chunk;
+            if (!hal->retrieveEntryValue(encryptedChunk, &chunk).isOk()) {
+                state.SkipWithError("retrieveEntryValue failed");
+            }
+            value.insert(value.end(), chunk.begin(), chunk.end());
+        }
+        vector<uint8_t> copy = value;
+        benchmark::DoNotOptimize(copy.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RetrieveEntryValueConcatenate)
+    ->Args({1024, 4096})
+    ->Args({64 * 1024, 4096})
+    ->Args({1024 * 1024, 4096})
+    ->Args({1024 * 1024, 64 * 1024});
+
+void BM_RetrieveEntryValue(benchmark::State& state) {
+    sp<FakeIdentityCredential> hal = new FakeIdentityCredential();
+    auto encryptedChunks = makeEncryptedChunks(state.range(0), state.range(1));
+    for (auto _ : state) {
+        vector<uint8_t> value;
+        if (!retrieveEntryValue(hal.get(), encryptedChunks, state.range(0), &value).isOk()) {
+            state.SkipWithError("retrieveEntryValue failed");
+        }
+        vector<uint8_t> moved = std::move(value);
+        benchmark::DoNotOptimize(moved.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RetrieveEntryValue)
+    ->Args({1024, 4096})
+    ->Args({64 * 1024, 4096})
+    ->Args({1024 * 1024, 4096})
+    ->Args({1024 * 1024, 64 * 1024});
+
+class FakeWritableIdentityCredential : public IWritableIdentityCredentialDefault {
+  public:
+    Status addEntryValue(const vector<uint8_t>& content, vector<uint8_t>* _aidl_return) override {
+        _aidl_return->resize(content.size() + kEncryptionOverhead);
+        std::copy(content.begin(), content.end(), _aidl_return->begin());
+        return Status::ok();
+    }
+};
+
+// Adds an entry of state.range(0) bytes in chunks of state.range(1) bytes to a new credential and
+// saves it, reporting the peak memory used on top of the plaintext.
+void personalizeBenchmark(benchmark::State& state, bool stream) {
+    sp<FakeWritableIdentityCredential> hal = new FakeWritableIdentityCredential();
+    vector<uint8_t> value(state.range(0), 0x5a);
+    size_t chunkSize = state.range(1);
+    TemporaryDir dataPath;
+    size_t peakBytes = 0;
+    for (auto _ : state) {
+        gPeakAllocatedBytes = size_t(gAllocatedBytes);
+        size_t baseBytes = gPeakAllocatedBytes;
+        {
+            CredentialData data(dataPath.path, 0, "credential");
+            EntryData entryData;
+            entryData.size = value.size();
+            if (stream) {
+                if (!addEntryValue(hal.get(), value, chunkSize, &data, &entryData).isOk()) {
+                    state.SkipWithError("addEntryValue failed");
+                }
+            } else {
+                // How personalize() added entries before they were streamed.
+                for (size_t pos = 0; pos < value.size(); pos += chunkSize) {
+                    vector<uint8_t> chunk(value.begin() + pos,
+                                          value.begin() + std::min(pos + chunkSize, value.size()));
+                    vector<uint8_t> encryptedChunk;
+                    if (!hal->addEntryValue(chunk, &encryptedChunk).isOk()) {
+                        state.SkipWithError("addEntryValue failed");
+                    }
+                    entryData.encryptedChunks.push_back(std::move(encryptedChunk));
+                }
+            }
+            data.addEntryData("namespace", "entry", std::move(entryData));
+            if (!data.saveToDisk()) {
+                state.SkipWithError("saveToDisk failed");
+            }
+        }
+        peakBytes = std::max(peakBytes, gPeakAllocatedBytes - baseBytes);
+    }
+    state.counters["peak_bytes"] = peakBytes;
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void BM_PersonalizeInMemory(benchmark::State& state) {
+    personalizeBenchmark(state, false /* stream */);
+}
+BENCHMARK(BM_PersonalizeInMemory)
+    ->Args({64 * 1024, 4096})
+    ->Args({1024 * 1024, 4096})
+    ->Args({8 * 1024 * 1024, 64 * 1024});
+
+void BM_PersonalizeStreamed(benchmark::State& state) {
+    personalizeBenchmark(state, true /* stream */);
+}
+BENCHMARK(BM_PersonalizeStreamed)
+    ->Args({64 * 1024, 4096})
+    ->Args({1024 * 1024, 4096})
+    ->Args({8 * 1024 * 1024, 64 * 1024});
+
+}  // namespace
+
+BENCHMARK_MAIN();
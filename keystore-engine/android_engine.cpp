@@ -29,6 +29,8 @@
 extern "C" {
 
 EVP_PKEY* EVP_PKEY_from_keystore(const char* key_id) __attribute__((visibility("default")));
+EVP_PKEY* EVP_PKEY_from_keystore_session(const char* key_id)
+    __attribute__((visibility("default")));
 
 /* EVP_PKEY_from_keystore returns an |EVP_PKEY| that contains either an RSA or
  * ECDSA key where the public part of the key reflects the value of the key
@@ -40,4 +42,14 @@ EVP_PKEY* EVP_PKEY_from_keystore(const char* key_id) {
     return EVP_PKEY_from_keystore2(key_id);
 }
 
+/* EVP_PKEY_from_keystore_session is like EVP_PKEY_from_keystore, but the
+ * Keystore operation for the next signature is created while the current
+ * signature is in flight. Use it for keys that sign repeatedly, e.g. for TLS
+ * handshakes. */
+EVP_PKEY* EVP_PKEY_from_keystore_session(const char* key_id) {
+    ALOGV("EVP_PKEY_from_keystore_session(\"%s\")", key_id);
+
+    return EVP_PKEY_from_keystore2_session(key_id);
+}
+
 }  // extern "C"
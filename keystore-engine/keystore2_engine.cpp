@@ -15,6 +15,7 @@
  */
 
 #include "keystore2_engine.h"
+#include "keystore2_signing_session.h"
 
 #include <aidl/android/system/keystore2/IKeystoreService.h>
 #include <android-base/logging.h>
@@ -33,6 +34,12 @@
 #include <openssl/rsa.h>
 #include <openssl/x509.h>
 
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <tuple>
+
 #define AT __func__ << ":" << __LINE__ << " "
 
 constexpr const char keystore2_service_name[] = "android.system.keystore2.IKeystoreService/default";
@@ -61,10 +68,7 @@ int64_t getNamespaceforCurrentUid() {
     }
 }
 
-struct Keystore2KeyBackend {
-    ks2::KeyDescriptor descriptor_;
-    std::shared_ptr<ks2::IKeystoreSecurityLevel> i_keystore_security_level_;
-};
+using Keystore2KeyBackend = keystore2_engine::SigningSession;
 
 /* key_backend_dup is called when one of the RSA or EC_KEY objects is duplicated. */
 extern "C" int key_backend_dup(CRYPTO_EX_DATA* /* to */, const CRYPTO_EX_DATA* /* from */,
@@ -194,66 +198,6 @@ bssl::UniquePtr<EVP_PKEY> wrap_ecdsa(std::shared_ptr<Keystore2KeyBackend> key_ba
     return result;
 }
 
-std::optional<std::vector<uint8_t>> keystore2_sign(const Keystore2KeyBackend& key_backend,
-                                                   std::vector<uint8_t> input,
-                                                   KMV1::Algorithm algorithm) {
-    auto sec_level = key_backend.i_keystore_security_level_;
-    ks2::CreateOperationResponse response;
-
-    std::vector<KMV1::KeyParameter> op_params(4);
-    op_params[0] = KMV1::KeyParameter{
-        .tag = KMV1::Tag::PURPOSE,
-        .value = KMV1::KeyParameterValue::make<KMV1::KeyParameterValue::keyPurpose>(
-            KMV1::KeyPurpose::SIGN)};
-    op_params[1] = KMV1::KeyParameter{
-        .tag = KMV1::Tag::ALGORITHM,
-        .value = KMV1::KeyParameterValue::make<KMV1::KeyParameterValue::algorithm>(algorithm)};
-    op_params[2] = KMV1::KeyParameter{
-        .tag = KMV1::Tag::PADDING,
-        .value = KMV1::KeyParameterValue::make<KMV1::KeyParameterValue::paddingMode>(
-            KMV1::PaddingMode::NONE)};
-    op_params[3] =
-        KMV1::KeyParameter{.tag = KMV1::Tag::DIGEST,
-                           .value = KMV1::KeyParameterValue::make<KMV1::KeyParameterValue::digest>(
-                               KMV1::Digest::NONE)};
-
-    auto rc = sec_level->createOperation(key_backend.descriptor_, op_params, false /* forced */,
-                                         &response);
-    if (!rc.isOk()) {
-        auto exception_code = rc.getExceptionCode();
-        if (exception_code == EX_SERVICE_SPECIFIC) {
-            LOG(ERROR) << AT << "Keystore createOperation returned service specific error: "
-                       << rc.getServiceSpecificError();
-        } else {
-            LOG(ERROR) << AT << "Communication with Keystore createOperation failed error: "
-                       << exception_code;
-        }
-        return std::nullopt;
-    }
-
-    auto op = response.iOperation;
-
-    std::optional<std::vector<uint8_t>> output = std::nullopt;
-    rc = op->finish(std::move(input), {}, &output);
-    if (!rc.isOk()) {
-        auto exception_code = rc.getExceptionCode();
-        if (exception_code == EX_SERVICE_SPECIFIC) {
-            LOG(ERROR) << AT << "Keystore finish returned service specific error: "
-                       << rc.getServiceSpecificError();
-        } else {
-            LOG(ERROR) << AT
-                       << "Communication with Keystore finish failed error: " << exception_code;
-        }
-        return std::nullopt;
-    }
-
-    if (!output) {
-        LOG(ERROR) << AT << "We did not get a signature from Keystore.";
-    }
-
-    return output;
-}
-
 /* rsa_private_transform takes a big-endian integer from |in|, calculates the
  * d'th power of it, modulo the RSA modulus, and writes the result as a
  * big-endian integer to |out|. Both |in| and |out| are |len| bytes long. It
@@ -267,8 +211,7 @@ extern "C" int rsa_private_transform(RSA* rsa, uint8_t* out, const uint8_t* in,
         return 0;
     }
 
-    auto output =
-        keystore2_sign(**key_backend, std::vector<uint8_t>(in, in + len), KMV1::Algorithm::RSA);
+    auto output = (*key_backend)->sign(std::vector<uint8_t>(in, in + len));
     if (!output) {
         return 0;
     }
@@ -310,8 +253,7 @@ extern "C" int ecdsa_sign(const uint8_t* digest, size_t digest_len, uint8_t* sig
 
     size_t ecdsa_size = ECDSA_size(ec_key);
 
-    auto output = keystore2_sign(**key_backend, std::vector<uint8_t>(digest, digest + digest_len),
-                                 KMV1::Algorithm::EC);
+    auto output = (*key_backend)->sign(std::vector<uint8_t>(digest, digest + digest_len));
     if (!output) {
         LOG(ERROR) << "There was an error during ecdsa_sign.";
         return 0;
@@ -356,21 +298,141 @@ bssl::UniquePtr<EVP_PKEY> extractPubKey(const std::vector<uint8_t>& cert_bytes)
     return pub_key;
 }
 
-}  // namespace
+/* KeyHandleCache keeps the keystore2 service binder and the keys loaded by
+ * EVP_PKEY_from_keystore2, so that processes which load the same key for
+ * every connection do not repeat the service lookup, the getKeyEntry
+ * transaction and the certificate parsing each time.
+ *
+ * An entry is dropped kTimeToLive after it was loaded, so that a rebound alias
+ * is picked up, with its new public key, without a failed signature. It is
+ * also dropped as soon as Keystore fails to create an operation for its key,
+ * e.g. because the alias was deleted or the grant was revoked, so that the
+ * next load asks Keystore again instead of failing every signature. All
+ * entries are dropped when the keystore2 service dies.
+ *
+ * Pipelined keys are never cached: their sessions hold a prepared Keystore
+ * operation, which must be released when the application frees the key
+ * rather than when the entry happens to be evicted. */
+class KeyHandleCache {
+  public:
+    struct Key {
+        ks2::Domain domain;
+        int64_t nspace;
+        std::optional<std::string> alias;
+
+        bool operator<(const Key& other) const {
+            return std::tie(domain, nspace, alias) <
+                   std::tie(other.domain, other.nspace, other.alias);
+        }
+    };
 
-/* EVP_PKEY_from_keystore returns an |EVP_PKEY| that contains either an RSA or
- * ECDSA key where the public part of the key reflects the value of the key
- * named |key_id| in Keystore and the private operations are forwarded onto
- * KeyStore. */
-extern "C" EVP_PKEY* EVP_PKEY_from_keystore2(const char* key_id) {
-    ::ndk::SpAIBinder keystoreBinder(AServiceManager_checkService(keystore2_service_name));
-    auto keystore2 = ks2::IKeystoreService::fromBinder(keystoreBinder);
+    static KeyHandleCache& get() {
+        static KeyHandleCache cache;
+        return cache;
+    }
 
-    if (!keystore2) {
-        LOG(ERROR) << AT << "Unable to connect to Keystore 2.0.";
-        return nullptr;
+    /* service returns the keystore2 service, connecting to it if necessary. */
+    std::shared_ptr<ks2::IKeystoreService> service() {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (service_) {
+                return service_;
+            }
+        }
+        ::ndk::SpAIBinder keystoreBinder(AServiceManager_checkService(keystore2_service_name));
+        auto keystore2 = ks2::IKeystoreService::fromBinder(keystoreBinder);
+        if (!keystore2) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(lock_);
+        if (!service_ && AIBinder_linkToDeath(keystoreBinder.get(), death_recipient_.get(),
+                                              this) == STATUS_OK) {
+            service_ = keystore2;
+        }
+        return keystore2;
+    }
+
+    /* lookup returns a new reference to the cached key for |key|, or nullptr. */
+    bssl::UniquePtr<EVP_PKEY> lookup(const Key& key) {
+        std::lock_guard<std::mutex> lock(lock_);
+        auto it = entries_.find(key);
+        if (it != entries_.end() && (it->second.key_backend->operation_failed() ||
+                                     std::chrono::steady_clock::now() >= it->second.expiry)) {
+            entries_.erase(it);
+            ++stats_.invalidations;
+            it = entries_.end();
+        }
+        if (it == entries_.end()) {
+            ++stats_.misses;
+            return nullptr;
+        }
+        ++stats_.hits;
+        it->second.last_used = ++use_counter_;
+        EVP_PKEY_up_ref(it->second.pkey.get());
+        return bssl::UniquePtr<EVP_PKEY>(it->second.pkey.get());
+    }
+
+    void insert(const Key& key, EVP_PKEY* pkey, std::shared_ptr<Keystore2KeyBackend> key_backend) {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (entries_.size() >= kMaxEntries && entries_.find(key) == entries_.end()) {
+            auto lru = std::min_element(entries_.begin(), entries_.end(),
+                                        [](const auto& a, const auto& b) {
+                                            return a.second.last_used < b.second.last_used;
+                                        });
+            entries_.erase(lru);
+        }
+        EVP_PKEY_up_ref(pkey);
+        entries_[key] = Entry{bssl::UniquePtr<EVP_PKEY>(pkey), std::move(key_backend),
+                              std::chrono::steady_clock::now() + kTimeToLive, ++use_counter_};
+    }
+
+    /* clear drops the service binder and all cached keys. */
+    void clear() {
+        std::lock_guard<std::mutex> lock(lock_);
+        stats_.invalidations += entries_.size();
+        entries_.clear();
+        service_ = nullptr;
+    }
+
+    Keystore2KeyCacheStats stats() const {
+        std::lock_guard<std::mutex> lock(lock_);
+        return stats_;
+    }
+
+  private:
+    static constexpr size_t kMaxEntries = 16;
+    static constexpr std::chrono::seconds kTimeToLive{5};
+
+    struct Entry {
+        bssl::UniquePtr<EVP_PKEY> pkey;
+        std::shared_ptr<Keystore2KeyBackend> key_backend;
+        std::chrono::steady_clock::time_point expiry;
+        uint64_t last_used;
+    };
+
+    KeyHandleCache() : death_recipient_(AIBinder_DeathRecipient_new(binder_died)) {}
+
+    static void binder_died(void* cookie) {
+        LOG(WARNING) << AT << "Keystore died, dropping cached keys.";
+        reinterpret_cast<KeyHandleCache*>(cookie)->clear();
     }
 
+    mutable std::mutex lock_;
+    ::ndk::ScopedAIBinder_DeathRecipient death_recipient_;
+    std::shared_ptr<ks2::IKeystoreService> service_;
+    std::map<Key, Entry> entries_;
+    uint64_t use_counter_ = 0;
+    Keystore2KeyCacheStats stats_ = {};
+};
+
+}  // namespace
+
+/* load_from_keystore2 returns an |EVP_PKEY| that contains either an RSA or
+ * ECDSA key where the public part of the key reflects the value of the key
+ * named |key_id| in Keystore and the private operations are forwarded onto
+ * KeyStore. If |pipelined| is true, the key signs in pipelined mode, see
+ * keystore2_engine::SigningSession. */
+static EVP_PKEY* load_from_keystore2(const char* key_id, bool pipelined) {
     std::string alias = key_id;
     if (android::base::StartsWith(alias, "USRPKEY_")) {
         LOG(WARNING) << AT << "Keystore backend used with legacy alias prefix - ignoring.";
@@ -393,6 +455,20 @@ extern "C" EVP_PKEY* EVP_PKEY_from_keystore2(const char* key_id) {
         descriptor.alias = std::nullopt;
     }
 
+    auto& cache = KeyHandleCache::get();
+    KeyHandleCache::Key cache_key = {descriptor.domain, descriptor.nspace, descriptor.alias};
+    if (!pipelined) {
+        if (auto cached = cache.lookup(cache_key)) {
+            return cached.release();
+        }
+    }
+
+    auto keystore2 = cache.service();
+    if (!keystore2) {
+        LOG(ERROR) << AT << "Unable to connect to Keystore 2.0.";
+        return nullptr;
+    }
+
     ks2::KeyEntryResponse response;
     auto rc = keystore2->getKeyEntry(descriptor, &response);
     if (!rc.isOk()) {
@@ -403,6 +479,8 @@ extern "C" EVP_PKEY* EVP_PKEY_from_keystore2(const char* key_id) {
         } else {
             LOG(ERROR) << AT << "Communication with Keystore getKeyEntry failed error: "
                        << exception_code;
+            // Keystore may have died before the death notification was delivered.
+            cache.clear();
         }
         return nullptr;
     }
@@ -418,17 +496,19 @@ extern "C" EVP_PKEY* EVP_PKEY_from_keystore2(const char* key_id) {
         return nullptr;
     }
 
-    auto key_backend = std::make_shared<Keystore2KeyBackend>(
-        Keystore2KeyBackend{response.metadata.key, response.iSecurityLevel});
-
     bssl::UniquePtr<EVP_PKEY> result;
+    std::shared_ptr<Keystore2KeyBackend> key_backend;
     switch (EVP_PKEY_id(pkey.get())) {
     case EVP_PKEY_RSA: {
+        key_backend = std::make_shared<Keystore2KeyBackend>(
+            response.metadata.key, response.iSecurityLevel, KMV1::Algorithm::RSA, pipelined);
         RSA* public_rsa = EVP_PKEY_get0_RSA(pkey.get());
         result = wrap_rsa(key_backend, public_rsa);
         break;
     }
     case EVP_PKEY_EC: {
+        key_backend = std::make_shared<Keystore2KeyBackend>(
+            response.metadata.key, response.iSecurityLevel, KMV1::Algorithm::EC, pipelined);
         EC_KEY* public_ecdsa = EVP_PKEY_get0_EC_KEY(pkey.get());
         result = wrap_ecdsa(key_backend, public_ecdsa);
         break;
@@ -438,5 +518,33 @@ extern "C" EVP_PKEY* EVP_PKEY_from_keystore2(const char* key_id) {
         return nullptr;
     }
 
+    if (result && !pipelined) {
+        cache.insert(cache_key, result.get(), std::move(key_backend));
+    }
     return result.release();
 }
+
+/* EVP_PKEY_from_keystore2 returns an |EVP_PKEY| for the key named |key_id| in
+ * Keystore. Every private key operation creates and finishes its own Keystore
+ * operation. */
+extern "C" EVP_PKEY* EVP_PKEY_from_keystore2(const char* key_id) {
+    return load_from_keystore2(key_id, false /* pipelined */);
+}
+
+/* EVP_PKEY_from_keystore2_session is like EVP_PKEY_from_keystore2, but the
+ * key signs in a session that prepares the Keystore operation for the next
+ * signature while the current one is in flight. This halves the number of
+ * Keystore transactions per signature for keys that sign repeatedly, such as
+ * TLS client keys, at the cost of holding one Keystore operation slot. The
+ * key is not cached, so the slot is released as soon as the key is freed. */
+extern "C" EVP_PKEY* EVP_PKEY_from_keystore2_session(const char* key_id) {
+    return load_from_keystore2(key_id, true /* pipelined */);
+}
+
+extern "C" void keystore2_engine_get_key_cache_stats(Keystore2KeyCacheStats* stats) {
+    *stats = KeyHandleCache::get().stats();
+}
+
+extern "C" void keystore2_engine_clear_key_cache() {
+    KeyHandleCache::get().clear();
+}
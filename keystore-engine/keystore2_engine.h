@@ -19,3 +19,22 @@
 #include <openssl/evp.h>
 
 extern "C" EVP_PKEY* EVP_PKEY_from_keystore2(const char* key_id);
+extern "C" EVP_PKEY* EVP_PKEY_from_keystore2_session(const char* key_id);
+
+/* Counters of the cache of keys loaded by EVP_PKEY_from_keystore2. An
+ * invalidation is counted for every entry dropped because it expired, because
+ * Keystore failed to create an operation for its key or because Keystore
+ * died. */
+struct Keystore2KeyCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+};
+
+extern "C" void keystore2_engine_get_key_cache_stats(Keystore2KeyCacheStats* stats)
+    __attribute__((visibility("default")));
+
+/* Drops all keys cached by EVP_PKEY_from_keystore2. Call this after replacing
+ * a key under an alias that is already loaded, so that the next load sees the
+ * new key right away instead of once the cached entry expires. */
+extern "C" void keystore2_engine_clear_key_cache() __attribute__((visibility("default")));
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <aidl/android/system/keystore2/BnKeystoreOperation.h>
+#include <aidl/android/system/keystore2/BnKeystoreSecurityLevel.h>
+
+#include <chrono>
+#include <thread>
+
+#include "keystore2_signing_session.h"
+
+namespace ks2 = ::aidl::android::system::keystore2;
+namespace KMV1 = ::aidl::android::hardware::security::keymint;
+
+using keystore2_engine::SigningSession;
+
+namespace {
+
+// Simulated cost of one Keystore transaction, including the trip to KeyMint.
+constexpr auto kCreateOperationLatency = std::chrono::microseconds(400);
+constexpr auto kFinishLatency = std::chrono::microseconds(800);
+
+class FakeOperation : public ks2::BnKeystoreOperation {
+  public:
+    ndk::ScopedAStatus updateAad(const std::vector<uint8_t>& /* aadInput */) override {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+    ndk::ScopedAStatus update(const std::vector<uint8_t>& /* input */,
+                              std::optional<std::vector<uint8_t>>* /* output */) override {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+    ndk::ScopedAStatus finish(const std::optional<std::vector<uint8_t>>& input,
+                              const std::optional<std::vector<uint8_t>>& /* signature */,
+                              std::optional<std::vector<uint8_t>>* output) override {
+        std::this_thread::sleep_for(kFinishLatency);
+        *output = input;
+        return ndk::ScopedAStatus::ok();
+    }
+    ndk::ScopedAStatus abort() override { return ndk::ScopedAStatus::ok(); }
+};
+
+class FakeSecurityLevel : public ks2::BnKeystoreSecurityLevel {
+  public:
+    ndk::ScopedAStatus createOperation(const ks2::KeyDescriptor& /* key */,
+                                       const std::vector<KMV1::KeyParameter>& /* params */,
+                                       bool /* forced */,
+                                       ks2::CreateOperationResponse* response) override {
+        std::this_thread::sleep_for(kCreateOperationLatency);
+        response->iOperation = ndk::SharedRefBase::make<FakeOperation>();
+        return ndk::ScopedAStatus::ok();
+    }
+    ndk::ScopedAStatus generateKey(const ks2::KeyDescriptor& /* key */,
+                                   const std::optional<ks2::KeyDescriptor>& /* attestationKey */,
+                                   const std::vector<KMV1::KeyParameter>& /* params */,
+                                   int32_t /* flags */, const std::vector<uint8_t>& /* entropy */,
+                                   ks2::KeyMetadata* /* metadata */) override {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+    ndk::ScopedAStatus importKey(const ks2::KeyDescriptor& /* key */,
+                                 const std::optional<ks2::KeyDescriptor>& /* attestationKey */,
+                                 const std::vector<KMV1::KeyParameter>& /* params */,
+                                 int32_t /* flags */, const std::vector<uint8_t>& /* keyData */,
+                                 ks2::KeyMetadata* /* metadata */) override {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+    ndk::ScopedAStatus
+    importWrappedKey(const ks2::KeyDescriptor& /* key */,
+                     const ks2::KeyDescriptor& /* wrappingKey */,
+                     const std::optional<std::vector<uint8_t>>& /* maskingKey */,
+                     const std::vector<KMV1::KeyParameter>& /* params */,
+                     const std::vector<ks2::AuthenticatorSpec>& /* authenticators */,
+                     ks2::KeyMetadata* /* metadata */) override {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+    ndk::ScopedAStatus
+    convertStorageKeyToEphemeral(const ks2::KeyDescriptor& /* storageKey */,
+                                 ks2::EphemeralStorageKeyResponse* /* response */) override {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+    ndk::ScopedAStatus deleteKey(const ks2::KeyDescriptor& /* key */) override {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+};
+
+// Measures the latency of one signature, as seen by the engine, when signatures are requested
+// back to back, e.g. by consecutive TLS handshakes. range(0) selects pipelined mode.
+void BM_SignLatency(benchmark::State& state) {
+    bool pipelined = state.range(0);
+    ks2::KeyDescriptor descriptor = {
+        .domain = ks2::Domain::SELINUX,
+        .nspace = 102,
+        .alias = "benchmark",
+        .blob = std::nullopt,
+    };
+    SigningSession session(descriptor, ndk::SharedRefBase::make<FakeSecurityLevel>(),
+                           KMV1::Algorithm::EC, pipelined);
+    std::vector<uint8_t> digest(32, 0xab);
+
+    for (auto _ : state) {
+        auto signature = session.sign(digest);
+        if (!signature) {
+            state.SkipWithError("sign failed");
+            break;
+        }
+        benchmark::DoNotOptimize(signature);
+    }
+    state.SetLabel(pipelined ? "pipelined" : "per-signature operation");
+}
+BENCHMARK(BM_SignLatency)->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "keystore2_signing_session.h"
+
+#include <aidl/android/hardware/security/keymint/ErrorCode.h>
+#include <android-base/logging.h>
+
+#include <string.h>
+
+#define AT __func__ << ":" << __LINE__ << " "
+
+namespace keystore2_engine {
+
+namespace {
+
+std::vector<KMV1::KeyParameter> make_op_params(KMV1::Algorithm algorithm) {
+    std::vector<KMV1::KeyParameter> op_params(4);
+    op_params[0] = KMV1::KeyParameter{
+        .tag = KMV1::Tag::PURPOSE,
+        .value = KMV1::KeyParameterValue::make<KMV1::KeyParameterValue::keyPurpose>(
+            KMV1::KeyPurpose::SIGN)};
+    op_params[1] = KMV1::KeyParameter{
+        .tag = KMV1::Tag::ALGORITHM,
+        .value = KMV1::KeyParameterValue::make<KMV1::KeyParameterValue::algorithm>(algorithm)};
+    op_params[2] = KMV1::KeyParameter{
+        .tag = KMV1::Tag::PADDING,
+        .value = KMV1::KeyParameterValue::make<KMV1::KeyParameterValue::paddingMode>(
+            KMV1::PaddingMode::NONE)};
+    op_params[3] =
+        KMV1::KeyParameter{.tag = KMV1::Tag::DIGEST,
+                           .value = KMV1::KeyParameterValue::make<KMV1::KeyParameterValue::digest>(
+                               KMV1::Digest::NONE)};
+    return op_params;
+}
+
+/* Keystore prunes idle operations when it runs out of operation slots. A
+ * prepared operation that was pruned fails with INVALID_OPERATION_HANDLE. */
+bool was_pruned(const ndk::ScopedAStatus& rc) {
+    return rc.getExceptionCode() == EX_SERVICE_SPECIFIC &&
+           rc.getServiceSpecificError() ==
+               static_cast<int32_t>(KMV1::ErrorCode::INVALID_OPERATION_HANDLE);
+}
+
+}  // namespace
+
+SigningSession::SigningSession(
+    ks2::KeyDescriptor descriptor,
+    std::shared_ptr<ks2::IKeystoreSecurityLevel> i_keystore_security_level,
+    KMV1::Algorithm algorithm, bool pipelined)
+    : descriptor_(std::move(descriptor)),
+      i_keystore_security_level_(std::move(i_keystore_security_level)),
+      op_params_(make_op_params(algorithm)), pipelined_(pipelined) {}
+
+SigningSession::~SigningSession() {
+    {
+        std::lock_guard<std::mutex> lock(next_operation_lock_);
+        stopping_ = true;
+    }
+    next_operation_cv_.notify_all();
+    if (worker_) {
+        pthread_join(*worker_, nullptr);
+    }
+    /* Release the operation slot held by the prepared operation right away
+     * instead of waiting for Keystore to prune it. */
+    if (next_operation_) {
+        next_operation_->abort();
+    }
+}
+
+std::shared_ptr<ks2::IKeystoreOperation> SigningSession::create_operation() const {
+    ks2::CreateOperationResponse response;
+    auto rc = i_keystore_security_level_->createOperation(descriptor_, op_params_,
+                                                          false /* forced */, &response);
+    if (!rc.isOk()) {
+        operation_failed_ = true;
+        auto exception_code = rc.getExceptionCode();
+        if (exception_code == EX_SERVICE_SPECIFIC) {
+            LOG(ERROR) << AT << "Keystore createOperation returned service specific error: "
+                       << rc.getServiceSpecificError();
+        } else {
+            LOG(ERROR) << AT << "Communication with Keystore createOperation failed error: "
+                       << exception_code;
+        }
+        return nullptr;
+    }
+    return response.iOperation;
+}
+
+bool SigningSession::start_worker_locked() {
+    if (worker_ || worker_failed_) {
+        return worker_.has_value();
+    }
+    pthread_t thread;
+    int error = pthread_create(&thread, nullptr, worker_main, this);
+    if (error != 0) {
+        LOG(WARNING) << AT << "Could not start the worker, signing without pipelining: "
+                     << strerror(error);
+        worker_failed_ = true;
+        return false;
+    }
+    worker_ = thread;
+    return true;
+}
+
+void* SigningSession::worker_main(void* session) {
+    reinterpret_cast<SigningSession*>(session)->run_worker();
+    return nullptr;
+}
+
+void SigningSession::run_worker() {
+    std::unique_lock<std::mutex> lock(next_operation_lock_);
+    while (true) {
+        next_operation_cv_.wait(lock, [this] { return stopping_ || next_operation_requested_; });
+        if (stopping_) {
+            return;
+        }
+        lock.unlock();
+        auto op = create_operation();
+        lock.lock();
+        next_operation_ = std::move(op);
+        next_operation_requested_ = false;
+        next_operation_cv_.notify_all();
+    }
+}
+
+std::shared_ptr<ks2::IKeystoreOperation> SigningSession::take_operation() {
+    std::unique_lock<std::mutex> lock(next_operation_lock_);
+    if (!start_worker_locked()) {
+        return nullptr;
+    }
+    /* Wait for an operation that is still being prepared rather than creating
+     * a second one next to it. */
+    next_operation_cv_.wait(lock, [this] { return !next_operation_requested_; });
+    auto prepared = std::move(next_operation_);
+    next_operation_ = nullptr;
+    next_operation_requested_ = true;
+    next_operation_cv_.notify_all();
+    return prepared;
+}
+
+std::optional<std::vector<uint8_t>> SigningSession::sign(std::vector<uint8_t> input) {
+    std::shared_ptr<ks2::IKeystoreOperation> op;
+    bool prepared = false;
+    if (pipelined_) {
+        op = take_operation();
+        prepared = op != nullptr;
+    }
+    if (!op) {
+        op = create_operation();
+        if (!op) {
+            return std::nullopt;
+        }
+    }
+
+    std::optional<std::vector<uint8_t>> output = std::nullopt;
+    auto rc = op->finish(input, {}, &output);
+    if (prepared && was_pruned(rc)) {
+        LOG(INFO) << AT << "Prepared operation was pruned, retrying with a new operation.";
+        op = create_operation();
+        if (!op) {
+            return std::nullopt;
+        }
+        output = std::nullopt;
+        rc = op->finish(input, {}, &output);
+    }
+    if (!rc.isOk()) {
+        auto exception_code = rc.getExceptionCode();
+        if (exception_code == EX_SERVICE_SPECIFIC) {
+            LOG(ERROR) << AT << "Keystore finish returned service specific error: "
+                       << rc.getServiceSpecificError();
+        } else {
+            LOG(ERROR) << AT
+                       << "Communication with Keystore finish failed error: " << exception_code;
+        }
+        return std::nullopt;
+    }
+
+    if (!output) {
+        LOG(ERROR) << AT << "We did not get a signature from Keystore.";
+    }
+
+    return output;
+}
+
+}  // namespace keystore2_engine
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/security/keymint/Algorithm.h>
+#include <aidl/android/hardware/security/keymint/KeyParameter.h>
+#include <aidl/android/system/keystore2/IKeystoreOperation.h>
+#include <aidl/android/system/keystore2/IKeystoreSecurityLevel.h>
+#include <aidl/android/system/keystore2/KeyDescriptor.h>
+
+#include <pthread.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace keystore2_engine {
+
+namespace ks2 = ::aidl::android::system::keystore2;
+namespace KMV1 = ::aidl::android::hardware::security::keymint;
+
+/* SigningSession performs the private key operations of one Keystore key.
+ *
+ * The security level binder and the operation parameters are set up once,
+ * when the key is loaded. In pipelined mode the session also creates the
+ * operation for the next signature while the current one is being finished,
+ * so that in the steady state each signature costs a single finish
+ * transaction. The operations are prepared by one worker thread per session,
+ * which is started with the first signature. If the thread cannot be started,
+ * the session falls back to creating an operation per signature. A prepared
+ * operation occupies a Keystore operation slot until it is used, which is why
+ * pipelining is only enabled for keys that are expected to sign repeatedly. */
+class SigningSession {
+  public:
+    SigningSession(ks2::KeyDescriptor descriptor,
+                   std::shared_ptr<ks2::IKeystoreSecurityLevel> i_keystore_security_level,
+                   KMV1::Algorithm algorithm, bool pipelined);
+    ~SigningSession();
+
+    SigningSession(const SigningSession&) = delete;
+    SigningSession& operator=(const SigningSession&) = delete;
+
+    /* sign returns the raw signature of |input|, or std::nullopt if Keystore
+     * failed to produce one. It may be called from multiple threads. */
+    std::optional<std::vector<uint8_t>> sign(std::vector<uint8_t> input);
+
+    /* operation_failed returns true once Keystore has failed to create an
+     * operation for the key, e.g. because its alias was deleted or rebound,
+     * its grant was revoked or Keystore could not be reached. */
+    bool operation_failed() const { return operation_failed_; }
+
+  private:
+    std::shared_ptr<ks2::IKeystoreOperation> create_operation() const;
+
+    /* take_operation returns the prepared operation if there is one, and
+     * asks the worker to prepare the operation for the following signature. */
+    std::shared_ptr<ks2::IKeystoreOperation> take_operation();
+
+    /* start_worker_locked starts the worker thread unless it is running or
+     * failed to start before. It returns true if the worker is running. */
+    bool start_worker_locked();
+    static void* worker_main(void* session);
+    void run_worker();
+
+    const ks2::KeyDescriptor descriptor_;
+    const std::shared_ptr<ks2::IKeystoreSecurityLevel> i_keystore_security_level_;
+    const std::vector<KMV1::KeyParameter> op_params_;
+    const bool pipelined_;
+    mutable std::atomic<bool> operation_failed_ = false;
+
+    std::mutex next_operation_lock_;
+    std::condition_variable next_operation_cv_;
+    /* Set while the worker is asked to, or is about to, prepare an operation. */
+    bool next_operation_requested_ = false;
+    bool stopping_ = false;
+    bool worker_failed_ = false;
+    std::optional<pthread_t> worker_;
+    std::shared_ptr<ks2::IKeystoreOperation> next_operation_;
+};
+
+}  // namespace keystore2_engine
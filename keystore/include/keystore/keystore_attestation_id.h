@@ -17,7 +17,14 @@
 #ifndef KEYSTORE_KEYSTORE_ATTESTATION_ID_H_
 #define KEYSTORE_KEYSTORE_ATTESTATION_ID_H_
 
+#include <sys/types.h>
 #include <utils/Errors.h>
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace android {
@@ -28,6 +35,7 @@ constexpr size_t KEY_ATTESTATION_APPLICATION_ID_MAX_SIZE = 1024;
 namespace keymaster {
 
 class KeyAttestationApplicationId;
+class IKeyAttestationApplicationIdProvider;
 
 }  // namespace keymaster
 
@@ -60,6 +68,62 @@ template <typename T> class StatusOr {
     T _value;
 };
 
+/**
+ * A bounded cache of DER-encoded attestation application ids, keyed by uid.
+ *
+ * Package updates (e.g. a new version code) are not signalled to this library, so entries expire
+ * after a short time to live: an attestation made within kDefaultTimeToLive of an update may
+ * still report the packages as they were before it. The time to live only needs to cover the
+ * bursts of attestations an app makes while generating its keys. Callers that learn about
+ * package changes drop a uid with invalidate(). That bumps a generation counter, so a lookup
+ * that raced with the invalidation does not store its now stale result.
+ */
+class AttestationApplicationIdCache {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kDefaultMaxEntries = 32;
+    static constexpr Clock::duration kDefaultTimeToLive = std::chrono::seconds(5);
+
+    AttestationApplicationIdCache(size_t max_entries = kDefaultMaxEntries,
+                                  Clock::duration time_to_live = kDefaultTimeToLive)
+        : max_entries_(max_entries), time_to_live_(time_to_live) {}
+
+    /**
+     * Returns the generation to pass to put() for a value that is about to be computed.
+     */
+    uint64_t generation() const;
+
+    /**
+     * Looks up a live entry for uid, and copies it to *aaid if there is one.
+     */
+    bool get(uid_t uid, std::vector<uint8_t>* aaid);
+
+    /**
+     * Stores aaid for uid, unless the cache was invalidated since generation was obtained. The
+     * least recently used entry is evicted if the cache is full.
+     */
+    void put(uid_t uid, uint64_t generation, const std::vector<uint8_t>& aaid);
+
+    void invalidate(uid_t uid);
+
+  private:
+    struct Entry {
+        uid_t uid;
+        Clock::time_point expiry;
+        std::vector<uint8_t> aaid;
+    };
+
+    const size_t max_entries_;
+    const Clock::duration time_to_live_;
+
+    mutable std::mutex lock_;
+    uint64_t generation_ = 0;
+    // Most recently used first.
+    std::list<Entry> lru_;
+    std::unordered_map<uid_t, std::list<Entry>::iterator> entries_;
+};
+
 /**
  * Gathers the attestation id for the application determined by uid by querying the package manager
  * As of this writing uids can be shared in android, which is why the asn.1 encoded attestation
@@ -71,6 +135,20 @@ template <typename T> class StatusOr {
  */
 StatusOr<std::vector<uint8_t>> gather_attestation_application_id(uid_t uid);
 
+/**
+ * Like gather_attestation_application_id(uid), but queries provider instead of the package
+ * manager, and uses cache instead of the process wide cache. No caching is done if cache is
+ * nullptr.
+ */
+StatusOr<std::vector<uint8_t>> gather_attestation_application_id(
+    uid_t uid, ::android::security::keymaster::IKeyAttestationApplicationIdProvider& provider,
+    AttestationApplicationIdCache* cache);
+
+/**
+ * Drops the cached attestation application id of uid, e.g. because its packages changed.
+ */
+void invalidate_attestation_application_id(uid_t uid);
+
 /**
  * Generates a DER-encoded vector containing information from KeyAttestationApplicationId.
  * The size of the returned vector will not exceed KEY_ATTESTATION_APPLICATION_ID_MAX_SIZE.
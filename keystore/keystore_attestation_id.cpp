@@ -20,6 +20,7 @@
 
 #include <log/log.h>
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -266,8 +267,76 @@ build_attestation_application_id(const KeyAttestationApplicationId& key_attestat
     return result;
 }
 
-StatusOr<std::vector<uint8_t>> gather_attestation_application_id(uid_t uid) {
+uint64_t AttestationApplicationIdCache::generation() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return generation_;
+}
+
+bool AttestationApplicationIdCache::get(uid_t uid, std::vector<uint8_t>* aaid) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto entry = entries_.find(uid);
+    if (entry == entries_.end()) return false;
+    if (entry->second->expiry <= Clock::now()) {
+        lru_.erase(entry->second);
+        entries_.erase(entry);
+        return false;
+    }
+    lru_.splice(lru_.begin(), lru_, entry->second);
+    *aaid = entry->second->aaid;
+    return true;
+}
+
+void AttestationApplicationIdCache::put(uid_t uid, uint64_t generation,
+                                        const std::vector<uint8_t>& aaid) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (generation != generation_ || max_entries_ == 0) return;
+    auto entry = entries_.find(uid);
+    if (entry != entries_.end()) {
+        lru_.erase(entry->second);
+        entries_.erase(entry);
+    }
+    if (lru_.size() >= max_entries_) {
+        entries_.erase(lru_.back().uid);
+        lru_.pop_back();
+    }
+    lru_.push_front(Entry{uid, Clock::now() + time_to_live_, aaid});
+    entries_[uid] = lru_.begin();
+}
+
+void AttestationApplicationIdCache::invalidate(uid_t uid) {
+    std::lock_guard<std::mutex> lock(lock_);
+    ++generation_;
+    auto entry = entries_.find(uid);
+    if (entry != entries_.end()) {
+        lru_.erase(entry->second);
+        entries_.erase(entry);
+    }
+}
+
+namespace {
+
+using ::android::security::keymaster::IKeyAttestationApplicationIdProvider;
+
+AttestationApplicationIdCache& get_attestation_application_id_cache() {
+    static AttestationApplicationIdCache cache;
+    return cache;
+}
+
+// The provider is only looked up when the package manager needs to be asked, because the first
+// lookup of the real provider blocks on the service manager.
+using ProviderGetter = std::function<IKeyAttestationApplicationIdProvider&()>;
+
+StatusOr<std::vector<uint8_t>> do_gather_attestation_application_id(
+    uid_t uid, const ProviderGetter& provider, AttestationApplicationIdCache* cache) {
+    std::vector<uint8_t> cached;
+    if (cache != nullptr && cache->get(uid, &cached)) {
+        return cached;
+    }
+    uint64_t generation = cache != nullptr ? cache->generation() : 0;
+
     KeyAttestationApplicationId key_attestation_id;
+    // Only answers from the package manager are cached; a failed request is retried next time.
+    bool cacheable = true;
 
     if (uid == AID_SYSTEM) {
         /* Use a fixed ID for system callers */
@@ -277,8 +346,7 @@ StatusOr<std::vector<uint8_t>> gather_attestation_application_id(uid_t uid) {
         key_attestation_id = KeyAttestationApplicationId(std::move(pinfo));
     } else {
         /* Get the attestation application ID from package manager */
-        auto& pm = KeyAttestationApplicationIdProvider::get();
-        auto status = pm.getKeyAttestationApplicationId(uid, &key_attestation_id);
+        auto status = provider().getKeyAttestationApplicationId(uid, &key_attestation_id);
         // Package Manager call has failed, perform attestation but indicate that the
         // caller is unknown.
         if (!status.isOk()) {
@@ -288,11 +356,38 @@ StatusOr<std::vector<uint8_t>> gather_attestation_application_id(uid_t uid) {
                 String16(kUnknownPackageName), 1 /* version code */,
                 std::make_shared<KeyAttestationPackageInfo::SignaturesVector>());
             key_attestation_id = KeyAttestationApplicationId(std::move(pinfo));
+            cacheable = false;
         }
     }
 
     /* DER encode the attestation application ID */
-    return build_attestation_application_id(key_attestation_id);
+    auto result = build_attestation_application_id(key_attestation_id);
+    if (cache != nullptr && cacheable && result.isOk()) {
+        cache->put(uid, generation, result.value());
+    }
+    return result;
+}
+
+}  // namespace
+
+StatusOr<std::vector<uint8_t>> gather_attestation_application_id(
+    uid_t uid, IKeyAttestationApplicationIdProvider& provider,
+    AttestationApplicationIdCache* cache) {
+    return do_gather_attestation_application_id(
+        uid, [&]() -> IKeyAttestationApplicationIdProvider& { return provider; }, cache);
+}
+
+StatusOr<std::vector<uint8_t>> gather_attestation_application_id(uid_t uid) {
+    return do_gather_attestation_application_id(
+        uid,
+        []() -> IKeyAttestationApplicationIdProvider& {
+            return KeyAttestationApplicationIdProvider::get();
+        },
+        &get_attestation_application_id_cache());
+}
+
+void invalidate_attestation_application_id(uid_t uid) {
+    get_attestation_application_id_cache().invalidate(uid);
 }
 
 }  // namespace security
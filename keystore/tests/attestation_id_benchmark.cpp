@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <android/security/keymaster/BnKeyAttestationApplicationIdProvider.h>
+#include <keystore/KeyAttestationApplicationId.h>
+#include <keystore/KeyAttestationPackageInfo.h>
+#include <keystore/Signature.h>
+#include <keystore/keystore_attestation_id.h>
+#include <utils/String16.h>
+
+using ::android::sp;
+using ::android::String16;
+using ::android::binder::Status;
+using ::android::content::pm::Signature;
+using ::android::security::AttestationApplicationIdCache;
+using ::android::security::gather_attestation_application_id;
+using ::android::security::keymaster::BnKeyAttestationApplicationIdProvider;
+using ::android::security::keymaster::KeyAttestationApplicationId;
+using ::android::security::keymaster::KeyAttestationPackageInfo;
+
+namespace {
+
+// Simulated cost of the binder call into the package manager.
+constexpr auto kPackageManagerLatency = std::chrono::microseconds(300);
+// Typical size of a DER-encoded signing certificate.
+constexpr size_t kCertificateSize = 1400;
+constexpr uid_t kAppUid = 10123;
+
+// Answers like the package manager would for an app uid shared by range(0) packages.
+class FakeKeyAttestationApplicationIdProvider : public BnKeyAttestationApplicationIdProvider {
+  public:
+    explicit FakeKeyAttestationApplicationIdProvider(size_t packages) : packages_(packages) {}
+
+    Status getKeyAttestationApplicationId(int32_t /* uid */,
+                                          KeyAttestationApplicationId* _aidl_return) override {
+        std::this_thread::sleep_for(kPackageManagerLatency);
+        auto signatures = std::make_shared<KeyAttestationPackageInfo::SignaturesVector>();
+        signatures->push_back(Signature(std::vector<uint8_t>(kCertificateSize, 0xa5)));
+        KeyAttestationApplicationId::PackageInfoVector pinfos;
+        for (size_t i = 0; i < packages_; ++i) {
+            pinfos.push_back(std::make_optional<KeyAttestationPackageInfo>(
+                String16(("com.example.package" + std::to_string(i)).c_str()), 1, signatures));
+        }
+        *_aidl_return = KeyAttestationApplicationId(std::move(pinfos));
+        return Status::ok();
+    }
+
+  private:
+    size_t packages_;
+};
+
+void BM_GatherUncached(benchmark::State& state) {
+    sp<FakeKeyAttestationApplicationIdProvider> provider =
+        new FakeKeyAttestationApplicationIdProvider(state.range(0));
+    for (auto _ : state) {
+        auto result = gather_attestation_application_id(kAppUid, *provider, nullptr);
+        if (!result.isOk()) {
+            state.SkipWithError("gather_attestation_application_id failed");
+            break;
+        }
+        benchmark::DoNotOptimize(result.value().data());
+    }
+}
+BENCHMARK(BM_GatherUncached)->Arg(1)->Arg(4)->UseRealTime();
+
+void BM_GatherCached(benchmark::State& state) {
+    sp<FakeKeyAttestationApplicationIdProvider> provider =
+        new FakeKeyAttestationApplicationIdProvider(state.range(0));
+    AttestationApplicationIdCache cache;
+    for (auto _ : state) {
+        auto result = gather_attestation_application_id(kAppUid, *provider, &cache);
+        if (!result.isOk()) {
+            state.SkipWithError("gather_attestation_application_id failed");
+            break;
+        }
+        benchmark::DoNotOptimize(result.value().data());
+    }
+}
+BENCHMARK(BM_GatherCached)->Arg(1)->Arg(4)->UseRealTime();
+
+// Many apps generating attested keys in turn, with more uids than the cache holds.
+void BM_GatherCachedEvicting(benchmark::State& state) {
+    sp<FakeKeyAttestationApplicationIdProvider> provider =
+        new FakeKeyAttestationApplicationIdProvider(1);
+    AttestationApplicationIdCache cache;
+    const uid_t uids = state.range(0);
+    uid_t next = 0;
+    for (auto _ : state) {
+        auto result = gather_attestation_application_id(kAppUid + next, *provider, &cache);
+        if (!result.isOk()) {
+            state.SkipWithError("gather_attestation_application_id failed");
+            break;
+        }
+        benchmark::DoNotOptimize(result.value().data());
+        next = (next + 1) % uids;
+    }
+}
+BENCHMARK(BM_GatherCachedEvicting)
+    ->Arg(AttestationApplicationIdCache::kDefaultMaxEntries)
+    ->Arg(AttestationApplicationIdCache::kDefaultMaxEntries * 2)
+    ->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <keystore/keystore_attestation_id.h>
+
+using ::android::security::AttestationApplicationIdCache;
+using std::vector;
+
+namespace keystore {
+
+namespace test {
+
+namespace {
+
+const vector<uint8_t> kAaid1 = {0x30, 0x01};
+const vector<uint8_t> kAaid2 = {0x30, 0x02};
+const vector<uint8_t> kAaid3 = {0x30, 0x03};
+
+}  // namespace
+
+TEST(AttestationApplicationIdCacheTest, hitAfterPut) {
+    AttestationApplicationIdCache cache;
+    vector<uint8_t> aaid;
+    ASSERT_FALSE(cache.get(10001, &aaid));
+
+    cache.put(10001, cache.generation(), kAaid1);
+    ASSERT_TRUE(cache.get(10001, &aaid));
+    ASSERT_EQ(kAaid1, aaid);
+    ASSERT_FALSE(cache.get(10002, &aaid));
+}
+
+TEST(AttestationApplicationIdCacheTest, evictsLeastRecentlyUsed) {
+    AttestationApplicationIdCache cache(2 /* max_entries */);
+    vector<uint8_t> aaid;
+    cache.put(10001, cache.generation(), kAaid1);
+    cache.put(10002, cache.generation(), kAaid2);
+    // Make 10001 the most recently used entry, so that 10002 is evicted.
+    ASSERT_TRUE(cache.get(10001, &aaid));
+    cache.put(10003, cache.generation(), kAaid3);
+
+    ASSERT_TRUE(cache.get(10001, &aaid));
+    ASSERT_FALSE(cache.get(10002, &aaid));
+    ASSERT_TRUE(cache.get(10003, &aaid));
+    ASSERT_EQ(kAaid3, aaid);
+}
+
+TEST(AttestationApplicationIdCacheTest, entriesExpire) {
+    AttestationApplicationIdCache cache(2 /* max_entries */, std::chrono::milliseconds(10));
+    vector<uint8_t> aaid;
+    cache.put(10001, cache.generation(), kAaid1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_FALSE(cache.get(10001, &aaid));
+}
+
+TEST(AttestationApplicationIdCacheTest, invalidate) {
+    AttestationApplicationIdCache cache;
+    vector<uint8_t> aaid;
+    cache.put(10001, cache.generation(), kAaid1);
+    cache.put(10002, cache.generation(), kAaid2);
+
+    cache.invalidate(10001);
+    ASSERT_FALSE(cache.get(10001, &aaid));
+    ASSERT_TRUE(cache.get(10002, &aaid));
+}
+
+TEST(AttestationApplicationIdCacheTest, stalePutIsDropped) {
+    AttestationApplicationIdCache cache;
+    vector<uint8_t> aaid;
+    // A lookup that started before an invalidation must not store its result.
+    auto generation = cache.generation();
+    cache.invalidate(10001);
+    cache.put(10001, generation, kAaid1);
+    ASSERT_FALSE(cache.get(10001, &aaid));
+
+    cache.put(10001, cache.generation(), kAaid1);
+    ASSERT_TRUE(cache.get(10001, &aaid));
+}
+
+}  // namespace test
+}  // namespace keystore
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+
+#include "../user_state.h"
+
+namespace keystore {
+
+namespace test {
+
+namespace {
+
+constexpr uid_t kSlowUser = 0;
+constexpr uid_t kOtherUsers = 8;
+constexpr auto kTimeout = std::chrono::seconds(5);
+
+// UserState::initialize creates the user directories relative to the working directory.
+class UserStateDBTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        ASSERT_NE(getcwd(old_cwd_, sizeof(old_cwd_)), nullptr);
+        ASSERT_EQ(chdir(dir_.path), 0);
+    }
+    void TearDown() override { ASSERT_EQ(chdir(old_cwd_), 0); }
+
+    TemporaryDir dir_;
+    char old_cwd_[PATH_MAX];
+    UserStateDB db_;
+};
+
+}  // namespace
+
+TEST_F(UserStateDBTest, lockedUserDoesNotBlockOtherUsers) {
+    // Hold one user's state the way a slow readMasterKey would, while other threads look up,
+    // create and modify the states of other users. The state is released before any assertion
+    // can return, so that a blocked thread fails the test instead of hanging it.
+    std::vector<std::future<void>> others;
+    std::vector<std::future_status> statuses;
+    {
+        auto slow = db_.getUserState(kSlowUser);
+        ASSERT_TRUE(slow);
+
+        for (uid_t userId = 1; userId <= kOtherUsers; ++userId) {
+            others.push_back(std::async(std::launch::async, [this, userId] {
+                for (int i = 0; i < 100; ++i) {
+                    auto state = db_.getUserState(userId);
+                    ASSERT_TRUE(state);
+                    ASSERT_EQ(state->getUserId(), userId);
+                    state->setState(STATE_LOCKED);
+                }
+            }));
+        }
+        for (auto& other : others) {
+            statuses.push_back(other.wait_for(kTimeout));
+        }
+    }
+    for (size_t i = 0; i < others.size(); ++i) {
+        ASSERT_EQ(statuses[i], std::future_status::ready);
+        others[i].get();
+    }
+}
+
+TEST_F(UserStateDBTest, readersShareUserState) {
+    db_.getUserState(kSlowUser)->setState(STATE_LOCKED);
+    const UserStateDB& db = db_;
+
+    std::future<bool> other_reader;
+    std::future_status status;
+    {
+        auto reader = db.getUserState(kSlowUser);
+        ASSERT_TRUE(reader);
+        other_reader = std::async(std::launch::async, [&db] {
+            auto state = db.getUserState(kSlowUser);
+            return state && state->getState() == STATE_LOCKED;
+        });
+        status = other_reader.wait_for(kTimeout);
+    }
+    ASSERT_EQ(status, std::future_status::ready);
+    ASSERT_TRUE(other_reader.get());
+
+    ASSERT_FALSE(db.getUserState(kOtherUsers + 1));
+}
+
+TEST_F(UserStateDBTest, writerExcludesReaders) {
+    const UserStateDB& db = db_;
+    db_.getUserState(kSlowUser)->setState(STATE_UNINITIALIZED);
+
+    std::atomic<bool> written = false;
+    std::future<bool> reader;
+    std::future_status early_status;
+    {
+        auto writer = db_.getUserState(kSlowUser);
+        reader = std::async(std::launch::async, [&db, &written] {
+            auto state = db.getUserState(kSlowUser);
+            return written.load() && state->getState() == STATE_NO_ERROR;
+        });
+        early_status = reader.wait_for(std::chrono::milliseconds(100));
+        writer->setState(STATE_NO_ERROR);
+        written = true;
+    }
+    // The reader must not get the state before the writer releases it.
+    ASSERT_EQ(early_status, std::future_status::timeout);
+    ASSERT_EQ(reader.wait_for(kTimeout), std::future_status::ready);
+    ASSERT_TRUE(reader.get());
+}
+
+}  // namespace test
+}  // namespace keystore
@@ -276,21 +276,33 @@ void UserState::setupMasterKeys() {
     setState(STATE_NO_ERROR);
 }
 
+UserStateDB::Entry* UserStateDB::find(uid_t userId) const {
+    std::shared_lock<std::shared_mutex> lock(mMasterKeysLock);
+    auto it = mMasterKeys.find(userId);
+    if (it == mMasterKeys.end()) return nullptr;
+    return &it->second;
+}
+
 LockedUserState<UserState> UserStateDB::getUserState(uid_t userId) {
-    std::unique_lock<std::mutex> lock(locked_state_mutex_);
-    decltype(mMasterKeys.begin()) it;
-    bool inserted;
-    std::tie(it, inserted) = mMasterKeys.emplace(userId, userId);
-    if (inserted) {
-        if (!it->second.initialize()) {
-            /* There's not much we can do if initialization fails. Trying to
-             * unlock the keystore for that user will fail as well, so any
-             * subsequent request for this user will just return SYSTEM_ERROR.
-             */
-            ALOGE("User initialization failed for %u; subsequent operations will fail", userId);
+    Entry* entry = find(userId);
+    if (entry == nullptr) {
+        std::unique_lock<std::shared_mutex> lock(mMasterKeysLock);
+        // The user state is initialized before it is published, so that readers never see an
+        // uninitialized state.
+        auto [it, inserted] = mMasterKeys.try_emplace(userId, userId);
+        if (inserted) {
+            if (!it->second.state.initialize()) {
+                /* There's not much we can do if initialization fails. Trying to
+                 * unlock the keystore for that user will fail as well, so any
+                 * subsequent request for this user will just return SYSTEM_ERROR.
+                 */
+                ALOGE("User initialization failed for %u; subsequent operations will fail",
+                      userId);
+            }
         }
+        entry = &it->second;
     }
-    return get(std::move(lock), &it->second);
+    return {&entry->state, std::unique_lock<std::shared_mutex>(entry->lock)};
 }
 
 LockedUserState<UserState> UserStateDB::getUserStateByUid(uid_t uid) {
@@ -298,10 +310,9 @@ LockedUserState<UserState> UserStateDB::getUserStateByUid(uid_t uid) {
 }
 
 LockedUserState<const UserState> UserStateDB::getUserState(uid_t userId) const {
-    std::unique_lock<std::mutex> lock(locked_state_mutex_);
-    auto it = mMasterKeys.find(userId);
-    if (it == mMasterKeys.end()) return {};
-    return get(std::move(lock), &it->second);
+    Entry* entry = find(userId);
+    if (entry == nullptr) return {};
+    return {&entry->state, std::shared_lock<std::shared_mutex>(entry->lock)};
 }
 
 LockedUserState<const UserState> UserStateDB::getUserStateByUid(uid_t uid) const {
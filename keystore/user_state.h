@@ -29,17 +29,27 @@
 #include "keystore_utils.h"
 
 #include <android-base/logging.h>
-#include <condition_variable>
 #include <keystore/keystore_concurrency.h>
+#include <map>
 #include <mutex>
-#include <set>
+#include <shared_mutex>
 #include <vector>
 
 namespace keystore {
 
 class UserState;
 
-template <typename UserState> using LockedUserState = ProxyLock<UnlockProxyLockHelper<UserState>>;
+// Mutable user states are locked exclusively, const ones are shared between readers.
+template <typename UserState> struct UserStateGuard {
+    template <typename Mutex> using type = std::unique_lock<Mutex>;
+};
+template <typename UserState> struct UserStateGuard<const UserState> {
+    template <typename Mutex> using type = std::shared_lock<Mutex>;
+};
+
+template <typename UserState>
+using LockedUserState = ProxyLock<MutexProxyLockHelper<UserState, std::shared_mutex,
+                                                       UserStateGuard<UserState>::template type>>;
 
 class UserState {
   public:
@@ -106,24 +116,22 @@ class UserStateDB {
     LockedUserState<const UserState> getUserStateByUid(uid_t uid) const;
 
   private:
-    mutable std::set<const UserState*> locked_state_;
-    mutable std::mutex locked_state_mutex_;
-    mutable std::condition_variable locked_state_mutex_cond_var_;
-
-    template <typename UserState>
-    LockedUserState<UserState> get(std::unique_lock<std::mutex> lock, UserState* entry) const {
-        locked_state_mutex_cond_var_.wait(
-            lock, [&] { return locked_state_.find(entry) == locked_state_.end(); });
-        locked_state_.insert(entry);
-        return {entry, [&](UserState* entry) {
-                    std::unique_lock<std::mutex> lock(locked_state_mutex_);
-                    locked_state_.erase(entry);
-                    lock.unlock();
-                    locked_state_mutex_cond_var_.notify_all();
-                }};
-    }
-
-    std::map<uid_t, UserState> mMasterKeys;
+    // Each user has its own lock, so that a slow operation on one user, e.g. the key derivation
+    // in readMasterKey, does not block the others.
+    struct Entry {
+        explicit Entry(uid_t userId) : state(userId) {}
+
+        UserState state;
+        std::shared_mutex lock;
+    };
+
+    Entry* find(uid_t userId) const;
+
+    // Guards the map itself, not the entries. Entries are never removed, and std::map does not
+    // move them, so they remain valid after this lock is released. It is never held while
+    // waiting for the lock of an entry.
+    mutable std::shared_mutex mMasterKeysLock;
+    mutable std::map<uid_t, Entry> mMasterKeys;
 };
 
 }  //  namespace keystore
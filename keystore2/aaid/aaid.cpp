@@ -19,6 +19,7 @@
 #include <keystore/keystore_attestation_id.h>
 
 using android::security::gather_attestation_application_id;
+using android::security::invalidate_attestation_application_id;
 
 uint32_t aaid_keystore_attestation_id(uint32_t uid, uint8_t* aaid, size_t* aaid_size) {
     static_assert(sizeof(uint32_t) == sizeof(uid_t), "uid_t has unexpected size");
@@ -40,3 +41,7 @@ uint32_t aaid_keystore_attestation_id(uint32_t uid, uint8_t* aaid, size_t* aaid_
     *aaid_size = result.value().size();
     return ::android::OK;
 }
+
+void aaid_keystore_invalidate_attestation_id(uint32_t uid) {
+    invalidate_attestation_application_id(uid);
+}
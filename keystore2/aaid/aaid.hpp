@@ -41,4 +41,12 @@ extern "C" {
      * @return OK on success.
      */
     uint32_t aaid_keystore_attestation_id(uint32_t uid, uint8_t* aaid, size_t* aaid_size);
+
+    /**
+     * Drops the cached attestation application id of the app uid, so that the next call to
+     * aaid_keystore_attestation_id queries the package manager again.
+     *
+     * @param uid the uid of the app whose packages changed.
+     */
+    void aaid_keystore_invalidate_attestation_id(uint32_t uid);
 }
@@ -15,7 +15,8 @@
 //! Rust binding for getting the attestation application id.
 
 use keystore2_aaid_bindgen::{
-    aaid_keystore_attestation_id, KEY_ATTESTATION_APPLICATION_ID_MAX_SIZE,
+    aaid_keystore_attestation_id, aaid_keystore_invalidate_attestation_id,
+    KEY_ATTESTATION_APPLICATION_ID_MAX_SIZE,
 };
 
 /// Returns the attestation application id for the given uid or an error code
@@ -33,3 +34,10 @@ pub fn get_aaid(uid: u32) -> Result<Vec<u8>, u32> {
         status => Err(status),
     }
 }
+
+/// Drops the cached attestation application id of the given uid, e.g. because the packages
+/// sharing the uid changed.
+pub fn invalidate_aaid(uid: u32) {
+    // Safety: aaid_keystore_invalidate_attestation_id takes no pointers.
+    unsafe { aaid_keystore_invalidate_attestation_id(uid) }
+}
@@ -608,7 +608,16 @@ CertUtilsError signCertWith(X509* certificate,
         return *error;
     }
     auto& algo_obj = std::get<X509_ALGOR_Ptr>(algo_objV);
-    if (!X509_set1_signature_algo(certificate, algo_obj.get())) {
+    return signCertWith(certificate, std::move(sign), algo_obj.get());
+}
+
+CertUtilsError signCertWith(X509* certificate,
+                            std::function<std::vector<uint8_t>(const uint8_t*, size_t)> sign,
+                            const X509_ALGOR* algo) {
+    if (certificate == nullptr || algo == nullptr) {
+        return CertUtilsError::UnexpectedNullPointer;
+    }
+    if (!X509_set1_signature_algo(certificate, algo)) {
         return CertUtilsError::BoringSsl;
     }
 
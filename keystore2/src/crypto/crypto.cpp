@@ -17,19 +17,26 @@
 #define LOG_TAG "keystore2"
 
 #include "crypto.hpp"
+#include "ec_key_pool.h"
+#include "password_key_deriver.h"
 
 #include <assert.h>
 #include <log/log.h>
 #include <openssl/aes.h>
+#include <openssl/cipher.h>
 #include <openssl/ec.h>
 #include <openssl/ec_key.h>
 #include <openssl/ecdh.h>
 #include <openssl/evp.h>
 #include <openssl/hkdf.h>
 #include <openssl/hmac.h>
+#include <openssl/mem.h>
 #include <openssl/rand.h>
+#include <openssl/sha.h>
 #include <openssl/x509.h>
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 
 // Copied from system/security/keystore/blob.h.
@@ -80,82 +87,134 @@ bool randomBytes(uint8_t* out, size_t len) {
     return RAND_bytes(out, len);
 }
 
-/*
- * Encrypt 'len' data at 'in' with AES-GCM, using 128-bit or 256-bit key at 'key', 96-bit IV at
- * 'iv' and write output to 'out' (which may be the same location as 'in') and 128-bit tag to
- * 'tag'.
+/**
+ * Sets up `ctx` for AES-GCM with the 128-bit or 256-bit key at 'key'. The IV is set by gcmEncrypt
+ * and gcmDecrypt.
  */
-bool AES_gcm_encrypt(const uint8_t* in, uint8_t* out, size_t len, const uint8_t* key,
-                     size_t key_size, const uint8_t* iv, uint8_t* tag) {
-
+static bool gcmInit(EVP_CIPHER_CTX* ctx, const uint8_t* key, size_t key_size, int enc) {
     // There can be 128-bit and 256-bit keys
     const EVP_CIPHER* cipher = getAesCipherForKey(key_size);
 
-    bssl::UniquePtr<EVP_CIPHER_CTX> ctx(EVP_CIPHER_CTX_new());
+    if (!EVP_CipherInit_ex(ctx, cipher, nullptr /* engine */, key, nullptr /* iv */, enc)) {
+        return false;
+    }
+    EVP_CIPHER_CTX_set_padding(ctx, 0 /* no padding needed with GCM */);
+    return true;
+}
 
-    EVP_EncryptInit_ex(ctx.get(), cipher, nullptr /* engine */, key, iv);
-    EVP_CIPHER_CTX_set_padding(ctx.get(), 0 /* no padding needed with GCM */);
+/*
+ * Encrypts one message with the key `ctx` was initialized with and writes the ciphertext to 'out',
+ * which may be the same location as 'in'. The cipher can only work in place if 'out' is exactly
+ * 'in', so an 'out' that partially overlaps 'in' is written through a scratch buffer.
+ */
+static bool gcmEncrypt(EVP_CIPHER_CTX* ctx, const uint8_t* in, uint8_t* out, size_t len,
+                       const uint8_t* iv, uint8_t* tag) {
+    if (!EVP_EncryptInit_ex(ctx, nullptr /* cipher */, nullptr /* engine */, nullptr /* key */,
+                            iv)) {
+        return false;
+    }
+
+    std::vector<uint8_t> out_tmp;
+    uint8_t* dst = out;
+    if (out != in && out < in + len && in < out + len) {
+        out_tmp.resize(len);
+        dst = out_tmp.data();
+    }
 
-    std::vector<uint8_t> out_tmp(len);
-    uint8_t* out_pos = out_tmp.data();
+    uint8_t* out_pos = dst;
     int out_len;
 
-    EVP_EncryptUpdate(ctx.get(), out_pos, &out_len, in, len);
+    EVP_EncryptUpdate(ctx, out_pos, &out_len, in, len);
     out_pos += out_len;
-    EVP_EncryptFinal_ex(ctx.get(), out_pos, &out_len);
+    EVP_EncryptFinal_ex(ctx, out_pos, &out_len);
     out_pos += out_len;
-    if (out_pos - out_tmp.data() != static_cast<ssize_t>(len)) {
-        ALOGD("Encrypted ciphertext is the wrong size, expected %zu, got %zd", len,
-              out_pos - out_tmp.data());
+    if (out_pos - dst != static_cast<ssize_t>(len)) {
+        ALOGD("Encrypted ciphertext is the wrong size, expected %zu, got %zd", len, out_pos - dst);
         return false;
     }
 
-    std::copy(out_tmp.data(), out_pos, out);
-    EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, kGcmTagLength, tag);
+    if (dst != out) {
+        std::copy(dst, out_pos, out);
+    }
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, kGcmTagLength, tag);
 
     return true;
 }
 
 /*
- * Decrypt 'len' data at 'in' with AES-GCM, using 128-bit or 256-bit key at 'key', 96-bit IV at
- * 'iv', checking 128-bit tag at 'tag' and writing plaintext to 'out'(which may be the same
- * location as 'in').
+ * Decrypts one message with the key `ctx` was initialized with and writes the plaintext to 'out',
+ * which may be the same location as 'in'. Unauthenticated plaintext never reaches 'out': if 'out'
+ * overlaps 'in', the message is decrypted into a scratch buffer that is erased afterwards, so a
+ * failed in-place decryption leaves the ciphertext untouched. Otherwise 'out' is written directly
+ * and erased if the tag does not match.
  */
-bool AES_gcm_decrypt(const uint8_t* in, uint8_t* out, size_t len, const uint8_t* key,
-                     size_t key_size, const uint8_t* iv, const uint8_t* tag) {
-
-    // There can be 128-bit and 256-bit keys
-    const EVP_CIPHER* cipher = getAesCipherForKey(key_size);
-
-    bssl::UniquePtr<EVP_CIPHER_CTX> ctx(EVP_CIPHER_CTX_new());
+static bool gcmDecrypt(EVP_CIPHER_CTX* ctx, const uint8_t* in, uint8_t* out, size_t len,
+                       const uint8_t* iv, const uint8_t* tag) {
+    if (!EVP_DecryptInit_ex(ctx, nullptr /* cipher */, nullptr /* engine */, nullptr /* key */,
+                            iv)) {
+        return false;
+    }
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, kGcmTagLength, const_cast<uint8_t*>(tag));
 
-    EVP_DecryptInit_ex(ctx.get(), cipher, nullptr /* engine */, key, iv);
-    EVP_CIPHER_CTX_set_padding(ctx.get(), 0 /* no padding needed with GCM */);
-    EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, kGcmTagLength, const_cast<uint8_t*>(tag));
+    std::vector<uint8_t> out_tmp;
+    uint8_t* dst = out;
+    if (out < in + len && in < out + len) {
+        out_tmp.resize(len);
+        dst = out_tmp.data();
+    }
+    ArrayEraser tmp_eraser(out_tmp.data(), out_tmp.size());
 
-    std::vector<uint8_t> out_tmp(len);
-    ArrayEraser out_eraser(out_tmp.data(), len);
-    uint8_t* out_pos = out_tmp.data();
+    uint8_t* out_pos = dst;
     int out_len;
 
-    EVP_DecryptUpdate(ctx.get(), out_pos, &out_len, in, len);
+    EVP_DecryptUpdate(ctx, out_pos, &out_len, in, len);
     out_pos += out_len;
-    if (!EVP_DecryptFinal_ex(ctx.get(), out_pos, &out_len)) {
+    if (!EVP_DecryptFinal_ex(ctx, out_pos, &out_len)) {
         ALOGE("Failed to decrypt blob; ciphertext or tag is likely corrupted");
+        if (dst == out) {
+            OPENSSL_cleanse(out, len);
+        }
         return false;
     }
     out_pos += out_len;
-    if (out_pos - out_tmp.data() != static_cast<ssize_t>(len)) {
-        ALOGE("Encrypted plaintext is the wrong size, expected %zu, got %zd", len,
-              out_pos - out_tmp.data());
+    if (out_pos - dst != static_cast<ssize_t>(len)) {
+        ALOGE("Encrypted plaintext is the wrong size, expected %zu, got %zd", len, out_pos - dst);
+        if (dst == out) {
+            OPENSSL_cleanse(out, len);
+        }
         return false;
     }
 
-    std::copy(out_tmp.data(), out_pos, out);
-
+    if (dst != out) {
+        std::copy(dst, out_pos, out);
+    }
     return true;
 }
 
+/*
+ * Encrypt 'len' data at 'in' with AES-GCM, using 128-bit or 256-bit key at 'key', 96-bit IV at
+ * 'iv' and write output to 'out' (which may be the same location as 'in') and 128-bit tag to
+ * 'tag'.
+ */
+bool AES_gcm_encrypt(const uint8_t* in, uint8_t* out, size_t len, const uint8_t* key,
+                     size_t key_size, const uint8_t* iv, uint8_t* tag) {
+    bssl::ScopedEVP_CIPHER_CTX ctx;
+    return gcmInit(ctx.get(), key, key_size, 1 /* encrypt */) &&
+           gcmEncrypt(ctx.get(), in, out, len, iv, tag);
+}
+
+/*
+ * Decrypt 'len' data at 'in' with AES-GCM, using 128-bit or 256-bit key at 'key', 96-bit IV at
+ * 'iv', checking 128-bit tag at 'tag' and writing plaintext to 'out'(which may be the same
+ * location as 'in').
+ */
+bool AES_gcm_decrypt(const uint8_t* in, uint8_t* out, size_t len, const uint8_t* key,
+                     size_t key_size, const uint8_t* iv, const uint8_t* tag) {
+    bssl::ScopedEVP_CIPHER_CTX ctx;
+    return gcmInit(ctx.get(), key, key_size, 0 /* decrypt */) &&
+           gcmDecrypt(ctx.get(), in, out, len, iv, tag);
+}
+
 // Copied from system/security/keystore/keymaster_enforcement.cpp.
 
 class EvpMdCtx {
@@ -185,25 +244,46 @@ bool CreateKeyId(const uint8_t* key_blob, size_t len, km_id_t* out_id) {
     return false;
 }
 
-// Copied from system/security/keystore/user_state.h
-
-static constexpr size_t SALT_SIZE = 16;
+// New code.
 
-// Copied from system/security/keystore/user_state.cpp.
+// Holds the HMAC state right after keying, i.e., with the inner and outer pads already hashed.
+struct HmacSha256Context {
+    bssl::ScopedHMAC_CTX keyed;
+};
 
-void generateKeyFromPassword(uint8_t* key, size_t key_len, const char* pw, size_t pw_len,
-                             const uint8_t* salt) {
-    const EVP_MD* digest = EVP_sha256();
+HmacSha256Context* HmacSha256ContextNew(const uint8_t* key, size_t key_size) {
+    auto ctx = std::make_unique<HmacSha256Context>();
+    if (!HMAC_Init_ex(ctx->keyed.get(), key, key_size, EVP_sha256(), nullptr /* engine */)) {
+        return nullptr;
+    }
+    return ctx.release();
+}
 
-    // SHA1 was used prior to increasing the key size
-    if (key_len == kAes128KeySizeBytes) {
-        digest = EVP_sha1();
+bool HmacSha256ContextSign(const HmacSha256Context* ctx, const uint8_t* msg, size_t msg_size,
+                           uint8_t* out, size_t out_size) {
+    if (out_size < SHA256_DIGEST_LENGTH) {
+        return false;
     }
+    // Copying the keyed state is much cheaper than keying again, and leaves `ctx` untouched so
+    // that it can be shared between threads.
+    bssl::ScopedHMAC_CTX msg_ctx;
+    unsigned int out_len;
+    return HMAC_CTX_copy_ex(msg_ctx.get(), ctx->keyed.get()) &&
+           HMAC_Update(msg_ctx.get(), msg, msg_size) && HMAC_Final(msg_ctx.get(), out, &out_len);
+}
 
-    PKCS5_PBKDF2_HMAC(pw, pw_len, salt, SALT_SIZE, 8192, digest, key_len, key);
+void HmacSha256ContextFree(HmacSha256Context* ctx) {
+    delete ctx;
 }
 
-// New code.
+void generateKeyFromPassword(uint8_t* key, size_t key_len, const char* pw, size_t pw_len,
+                             const uint8_t* salt) {
+    keystore::PasswordKeyDeriver::get().derive(key, key_len, pw, pw_len, salt);
+}
+
+void clearPasswordKeyCache() {
+    keystore::PasswordKeyDeriver::get().clear();
+}
 
 bool HKDFExtract(uint8_t* out_key, size_t* out_len, const uint8_t* secret, size_t secret_len,
                  const uint8_t* salt, size_t salt_len) {
@@ -224,16 +304,11 @@ int ECDHComputeKey(void* out, const EC_POINT* pub_key, const EC_KEY* priv_key) {
 }
 
 EC_KEY* ECKEYGenerateKey() {
-    EC_KEY* key = EC_KEY_new();
-    EC_GROUP* group = EC_GROUP_new_by_curve_name(NID_secp521r1);
-    EC_KEY_set_group(key, group);
-    auto result = EC_KEY_generate_key(key);
-    if (result == 0) {
-        EC_GROUP_free(group);
-        EC_KEY_free(key);
-        return nullptr;
-    }
-    return key;
+    return keystore::EcKeyPool::get().take().release();
+}
+
+void ECKEYSetKeyPoolDepth(size_t depth) {
+    keystore::EcKeyPool::get().setDepth(depth);
 }
 
 size_t ECKEYMarshalPrivateKey(const EC_KEY* priv_key, uint8_t* buf, size_t len) {
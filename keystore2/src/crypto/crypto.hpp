@@ -20,6 +20,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/types.h>
 
 extern "C" {
   bool hmacSha256(const uint8_t* key, size_t key_size, const uint8_t* msg, size_t msg_size,
@@ -27,6 +28,8 @@ extern "C" {
   bool randomBytes(uint8_t* out, size_t len);
   bool AES_gcm_encrypt(const uint8_t* in, uint8_t* out, size_t len,
                        const uint8_t* key, size_t key_size, const uint8_t* iv, uint8_t* tag);
+  // 'out' may be the same location as 'in'. On failure, 'out' holds no plaintext, and an
+  // in-place call leaves the ciphertext untouched.
   bool AES_gcm_decrypt(const uint8_t* in, uint8_t* out, size_t len,
                        const uint8_t* key, size_t key_size, const uint8_t* iv,
                        const uint8_t* tag);
@@ -36,10 +39,23 @@ extern "C" {
 
   bool CreateKeyId(const uint8_t* key_blob, size_t len, km_id_t* out_id);
 
+  // An HMAC-SHA256 key with its inner and outer pad state computed once, for computing many
+  // tags under the same key. Signing does not modify the context, so it may be shared between
+  // threads. out_size must be at least 32.
+  typedef struct HmacSha256Context HmacSha256Context;
+  HmacSha256Context* HmacSha256ContextNew(const uint8_t* key, size_t key_size);
+  bool HmacSha256ContextSign(const HmacSha256Context* ctx, const uint8_t* msg, size_t msg_size,
+                             uint8_t* out, size_t out_size);
+  void HmacSha256ContextFree(HmacSha256Context* ctx);
+
   // The salt parameter must be non-nullptr and point to 16 bytes of data.
+  // Derived keys are cached for a few seconds, see clearPasswordKeyCache.
   void generateKeyFromPassword(uint8_t* key, size_t key_len, const char* pw,
                                size_t pw_len, const uint8_t* salt);
 
+  // Erases all keys cached by generateKeyFromPassword. Must be called when a user locks.
+  void clearPasswordKeyCache();
+
   #include "openssl/digest.h"
   #include "openssl/ec_key.h"
 
@@ -56,8 +72,12 @@ extern "C" {
 
   int ECDHComputeKey(void *out, const EC_POINT *pub_key, const EC_KEY *priv_key);
 
+  // Takes a pre-generated P-521 key from a pool, or generates one if the pool is empty.
   EC_KEY* ECKEYGenerateKey();
 
+  // Sets how many keys ECKEYGenerateKey keeps ready. 0 disables the pool.
+  void ECKEYSetKeyPoolDepth(size_t depth);
+
   size_t ECKEYMarshalPrivateKey(const EC_KEY *priv_key, uint8_t *buf, size_t len);
 
   EC_KEY* ECKEYParsePrivateKey(const uint8_t *buf, size_t len);
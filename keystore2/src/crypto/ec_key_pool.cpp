@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ec_key_pool.h>
+
+#include <log/log.h>
+#include <openssl/ec.h>
+#include <openssl/nid.h>
+#include <string.h>
+
+namespace keystore {
+
+EcKeyPool::EcKeyPool(size_t depth, Generator generate)
+    : mGenerate(std::move(generate)), mDepth(depth) {}
+
+EcKeyPool::~EcKeyPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mRefillNeeded.notify_all();
+    if (mRefiller) {
+        pthread_join(*mRefiller, nullptr);
+    }
+}
+
+EcKeyPool& EcKeyPool::get() {
+    // Never destroyed, so that the refill thread cannot race with static destruction at exit.
+    static EcKeyPool* pool = new EcKeyPool(kDefaultDepth, generateP521);
+    return *pool;
+}
+
+bssl::UniquePtr<EC_KEY> EcKeyPool::generateP521() {
+    bssl::UniquePtr<EC_KEY> key(EC_KEY_new_by_curve_name(NID_secp521r1));
+    if (!key || !EC_KEY_generate_key(key.get())) {
+        return nullptr;
+    }
+    return key;
+}
+
+bssl::UniquePtr<EC_KEY> EcKeyPool::take() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mRefiller && !mRefillerFailed && mDepth > 0) {
+            pthread_t thread;
+            int error = pthread_create(&thread, nullptr, refillMain, this);
+            if (error == 0) {
+                mRefiller = thread;
+            } else {
+                ALOGW("EcKeyPool: failed to start refill thread, generating keys on demand: %s",
+                      strerror(error));
+                mRefillerFailed = true;
+            }
+        }
+        if (!mKeys.empty()) {
+            auto key = std::move(mKeys.front());
+            mKeys.pop_front();
+            ++mHits;
+            mRefillNeeded.notify_one();
+            return key;
+        }
+        ++mMisses;
+    }
+    mRefillNeeded.notify_one();
+    return mGenerate();
+}
+
+void EcKeyPool::setDepth(size_t depth) {
+    std::deque<bssl::UniquePtr<EC_KEY>> surplus;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDepth = depth;
+        while (mKeys.size() > mDepth) {
+            surplus.push_back(std::move(mKeys.back()));
+            mKeys.pop_back();
+        }
+    }
+    // The surplus keys are freed, and thereby erased, outside of the lock.
+    mRefillNeeded.notify_one();
+}
+
+size_t EcKeyPool::hits() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mHits;
+}
+
+size_t EcKeyPool::misses() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mMisses;
+}
+
+void* EcKeyPool::refillMain(void* pool) {
+    reinterpret_cast<EcKeyPool*>(pool)->refillLoop();
+    return nullptr;
+}
+
+void EcKeyPool::refillLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mRefillNeeded.wait(lock, [this] { return mStopping || mKeys.size() < mDepth; });
+        if (mStopping) return;
+
+        lock.unlock();
+        auto key = mGenerate();
+        lock.lock();
+
+        if (!key) {
+            ALOGE("EcKeyPool: failed to generate key");
+            // Leave it to the next take() to try again, rather than spinning on the failure.
+            mRefillNeeded.wait(lock);
+            continue;
+        }
+        if (mKeys.size() < mDepth) {
+            mKeys.push_back(std::move(key));
+        }
+    }
+}
+
+}  // namespace keystore
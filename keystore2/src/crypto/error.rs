@@ -95,7 +95,8 @@ pub enum Error {
     #[error("Failed to extract certificate subject.")]
     ExtractSubjectFailed,
 
-    /// This is returned if the C implementation of hmacSha256 failed.
+    /// This is returned if the C implementation of hmacSha256 or the HmacSha256Context
+    /// functions failed.
     #[error("Failed to calculate HMAC-SHA256.")]
     HmacSha256Failed,
 
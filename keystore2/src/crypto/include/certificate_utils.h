@@ -77,6 +77,23 @@ struct BasicConstraintsExtension {
     std::optional<int> pathLength;
 };
 
+/**
+ * Allocates an X509 certificate structure and sets the version, serial number, subject name, and
+ * the validity period. The result has neither a public key nor extensions. Callers that obtain the
+ * public key asynchronously can prepare the rump ahead of time and complete it with
+ * `X509_set_pubkey` later.
+ * @param serial The certificate serial number.
+ * @param subject The X509 name encoded subject common name.
+ * @param activeDateTimeMilliSeconds The not before date in epoch milliseconds.
+ * @param usageExpireDateTimeMilliSeconds The not after date in epoch milliseconds.
+ * @return CertUtilsError::Ok on success.
+ */
+std::variant<CertUtilsError, X509_Ptr>
+makeCertRump(std::optional<std::reference_wrapper<const std::vector<uint8_t>>> serial,
+             std::optional<std::reference_wrapper<const std::vector<uint8_t>>> subject,
+             const int64_t activeDateTimeMilliSeconds,
+             const int64_t usageExpireDateTimeMilliSeconds);
+
 /**
  * This function allocates and prepares an X509 certificate structure with all of the information
  * given. Next steps would be to set an Issuer with `setIssuer` and sign it with either
@@ -170,6 +187,29 @@ CertUtilsError signCertWith(X509* certificate,
                             std::function<std::vector<uint8_t>(const uint8_t*, size_t)> sign,
                             Algo algo, Padding padding, Digest digest);
 
+/**
+ * Builds the signature algorithm identifier for the given triplet as used by `signCertWith`.
+ * The result does not depend on the certificate and may be reused for any number of signatures.
+ * @param algo Algorithm specifier.
+ * @param padding Padding specifier. Ignored if `algo` is Algo::ECDSA.
+ * @param digest Digest specifier.
+ * @return The X509_ALGOR structure on success.
+ */
+std::variant<CertUtilsError, X509_ALGOR_Ptr> makeAlgo(Algo algo, Padding padding, Digest digest);
+
+/**
+ * Like `signCertWith` above, but takes a signature algorithm identifier previously built with
+ * `makeAlgo`. `algo` is copied into the certificate and not modified.
+ *
+ * @param certificate X509 certificate structure to be signed.
+ * @param sign Callback function used to digest and sign the DER encoded to-be-signed certificate.
+ * @param algo Signing algorithm id of the X509 certificate.
+ * @return CertUtilsError::Ok on success.
+ */
+CertUtilsError signCertWith(X509* certificate,
+                            std::function<std::vector<uint8_t>(const uint8_t*, size_t)> sign,
+                            const X509_ALGOR* algo);
+
 /**
  * Generates the DER representation of the given signed X509 certificate structure.
  * @param certificate
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <openssl/ec_key.h>
+#include <pthread.h>
+#include <stddef.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+
+namespace keystore {
+
+/**
+ * A pool of pre-generated EC keys for ECKEYGenerateKey.
+ *
+ * Generating a P-521 key takes long enough to show up in the latency of super-encryption, which
+ * needs a new ephemeral key each time. The pool hands out keys generated ahead of time and
+ * refills itself on a background thread, which is started when the first key is taken. If the
+ * pool is empty, or the thread cannot be started, a key is generated synchronously.
+ *
+ * Keys leaving the pool other than through `take`, because the depth shrinks or the pool is
+ * destroyed, are freed with EC_KEY_free, which erases the private key.
+ */
+class EcKeyPool {
+  public:
+    using Generator = std::function<bssl::UniquePtr<EC_KEY>()>;
+
+    // The default number of keys kept ready.
+    static constexpr size_t kDefaultDepth = 2;
+
+    EcKeyPool(size_t depth, Generator generate);
+    ~EcKeyPool();
+
+    EcKeyPool(const EcKeyPool&) = delete;
+    EcKeyPool& operator=(const EcKeyPool&) = delete;
+
+    /**
+     * Returns the process wide instance used by ECKEYGenerateKey, which generates P-521 keys.
+     */
+    static EcKeyPool& get();
+
+    /**
+     * Generates a new P-521 key, without using any pool.
+     */
+    static bssl::UniquePtr<EC_KEY> generateP521();
+
+    /**
+     * Returns a key, which is never handed out again. Returns nullptr if the pool is empty and
+     * generating a key fails.
+     */
+    bssl::UniquePtr<EC_KEY> take();
+
+    /**
+     * Sets the number of keys to keep ready. Surplus keys are freed. A depth of 0 disables the
+     * pool.
+     */
+    void setDepth(size_t depth);
+
+    size_t hits() const;
+    size_t misses() const;
+
+  private:
+    static void* refillMain(void* pool);
+    void refillLoop();
+
+    const Generator mGenerate;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mRefillNeeded;
+    std::deque<bssl::UniquePtr<EC_KEY>> mKeys;
+    size_t mDepth;
+    size_t mHits = 0;
+    size_t mMisses = 0;
+    bool mStopping = false;
+    // Set once starting the refill thread failed, so that it is not retried on every take().
+    bool mRefillerFailed = false;
+    std::optional<pthread_t> mRefiller;
+};
+
+}  // namespace keystore
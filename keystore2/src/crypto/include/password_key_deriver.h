@@ -0,0 +1,167 @@
+/*
+ * Copyright 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <openssl/sha.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace keystore {
+
+/**
+ * Derives keys from passwords with PBKDF2 for generateKeyFromPassword.
+ *
+ * Derivations run on a bounded pool of worker threads. Several users unlocking at the same time
+ * are derived in parallel without oversubscribing the CPU, and concurrent requests for the same
+ * password and salt share a single derivation. If no worker can be started, keys are derived on
+ * the calling threads instead.
+ *
+ * Derived keys are kept for a short time, so that repeated unlocks skip the work. The workers
+ * erase cached keys as they expire, and `clear` erases all of them, which must happen whenever a
+ * user locks. Without workers, nothing would erase expired keys, so nothing is cached. Cached keys
+ * are looked up by an HMAC of the password and salt under a random per-process key, so the
+ * lookup table does not allow testing password guesses either.
+ */
+class PasswordKeyDeriver {
+  public:
+    // All salts are this many bytes long.
+    static constexpr size_t kSaltSize = 16;
+
+    struct Request {
+        uint8_t* key;
+        size_t keyLen;
+        const char* pw;
+        size_t pwLen;
+        const uint8_t* salt;
+    };
+
+    // With no workers, keys are derived on the calling threads and not cached.
+    PasswordKeyDeriver(size_t numWorkers, std::chrono::milliseconds cacheTtl);
+    ~PasswordKeyDeriver();
+
+    PasswordKeyDeriver(const PasswordKeyDeriver&) = delete;
+    PasswordKeyDeriver& operator=(const PasswordKeyDeriver&) = delete;
+
+    /**
+     * Returns the process wide instance used by generateKeyFromPassword.
+     */
+    static PasswordKeyDeriver& get();
+
+    /**
+     * Derives a single key. Blocks until the key has been written to `key`.
+     */
+    void derive(uint8_t* key, size_t keyLen, const char* pw, size_t pwLen, const uint8_t* salt);
+
+    /**
+     * Derives all requested keys, in parallel as far as the worker pool allows. Blocks until all
+     * keys have been written.
+     */
+    void deriveAll(const Request* requests, size_t count);
+
+    /**
+     * Erases all cached keys. Derivations in flight complete, but their results are not cached.
+     */
+    void clear();
+
+    size_t hits() const;
+    size_t misses() const;
+    size_t cachedKeys() const;
+
+    /**
+     * The PBKDF2 derivation itself, without caching.
+     */
+    static void deriveUncached(uint8_t* key, size_t keyLen, const char* pw, size_t pwLen,
+                               const uint8_t* salt);
+
+  private:
+    using CacheId = std::array<uint8_t, SHA256_DIGEST_LENGTH>;
+
+    // A byte buffer that is erased when it is destroyed.
+    class SecretBytes {
+      public:
+        SecretBytes() = default;
+        SecretBytes(const uint8_t* data, size_t size) : mBytes(data, data + size) {}
+        explicit SecretBytes(size_t size) : mBytes(size) {}
+        SecretBytes(SecretBytes&&) = default;
+        SecretBytes& operator=(SecretBytes&& other);
+        ~SecretBytes();
+
+        uint8_t* data() { return mBytes.data(); }
+        const uint8_t* data() const { return mBytes.data(); }
+        size_t size() const { return mBytes.size(); }
+
+      private:
+        void erase();
+
+        std::vector<uint8_t> mBytes;
+    };
+
+    struct Derivation {
+        CacheId id;
+        SecretBytes pw;
+        std::array<uint8_t, kSaltSize> salt;
+        SecretBytes key;
+        uint64_t generation;
+        bool done = false;
+    };
+
+    struct CacheEntry {
+        SecretBytes key;
+        std::chrono::steady_clock::time_point expiry;
+    };
+
+    // Returns nullopt if the HMAC cannot be computed.
+    std::optional<CacheId> cacheId(size_t keyLen, const char* pw, size_t pwLen,
+                                   const uint8_t* salt) const;
+
+    static void* workerMain(void* deriver);
+    void workerLoop();
+    // Runs the first queued derivation with the lock released. Only derivations run by a worker
+    // are cached.
+    void runNextLocked(std::unique_lock<std::mutex>& lock, bool onWorker);
+    void pruneExpiredLocked(std::chrono::steady_clock::time_point now);
+
+    const std::chrono::milliseconds mCacheTtl;
+    std::array<uint8_t, SHA256_DIGEST_LENGTH> mCacheIdKey;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mWorkAvailable;
+    std::condition_variable mDerivationDone;
+    std::deque<std::shared_ptr<Derivation>> mQueue;
+    std::map<CacheId, std::shared_ptr<Derivation>> mInFlight;
+    std::map<CacheId, CacheEntry> mCache;
+    // Incremented by clear(), so that derivations started before do not populate the cache.
+    uint64_t mGeneration = 0;
+    size_t mHits = 0;
+    size_t mMisses = 0;
+    bool mStopping = false;
+    // Only changed by the constructor.
+    std::vector<pthread_t> mWorkers;
+};
+
+}  // namespace keystore
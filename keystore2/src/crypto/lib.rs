@@ -19,10 +19,12 @@ mod error;
 pub mod zvec;
 pub use error::Error;
 use keystore2_crypto_bindgen::{
-    extractSubjectFromCertificate, generateKeyFromPassword, hmacSha256, randomBytes,
-    AES_gcm_decrypt, AES_gcm_encrypt, ECDHComputeKey, ECKEYGenerateKey, ECKEYMarshalPrivateKey,
-    ECKEYParsePrivateKey, ECPOINTOct2Point, ECPOINTPoint2Oct, EC_KEY_free, EC_KEY_get0_public_key,
-    EC_POINT_free, HKDFExpand, HKDFExtract, EC_KEY, EC_MAX_BYTES, EC_POINT, EVP_MAX_MD_SIZE,
+    clearPasswordKeyCache, extractSubjectFromCertificate, generateKeyFromPassword, hmacSha256,
+    randomBytes, AES_gcm_decrypt, AES_gcm_encrypt, ECDHComputeKey, ECKEYGenerateKey,
+    ECKEYMarshalPrivateKey, ECKEYParsePrivateKey, ECKEYSetKeyPoolDepth, ECPOINTOct2Point,
+    ECPOINTPoint2Oct, EC_KEY_free, EC_KEY_get0_public_key, EC_POINT_free, HKDFExpand, HKDFExtract,
+    HmacSha256ContextFree, HmacSha256ContextNew, HmacSha256ContextSign, EC_KEY, EC_MAX_BYTES,
+    EC_POINT, EVP_MAX_MD_SIZE,
 };
 use std::convert::TryFrom;
 use std::convert::TryInto;
@@ -89,6 +91,49 @@ pub fn hmac_sha256(key: &[u8], msg: &[u8]) -> Result<Vec<u8>, Error> {
     }
 }
 
+/// An HMAC-SHA256 key with its pad state computed once. Use this rather than [`hmac_sha256`] to
+/// compute many tags under the same key.
+pub struct HmacSha256Context(*mut keystore2_crypto_bindgen::HmacSha256Context);
+
+// Safety: HmacSha256ContextSign does not modify the context, and the context is only freed on
+// drop.
+unsafe impl Send for HmacSha256Context {}
+// Safety: See above.
+unsafe impl Sync for HmacSha256Context {}
+
+impl HmacSha256Context {
+    /// Creates a context for computing tags under `key`.
+    pub fn new(key: &[u8]) -> Result<Self, Error> {
+        // Safety: key must point to a const buffer with size given by the second argument.
+        let ctx = unsafe { HmacSha256ContextNew(key.as_ptr(), key.len()) };
+        if ctx.is_null() {
+            return Err(Error::HmacSha256Failed);
+        }
+        Ok(Self(ctx))
+    }
+
+    /// Computes the HMAC-SHA256 tag of `msg`. Gives the same result as [`hmac_sha256`].
+    pub fn sign(&self, msg: &[u8]) -> Result<Vec<u8>, Error> {
+        let mut tag = vec![0; HMAC_SHA256_LEN];
+        // Safety: self.0 is a valid context. msg and tag point to buffers with size given by the
+        // argument that follows them.
+        match unsafe {
+            HmacSha256ContextSign(self.0, msg.as_ptr(), msg.len(), tag.as_mut_ptr(), tag.len())
+        } {
+            true => Ok(tag),
+            false => Err(Error::HmacSha256Failed),
+        }
+    }
+}
+
+impl Drop for HmacSha256Context {
+    fn drop(&mut self) {
+        // Safety: We only create HmacSha256Context objects for valid contexts and they are the
+        // sole owners of those contexts.
+        unsafe { HmacSha256ContextFree(self.0) };
+    }
+}
+
 /// Uses AES GCM to decipher a message given an initialization vector, aead tag, and key.
 /// This function accepts 128 and 256-bit keys and uses AES128 and AES256 respectively based
 /// on the key length.
@@ -228,6 +273,13 @@ impl<'a> Password<'a> {
     }
 }
 
+/// Erases the keys that `Password::derive_key` caches for a few seconds to speed up repeated
+/// unlocks. This must be called whenever a user locks.
+pub fn clear_password_key_cache() {
+    // Safety: clearPasswordKeyCache has no preconditions.
+    unsafe { clearPasswordKeyCache() }
+}
+
 /// Calls the boringssl HKDF_extract function.
 pub fn hkdf_extract(secret: &[u8], salt: &[u8]) -> Result<ZVec, Error> {
     let max_size: usize = EVP_MAX_MD_SIZE.try_into().unwrap();
@@ -343,7 +395,8 @@ pub fn ecdh_compute_key(pub_key: &EC_POINT, priv_key: &ECKey) -> Result<ZVec, Er
     Ok(buf)
 }
 
-/// Calls the boringssl EC_KEY_generate_key function.
+/// Returns a new P-521 key. Keys are generated ahead of time on a background thread, see
+/// ec_key_set_pool_depth.
 pub fn ec_key_generate_key() -> Result<ECKey, Error> {
     // Safety: Creates a new key on its own.
     let key = unsafe { ECKEYGenerateKey() };
@@ -353,6 +406,12 @@ pub fn ec_key_generate_key() -> Result<ECKey, Error> {
     Ok(ECKey(key))
 }
 
+/// Sets how many keys ec_key_generate_key keeps ready. 0 disables pre-generation.
+pub fn ec_key_set_pool_depth(depth: usize) {
+    // Safety: ECKEYSetKeyPoolDepth takes no pointers.
+    unsafe { ECKEYSetKeyPoolDepth(depth) }
+}
+
 /// Calls the boringssl EC_KEY_marshal_private_key function.
 pub fn ec_key_marshal_private_key(key: &ECKey) -> Result<ZVec, Error> {
     let len = 73; // Empirically observed length of private key
@@ -587,4 +646,15 @@ mod tests {
         assert_eq!(tag2.len(), HMAC_SHA256_LEN);
         assert_ne!(tag1a, tag2);
     }
+
+    #[test]
+    fn test_hmac_sha256_context() {
+        let key = b"This is the key";
+        let msg1 = b"This is a message";
+        let msg2 = b"This is another message";
+        let ctx = HmacSha256Context::new(key).unwrap();
+        assert_eq!(ctx.sign(msg1).unwrap(), hmac_sha256(key, msg1).unwrap());
+        assert_eq!(ctx.sign(msg2).unwrap(), hmac_sha256(key, msg2).unwrap());
+        assert_eq!(ctx.sign(msg1).unwrap(), hmac_sha256(key, msg1).unwrap());
+    }
 }
@@ -0,0 +1,288 @@
+/*
+ * Copyright 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <password_key_deriver.h>
+
+#include <log/log.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/mem.h>
+#include <openssl/rand.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace keystore {
+
+namespace {
+
+constexpr size_t kAes128KeySizeBytes = 128 / 8;
+
+// Unlocks are rare and each derivation keeps a core busy for a while, so a few workers suffice.
+constexpr unsigned kMaxWorkers = 4;
+
+// Long enough to cover the unlock calls that follow a single user unlock.
+constexpr std::chrono::milliseconds kCacheTtl = std::chrono::seconds(5);
+
+}  // namespace
+
+PasswordKeyDeriver::SecretBytes& PasswordKeyDeriver::SecretBytes::operator=(SecretBytes&& other) {
+    if (this != &other) {
+        erase();
+        mBytes = std::move(other.mBytes);
+    }
+    return *this;
+}
+
+PasswordKeyDeriver::SecretBytes::~SecretBytes() {
+    erase();
+}
+
+void PasswordKeyDeriver::SecretBytes::erase() {
+    OPENSSL_cleanse(mBytes.data(), mBytes.size());
+}
+
+PasswordKeyDeriver::PasswordKeyDeriver(size_t numWorkers, std::chrono::milliseconds cacheTtl)
+    : mCacheTtl(cacheTtl) {
+    RAND_bytes(mCacheIdKey.data(), mCacheIdKey.size());
+    for (size_t i = 0; i < numWorkers; ++i) {
+        pthread_t thread;
+        int error = pthread_create(&thread, nullptr, workerMain, this);
+        if (error != 0) {
+            ALOGW("PasswordKeyDeriver: failed to start worker %zu of %zu: %s", i + 1, numWorkers,
+                  strerror(error));
+            break;
+        }
+        mWorkers.push_back(thread);
+    }
+}
+
+PasswordKeyDeriver::~PasswordKeyDeriver() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWorkAvailable.notify_all();
+    for (pthread_t worker : mWorkers) {
+        pthread_join(worker, nullptr);
+    }
+    OPENSSL_cleanse(mCacheIdKey.data(), mCacheIdKey.size());
+}
+
+PasswordKeyDeriver& PasswordKeyDeriver::get() {
+    // Never destroyed, so that the workers cannot race with static destruction at exit.
+    static PasswordKeyDeriver* deriver = new PasswordKeyDeriver(
+        std::clamp(std::thread::hardware_concurrency(), 1u, kMaxWorkers), kCacheTtl);
+    return *deriver;
+}
+
+// Copied from system/security/keystore/user_state.cpp.
+
+void PasswordKeyDeriver::deriveUncached(uint8_t* key, size_t keyLen, const char* pw, size_t pwLen,
+                                        const uint8_t* salt) {
+    const EVP_MD* digest = EVP_sha256();
+
+    // SHA1 was used prior to increasing the key size
+    if (keyLen == kAes128KeySizeBytes) {
+        digest = EVP_sha1();
+    }
+
+    PKCS5_PBKDF2_HMAC(pw, pwLen, salt, kSaltSize, 8192, digest, keyLen, key);
+}
+
+// New code.
+
+std::optional<PasswordKeyDeriver::CacheId> PasswordKeyDeriver::cacheId(size_t keyLen,
+                                                                       const char* pw,
+                                                                       size_t pwLen,
+                                                                       const uint8_t* salt) const {
+    // The key length selects the digest, so it is part of the identity.
+    uint64_t len = keyLen;
+    bssl::ScopedHMAC_CTX ctx;
+    CacheId id;
+    unsigned int idLen;
+    if (!HMAC_Init_ex(ctx.get(), mCacheIdKey.data(), mCacheIdKey.size(), EVP_sha256(),
+                      nullptr /* engine */) ||
+        !HMAC_Update(ctx.get(), reinterpret_cast<const uint8_t*>(&len), sizeof(len)) ||
+        !HMAC_Update(ctx.get(), salt, kSaltSize) ||
+        !HMAC_Update(ctx.get(), reinterpret_cast<const uint8_t*>(pw), pwLen) ||
+        !HMAC_Final(ctx.get(), id.data(), &idLen)) {
+        return std::nullopt;
+    }
+    return id;
+}
+
+void PasswordKeyDeriver::derive(uint8_t* key, size_t keyLen, const char* pw, size_t pwLen,
+                                const uint8_t* salt) {
+    Request request = {.key = key, .keyLen = keyLen, .pw = pw, .pwLen = pwLen, .salt = salt};
+    deriveAll(&request, 1);
+}
+
+void PasswordKeyDeriver::deriveAll(const Request* requests, size_t count) {
+    // A request without an id can neither be cached nor shared, so it is derived right away.
+    std::vector<std::optional<CacheId>> ids(count);
+    for (size_t i = 0; i < count; ++i) {
+        const Request& request = requests[i];
+        ids[i] = cacheId(request.keyLen, request.pw, request.pwLen, request.salt);
+        if (!ids[i]) {
+            ALOGE("PasswordKeyDeriver: failed to compute cache id");
+            deriveUncached(request.key, request.keyLen, request.pw, request.pwLen, request.salt);
+        }
+    }
+
+    std::vector<std::shared_ptr<Derivation>> pending(count);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    pruneExpiredLocked(std::chrono::steady_clock::now());
+    for (size_t i = 0; i < count; ++i) {
+        if (!ids[i]) {
+            continue;
+        }
+        const Request& request = requests[i];
+        const CacheId& id = *ids[i];
+
+        if (auto it = mCache.find(id); it != mCache.end()) {
+            const SecretBytes& cached = it->second.key;
+            std::copy(cached.data(), cached.data() + cached.size(), request.key);
+            ++mHits;
+            continue;
+        }
+        if (auto it = mInFlight.find(id); it != mInFlight.end()) {
+            pending[i] = it->second;
+            ++mHits;
+            continue;
+        }
+
+        auto derivation = std::make_shared<Derivation>();
+        derivation->id = id;
+        derivation->pw = SecretBytes(reinterpret_cast<const uint8_t*>(request.pw), request.pwLen);
+        std::copy(request.salt, request.salt + kSaltSize, derivation->salt.begin());
+        derivation->key = SecretBytes(request.keyLen);
+        derivation->generation = mGeneration;
+        mInFlight.emplace(id, derivation);
+        mQueue.push_back(derivation);
+        pending[i] = std::move(derivation);
+        ++mMisses;
+        mWorkAvailable.notify_one();
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (!pending[i]) {
+            continue;
+        }
+        auto& derivation = *pending[i];
+        while (!derivation.done) {
+            // Without workers, the callers run the queued derivations themselves.
+            if (mWorkers.empty() && !mQueue.empty()) {
+                runNextLocked(lock, false /* onWorker */);
+            } else {
+                mDerivationDone.wait(lock);
+            }
+        }
+        std::copy(derivation.key.data(), derivation.key.data() + derivation.key.size(),
+                  requests[i].key);
+    }
+}
+
+void PasswordKeyDeriver::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCache.clear();
+    ++mGeneration;
+}
+
+size_t PasswordKeyDeriver::hits() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mHits;
+}
+
+size_t PasswordKeyDeriver::misses() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mMisses;
+}
+
+size_t PasswordKeyDeriver::cachedKeys() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCache.size();
+}
+
+void PasswordKeyDeriver::pruneExpiredLocked(std::chrono::steady_clock::time_point now) {
+    for (auto it = mCache.begin(); it != mCache.end();) {
+        if (it->second.expiry <= now) {
+            it = mCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void* PasswordKeyDeriver::workerMain(void* deriver) {
+    reinterpret_cast<PasswordKeyDeriver*>(deriver)->workerLoop();
+    return nullptr;
+}
+
+void PasswordKeyDeriver::workerLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mStopping) {
+        auto now = std::chrono::steady_clock::now();
+        pruneExpiredLocked(now);
+
+        if (mQueue.empty()) {
+            // Idle workers also expire cached keys, so that they do not outlive their time to live
+            // just because no one asks for a key.
+            if (mCache.empty()) {
+                mWorkAvailable.wait(lock);
+            } else {
+                auto next = std::min_element(
+                    mCache.begin(), mCache.end(),
+                    [](const auto& a, const auto& b) { return a.second.expiry < b.second.expiry; });
+                // A copy, as the entry may be erased by clear() while waiting.
+                auto expiry = next->second.expiry;
+                mWorkAvailable.wait_until(lock, expiry);
+            }
+            continue;
+        }
+
+        runNextLocked(lock, true /* onWorker */);
+    }
+}
+
+void PasswordKeyDeriver::runNextLocked(std::unique_lock<std::mutex>& lock, bool onWorker) {
+    auto derivation = std::move(mQueue.front());
+    mQueue.pop_front();
+    lock.unlock();
+    deriveUncached(derivation->key.data(), derivation->key.size(),
+                   reinterpret_cast<const char*>(derivation->pw.data()), derivation->pw.size(),
+                   derivation->salt.data());
+    lock.lock();
+
+    derivation->pw = SecretBytes();
+    derivation->done = true;
+    mInFlight.erase(derivation->id);
+    // A clear() since the derivation started means a user locked; do not resurrect the key. The
+    // worker that caches the key goes on to erase it when it expires.
+    if (onWorker && derivation->generation == mGeneration && mCacheTtl.count() > 0) {
+        mCache.insert_or_assign(
+            derivation->id,
+            CacheEntry{
+                .key = SecretBytes(derivation->key.data(), derivation->key.size()),
+                .expiry = std::chrono::steady_clock::now() + mCacheTtl,
+            });
+    }
+    mDerivationDone.notify_all();
+}
+
+}  // namespace keystore
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "crypto.hpp"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+constexpr size_t kIvLength = 12;
+constexpr size_t kTagLength = 16;
+
+class AesGcmTest : public testing::TestWithParam<size_t /* key size */> {
+  protected:
+    void SetUp() override {
+        key_.resize(GetParam());
+        ASSERT_TRUE(randomBytes(key_.data(), key_.size()));
+    }
+
+    std::vector<uint8_t> key_;
+};
+
+INSTANTIATE_TEST_SUITE_P(AesGcm, AesGcmTest, testing::Values(16, 32));
+
+TEST_P(AesGcmTest, RoundTrip) {
+    std::vector<uint8_t> plaintext(1000, 0xa5);
+    std::array<uint8_t, kIvLength> iv = {};
+    std::array<uint8_t, kTagLength> tag;
+
+    std::vector<uint8_t> ciphertext(plaintext.size());
+    ASSERT_TRUE(AES_gcm_encrypt(plaintext.data(), ciphertext.data(), plaintext.size(), key_.data(),
+                                key_.size(), iv.data(), tag.data()));
+    ASSERT_NE(ciphertext, plaintext);
+
+    std::vector<uint8_t> decrypted(ciphertext.size());
+    ASSERT_TRUE(AES_gcm_decrypt(ciphertext.data(), decrypted.data(), ciphertext.size(),
+                                key_.data(), key_.size(), iv.data(), tag.data()));
+    ASSERT_EQ(decrypted, plaintext);
+}
+
+TEST_P(AesGcmTest, InPlace) {
+    std::vector<uint8_t> plaintext(1000, 0xa5);
+    std::array<uint8_t, kIvLength> iv = {};
+    std::array<uint8_t, kTagLength> tag;
+
+    std::vector<uint8_t> expected(plaintext.size());
+    std::array<uint8_t, kTagLength> expectedTag;
+    ASSERT_TRUE(AES_gcm_encrypt(plaintext.data(), expected.data(), plaintext.size(), key_.data(),
+                                key_.size(), iv.data(), expectedTag.data()));
+
+    auto buffer = plaintext;
+    ASSERT_TRUE(AES_gcm_encrypt(buffer.data(), buffer.data(), buffer.size(), key_.data(),
+                                key_.size(), iv.data(), tag.data()));
+    ASSERT_EQ(buffer, expected);
+    ASSERT_EQ(tag, expectedTag);
+
+    ASSERT_TRUE(AES_gcm_decrypt(buffer.data(), buffer.data(), buffer.size(), key_.data(),
+                                key_.size(), iv.data(), tag.data()));
+    ASSERT_EQ(buffer, plaintext);
+}
+
+TEST_P(AesGcmTest, CorruptedTagErasesOutput) {
+    std::vector<uint8_t> plaintext(1000, 0xa5);
+    std::array<uint8_t, kIvLength> iv = {};
+    std::array<uint8_t, kTagLength> tag;
+
+    std::vector<uint8_t> ciphertext(plaintext.size());
+    ASSERT_TRUE(AES_gcm_encrypt(plaintext.data(), ciphertext.data(), plaintext.size(), key_.data(),
+                                key_.size(), iv.data(), tag.data()));
+    tag[0] ^= 1;
+    std::vector<uint8_t> decrypted(ciphertext.size(), 0xff);
+    ASSERT_FALSE(AES_gcm_decrypt(ciphertext.data(), decrypted.data(), ciphertext.size(),
+                                 key_.data(), key_.size(), iv.data(), tag.data()));
+    ASSERT_EQ(decrypted, std::vector<uint8_t>(decrypted.size(), 0));
+}
+
+TEST_P(AesGcmTest, CorruptedTagInPlaceKeepsCiphertext) {
+    std::vector<uint8_t> plaintext(1000, 0xa5);
+    std::array<uint8_t, kIvLength> iv = {};
+    std::array<uint8_t, kTagLength> tag;
+
+    auto buffer = plaintext;
+    ASSERT_TRUE(AES_gcm_encrypt(buffer.data(), buffer.data(), buffer.size(), key_.data(),
+                                key_.size(), iv.data(), tag.data()));
+    auto ciphertext = buffer;
+    tag[0] ^= 1;
+    ASSERT_FALSE(AES_gcm_decrypt(buffer.data(), buffer.data(), buffer.size(), key_.data(),
+                                 key_.size(), iv.data(), tag.data()));
+    ASSERT_EQ(buffer, ciphertext);
+}
+
+TEST_P(AesGcmTest, OverlappingBuffers) {
+    std::vector<uint8_t> plaintext(1000, 0xa5);
+    std::array<uint8_t, kIvLength> iv = {};
+    std::array<uint8_t, kTagLength> tag;
+
+    std::vector<uint8_t> expected(plaintext.size());
+    std::array<uint8_t, kTagLength> expectedTag;
+    ASSERT_TRUE(AES_gcm_encrypt(plaintext.data(), expected.data(), plaintext.size(), key_.data(),
+                                key_.size(), iv.data(), expectedTag.data()));
+
+    // The output starts a few bytes into the input, and the other way around.
+    constexpr size_t kShift = 7;
+    std::vector<uint8_t> buffer(plaintext.size() + kShift);
+    std::copy(plaintext.begin(), plaintext.end(), buffer.begin());
+    ASSERT_TRUE(AES_gcm_encrypt(buffer.data(), buffer.data() + kShift, plaintext.size(),
+                                key_.data(), key_.size(), iv.data(), tag.data()));
+    ASSERT_EQ(std::vector<uint8_t>(buffer.begin() + kShift, buffer.end()), expected);
+    ASSERT_EQ(tag, expectedTag);
+
+    ASSERT_TRUE(AES_gcm_decrypt(buffer.data() + kShift, buffer.data(), plaintext.size(),
+                                key_.data(), key_.size(), iv.data(), tag.data()));
+    ASSERT_EQ(std::vector<uint8_t>(buffer.begin(), buffer.begin() + plaintext.size()), plaintext);
+}
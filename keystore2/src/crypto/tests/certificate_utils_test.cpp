@@ -324,6 +324,58 @@ TEST_P(CertificateUtilsWithRsa, CertSigningWithCallbackRsa) {
     }
 }
 
+TEST(CertificateUtilsTest, CertRumpWithSharedAlgo) {
+    EVP_PKEY_CTX_Ptr pkey_ctx(EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL));
+    ASSERT_TRUE((bool)pkey_ctx);
+    ASSERT_TRUE(EVP_PKEY_keygen_init(pkey_ctx.get()));
+    ASSERT_TRUE(EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pkey_ctx.get(), NID_X9_62_prime256v1));
+
+    EVP_PKEY* pkey_ptr = nullptr;
+    ASSERT_TRUE(EVP_PKEY_keygen(pkey_ctx.get(), &pkey_ptr));
+    EVP_PKEY_Ptr pkey(pkey_ptr);
+    ASSERT_TRUE(pkey);
+
+    auto algoV = makeAlgo(Algo::ECDSA, Padding::Ignored, Digest::SHA256);
+    ASSERT_TRUE(std::holds_alternative<X509_ALGOR_Ptr>(algoV));
+    auto& algo = std::get<X509_ALGOR_Ptr>(algoV);
+
+    uint64_t now_ms = (uint64_t)time(nullptr) * 1000;
+
+    // Sign two certificates with the same algorithm identifier to check that it is not consumed.
+    for (int i = 0; i < 2; ++i) {
+        auto certV = makeCertRump(std::nullopt, std::nullopt, now_ms - kValidity,
+                                  now_ms + kValidity);
+        ASSERT_TRUE(std::holds_alternative<X509_Ptr>(certV));
+        auto& cert = std::get<X509_Ptr>(certV);
+        ASSERT_TRUE(X509_set_pubkey(cert.get(), pkey.get()));
+        ASSERT_TRUE(!setIssuer(cert.get(), cert.get(), false));
+
+        ASSERT_TRUE(!signCertWith(
+            cert.get(),
+            [&](const uint8_t* data, size_t len) {
+                bssl::ScopedEVP_MD_CTX sign_ctx;
+                EXPECT_TRUE(EVP_DigestSignInit(sign_ctx.get(), nullptr, EVP_sha256(), nullptr,
+                                               pkey.get()));
+
+                std::vector<uint8_t> sig_buf(512);
+                size_t sig_len = 512;
+                EVP_DigestSign(sign_ctx.get(), sig_buf.data(), &sig_len, data, len);
+                sig_buf.resize(sig_len);
+                return sig_buf;
+            },
+            algo.get()));
+
+        auto encCertV = encodeCert(cert.get());
+        ASSERT_TRUE(std::holds_alternative<std::vector<uint8_t>>(encCertV));
+        auto& encCert = std::get<1>(encCertV);
+
+        const uint8_t* p = encCert.data();
+        X509_Ptr decoded_cert(d2i_X509(nullptr, &p, (long)encCert.size()));
+        ASSERT_TRUE(decoded_cert);
+        ASSERT_TRUE(X509_verify(decoded_cert.get(), pkey.get()));
+    }
+}
+
 TEST(TimeStringTests, toTimeStringTest) {
     // Two test vectors that need to result in UTCTime
     ASSERT_EQ(std::string(toTimeString(1622758591000)->data()), std::string("210603221631Z"));
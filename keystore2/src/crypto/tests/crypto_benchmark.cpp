@@ -0,0 +1,195 @@
+/*
+ * Copyright 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "crypto.hpp"
+#include "ec_key_pool.h"
+#include "password_key_deriver.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using keystore::EcKeyPool;
+using keystore::PasswordKeyDeriver;
+
+constexpr size_t kKeyLength = 32;
+constexpr size_t kIvLength = 12;
+constexpr size_t kTagLength = 16;
+
+// A set of super encrypted blobs of the given size, all under one key.
+struct Blobs {
+    Blobs(size_t count, size_t size)
+        : ciphertexts(count, std::vector<uint8_t>(size)), plaintexts(ciphertexts),
+          ivs(count), tags(count) {
+        randomBytes(key.data(), key.size());
+        for (size_t i = 0; i < count; ++i) {
+            randomBytes(ivs[i].data(), kIvLength);
+            randomBytes(plaintexts[i].data(), size);
+            AES_gcm_encrypt(plaintexts[i].data(), ciphertexts[i].data(), size, key.data(),
+                            key.size(), ivs[i].data(), tags[i].data());
+        }
+    }
+
+    std::array<uint8_t, kKeyLength> key;
+    std::vector<std::vector<uint8_t>> ciphertexts;
+    std::vector<std::vector<uint8_t>> plaintexts;
+    std::vector<std::array<uint8_t, kIvLength>> ivs;
+    std::vector<std::array<uint8_t, kTagLength>> tags;
+};
+
+static void BM_AesGcmEncrypt(benchmark::State& state) {
+    Blobs blobs(1, state.range(0));
+    for (auto _ : state) {
+        AES_gcm_encrypt(blobs.plaintexts[0].data(), blobs.ciphertexts[0].data(), state.range(0),
+                        blobs.key.data(), blobs.key.size(), blobs.ivs[0].data(),
+                        blobs.tags[0].data());
+        benchmark::DoNotOptimize(blobs.ciphertexts[0].data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_AesGcmEncrypt)->RangeMultiplier(4)->Range(64, 64 << 10);
+
+static void BM_AesGcmDecrypt(benchmark::State& state) {
+    Blobs blobs(1, state.range(0));
+    for (auto _ : state) {
+        if (!AES_gcm_decrypt(blobs.ciphertexts[0].data(), blobs.plaintexts[0].data(),
+                             state.range(0), blobs.key.data(), blobs.key.size(),
+                             blobs.ivs[0].data(), blobs.tags[0].data())) {
+            state.SkipWithError("AES_gcm_decrypt failed.");
+            return;
+        }
+        benchmark::DoNotOptimize(blobs.plaintexts[0].data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_AesGcmDecrypt)->RangeMultiplier(4)->Range(64, 64 << 10);
+
+// Decrypts range(0) blobs of range(1) bytes one at a time, like loading a set of super encrypted
+// key blobs does.
+static void BM_AesGcmDecryptLoop(benchmark::State& state) {
+    Blobs blobs(state.range(0), state.range(1));
+    for (auto _ : state) {
+        for (size_t i = 0; i < blobs.ciphertexts.size(); ++i) {
+            if (!AES_gcm_decrypt(blobs.ciphertexts[i].data(), blobs.plaintexts[i].data(),
+                                 state.range(1), blobs.key.data(), blobs.key.size(),
+                                 blobs.ivs[i].data(), blobs.tags[i].data())) {
+                state.SkipWithError("AES_gcm_decrypt failed.");
+                return;
+            }
+        }
+        benchmark::DoNotOptimize(blobs.plaintexts.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_AesGcmDecryptLoop)->Args({16, 256})->Args({64, 256})->Args({64, 4096});
+
+// Each benchmark thread is one user unlocking with its own password and a fresh salt, so every
+// iteration is a full derivation. The reported time is the unlock latency per user.
+static void BM_UnlockLatency(benchmark::State& state) {
+    static std::atomic<uint64_t> saltCounter = 0;
+    std::string pw = "password" + std::to_string(state.thread_index());
+    std::array<uint8_t, PasswordKeyDeriver::kSaltSize> salt = {};
+    std::array<uint8_t, kKeyLength> key;
+    for (auto _ : state) {
+        uint64_t counter = saltCounter++;
+        std::copy(reinterpret_cast<const uint8_t*>(&counter),
+                  reinterpret_cast<const uint8_t*>(&counter + 1), salt.begin());
+        auto start = std::chrono::steady_clock::now();
+        generateKeyFromPassword(key.data(), key.size(), pw.data(), pw.size(), salt.data());
+        benchmark::DoNotOptimize(key.data());
+        state.SetIterationTime(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+}
+BENCHMARK(BM_UnlockLatency)->ThreadRange(1, 8)->UseManualTime()->Unit(benchmark::kMillisecond);
+
+// Same as BM_UnlockLatency, but without the bounded worker pool.
+static void BM_UnlockLatencyUnbounded(benchmark::State& state) {
+    std::string pw = "password" + std::to_string(state.thread_index());
+    std::array<uint8_t, PasswordKeyDeriver::kSaltSize> salt = {};
+    std::array<uint8_t, kKeyLength> key;
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        PasswordKeyDeriver::deriveUncached(key.data(), key.size(), pw.data(), pw.size(),
+                                           salt.data());
+        benchmark::DoNotOptimize(key.data());
+        state.SetIterationTime(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+}
+BENCHMARK(BM_UnlockLatencyUnbounded)
+    ->ThreadRange(1, 8)
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Repeated unlocks with the same password and salt, served from the cache.
+static void BM_RepeatedUnlock(benchmark::State& state) {
+    std::string pw = "password";
+    std::array<uint8_t, PasswordKeyDeriver::kSaltSize> salt = {0xff};
+    std::array<uint8_t, kKeyLength> key;
+    for (auto _ : state) {
+        generateKeyFromPassword(key.data(), key.size(), pw.data(), pw.size(), salt.data());
+        benchmark::DoNotOptimize(key.data());
+    }
+}
+BENCHMARK(BM_RepeatedUnlock);
+
+// Takes ephemeral P-521 keys from a pool of depth range(0), the way super-encrypting a key does.
+// Requests are range(1) ms apart, which gives the pool time to refill; a depth of 0 generates
+// every key on the calling thread. Reports the p50 and p99 of the latency of taking a key. The
+// iteration count is fixed, as hits take almost no time and the gaps are not measured.
+static void BM_EcKeyGenerateLatency(benchmark::State& state) {
+    EcKeyPool pool(state.range(0), EcKeyPool::generateP521);
+    const auto gap = std::chrono::milliseconds(state.range(1));
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::this_thread::sleep_for(gap);
+        state.ResumeTiming();
+        auto start = std::chrono::steady_clock::now();
+        auto key = pool.take();
+        auto latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+        if (!key) {
+            state.SkipWithError("Failed to generate key.");
+            return;
+        }
+        latencies.push_back(latency.count());
+        state.SetIterationTime(latency.count());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentileUs = [&latencies](size_t p) {
+        return latencies[latencies.size() * p / 100] * 1e6;
+    };
+    state.counters["p50_us"] = percentileUs(50);
+    state.counters["p99_us"] = percentileUs(99);
+    state.counters["misses"] = pool.misses();
+}
+BENCHMARK(BM_EcKeyGenerateLatency)
+    ->Args({0, 5})
+    ->Args({EcKeyPool::kDefaultDepth, 5})
+    ->Args({8, 5})
+    ->Args({EcKeyPool::kDefaultDepth, 0})
+    ->Iterations(500)
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "password_key_deriver.h"
+
+#include <array>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace keystore;
+using namespace std::chrono_literals;
+
+using Salt = std::array<uint8_t, PasswordKeyDeriver::kSaltSize>;
+
+static Salt makeSalt(uint8_t seed) {
+    Salt salt;
+    for (size_t i = 0; i < salt.size(); ++i) {
+        salt[i] = seed + i;
+    }
+    return salt;
+}
+
+static std::vector<uint8_t> deriveUncached(const std::string& pw, const Salt& salt,
+                                           size_t keyLen) {
+    std::vector<uint8_t> key(keyLen);
+    PasswordKeyDeriver::deriveUncached(key.data(), key.size(), pw.data(), pw.size(), salt.data());
+    return key;
+}
+
+TEST(PasswordKeyDeriverTest, MatchesUncachedDerivation) {
+    PasswordKeyDeriver deriver(2, 10s);
+    std::string pw = "correct horse battery staple";
+    auto salt = makeSalt(1);
+    for (size_t keyLen : {16, 32}) {
+        std::vector<uint8_t> key(keyLen);
+        deriver.derive(key.data(), key.size(), pw.data(), pw.size(), salt.data());
+        ASSERT_EQ(key, deriveUncached(pw, salt, keyLen));
+    }
+    // The two key lengths use different digests, so they must not share a cache entry.
+    ASSERT_EQ(deriver.misses(), 2u);
+}
+
+TEST(PasswordKeyDeriverTest, RepeatedDerivationHitsCache) {
+    PasswordKeyDeriver deriver(2, 10s);
+    std::string pw = "1234";
+    auto salt = makeSalt(2);
+    std::vector<uint8_t> first(32);
+    std::vector<uint8_t> second(32);
+    deriver.derive(first.data(), first.size(), pw.data(), pw.size(), salt.data());
+    deriver.derive(second.data(), second.size(), pw.data(), pw.size(), salt.data());
+    ASSERT_EQ(first, second);
+    ASSERT_EQ(deriver.misses(), 1u);
+    ASSERT_EQ(deriver.hits(), 1u);
+
+    // A different password or salt must not hit.
+    std::string otherPw = "1235";
+    deriver.derive(second.data(), second.size(), otherPw.data(), otherPw.size(), salt.data());
+    ASSERT_EQ(second, deriveUncached(otherPw, salt, 32));
+    auto otherSalt = makeSalt(3);
+    deriver.derive(second.data(), second.size(), pw.data(), pw.size(), otherSalt.data());
+    ASSERT_EQ(second, deriveUncached(pw, otherSalt, 32));
+    ASSERT_EQ(deriver.misses(), 3u);
+}
+
+TEST(PasswordKeyDeriverTest, ClearAndExpiry) {
+    PasswordKeyDeriver deriver(1, 100ms);
+    std::string pw = "1234";
+    auto salt = makeSalt(4);
+    std::vector<uint8_t> key(32);
+    deriver.derive(key.data(), key.size(), pw.data(), pw.size(), salt.data());
+    deriver.clear();
+    deriver.derive(key.data(), key.size(), pw.data(), pw.size(), salt.data());
+    ASSERT_EQ(deriver.misses(), 2u);
+
+    std::this_thread::sleep_for(200ms);
+    deriver.derive(key.data(), key.size(), pw.data(), pw.size(), salt.data());
+    ASSERT_EQ(deriver.misses(), 3u);
+    ASSERT_EQ(key, deriveUncached(pw, salt, 32));
+}
+
+TEST(PasswordKeyDeriverTest, DeriveAll) {
+    constexpr size_t kUsers = 8;
+    PasswordKeyDeriver deriver(4, 10s);
+    std::vector<std::string> passwords;
+    std::vector<Salt> salts;
+    std::vector<std::vector<uint8_t>> keys(kUsers + 1, std::vector<uint8_t>(32));
+    std::vector<PasswordKeyDeriver::Request> requests;
+    for (size_t i = 0; i < kUsers; ++i) {
+        passwords.push_back("password" + std::to_string(i));
+        salts.push_back(makeSalt(i * 16));
+    }
+    for (size_t i = 0; i < kUsers; ++i) {
+        requests.push_back({.key = keys[i].data(),
+                            .keyLen = keys[i].size(),
+                            .pw = passwords[i].data(),
+                            .pwLen = passwords[i].size(),
+                            .salt = salts[i].data()});
+    }
+    // A duplicate request shares the derivation of the first one.
+    requests.push_back({.key = keys[kUsers].data(),
+                        .keyLen = keys[kUsers].size(),
+                        .pw = passwords[0].data(),
+                        .pwLen = passwords[0].size(),
+                        .salt = salts[0].data()});
+
+    deriver.deriveAll(requests.data(), requests.size());
+    for (size_t i = 0; i < kUsers; ++i) {
+        ASSERT_EQ(keys[i], deriveUncached(passwords[i], salts[i], 32));
+    }
+    ASSERT_EQ(keys[kUsers], keys[0]);
+    ASSERT_EQ(deriver.misses(), kUsers);
+    ASSERT_EQ(deriver.hits(), 1u);
+}
+
+TEST(PasswordKeyDeriverTest, ExpiredKeysAreErased) {
+    PasswordKeyDeriver deriver(1, 100ms);
+    std::string pw = "1234";
+    auto salt = makeSalt(5);
+    std::vector<uint8_t> key(32);
+    deriver.derive(key.data(), key.size(), pw.data(), pw.size(), salt.data());
+    ASSERT_EQ(deriver.cachedKeys(), 1u);
+
+    // The key is erased without any further call to derive.
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (deriver.cachedKeys() != 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(10ms);
+    }
+    ASSERT_EQ(deriver.cachedKeys(), 0u);
+}
+
+TEST(PasswordKeyDeriverTest, WithoutWorkers) {
+    PasswordKeyDeriver deriver(0, 10s);
+    std::string pw = "1234";
+    auto salt = makeSalt(6);
+    std::vector<uint8_t> key(32);
+    deriver.derive(key.data(), key.size(), pw.data(), pw.size(), salt.data());
+    ASSERT_EQ(key, deriveUncached(pw, salt, 32));
+
+    // Nothing would erase the key when it expires, so it is not cached.
+    ASSERT_EQ(deriver.cachedKeys(), 0u);
+    deriver.derive(key.data(), key.size(), pw.data(), pw.size(), salt.data());
+    ASSERT_EQ(deriver.misses(), 2u);
+}
@@ -18,11 +18,26 @@ use crate::ks_err;
 use anyhow::{Context, Result};
 use keystore2_crypto::{
     aes_gcm_decrypt, aes_gcm_encrypt, ec_key_generate_key, ec_key_get0_public_key,
-    ec_key_marshal_private_key, ec_key_parse_private_key, ec_point_oct_to_point,
-    ec_point_point_to_oct, ecdh_compute_key, generate_salt, hkdf_expand, hkdf_extract, ECKey, ZVec,
-    AES_256_KEY_LENGTH,
+    ec_key_marshal_private_key, ec_key_parse_private_key, ec_key_set_pool_depth,
+    ec_point_oct_to_point, ec_point_point_to_oct, ecdh_compute_key, generate_salt, hkdf_expand,
+    hkdf_extract, ECKey, ZVec, AES_256_KEY_LENGTH,
 };
 
+/// System property overriding the number of ephemeral keys generated ahead of time.
+const KEY_POOL_DEPTH_PROPERTY: &str = "keystore.ec_key_pool_depth";
+
+/// Applies KEY_POOL_DEPTH_PROPERTY, if set, to the pool behind ECDHPrivateKey::generate.
+pub fn configure_key_pool() {
+    match rustutils::system_properties::read(KEY_POOL_DEPTH_PROPERTY) {
+        Ok(Some(value)) => match value.parse::<usize>() {
+            Ok(depth) => ec_key_set_pool_depth(depth),
+            Err(e) => log::error!("Invalid {}: {:?}: {:?}", KEY_POOL_DEPTH_PROPERTY, value, e),
+        },
+        Ok(None) => {}
+        Err(e) => log::error!("Failed to read {}: {:?}", KEY_POOL_DEPTH_PROPERTY, e),
+    }
+}
+
 /// Private key for ECDH encryption.
 pub struct ECDHPrivateKey(ECKey);
 
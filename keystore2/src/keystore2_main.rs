@@ -92,6 +92,7 @@ fn main() {
     ENFORCEMENTS.install_confirmation_token_receiver(confirmation_token_receiver);
 
     entropy::register_feeder();
+    keystore2::ec_crypto::configure_key_pool();
     shared_secret_negotiation::perform_shared_secret_negotiation();
 
     info!("Starting thread pool now.");
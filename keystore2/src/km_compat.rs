@@ -30,7 +30,8 @@ use android_hardware_security_keymint::aidl::android::hardware::security::keymin
 };
 use android_security_compat::aidl::android::security::compat::IKeystoreCompatService::IKeystoreCompatService;
 use anyhow::Context;
-use keystore2_crypto::{hmac_sha256, HMAC_SHA256_LEN};
+use keystore2_crypto::{HmacSha256Context, HMAC_SHA256_LEN};
+use lazy_static::lazy_static;
 
 /// Key data associated with key generation/import.
 #[derive(Debug, PartialEq, Eq)]
@@ -74,6 +75,17 @@ pub trait EmulationDetector: Send + Sync {
 const KEYBLOB_PREFIX: &[u8] = b"SoftKeyMintForV1Blob";
 const KEYBLOB_HMAC_KEY: &[u8] = b"SoftKeyMintForV1HMACKey";
 
+lazy_static! {
+    /// Keyed once, as every wrapped keyblob is tagged and checked under the same key.
+    static ref KEYBLOB_HMAC: Result<HmacSha256Context, keystore2_crypto::Error> =
+        HmacSha256Context::new(KEYBLOB_HMAC_KEY);
+}
+
+/// Calculate the HMAC-SHA256 tag of `keyblob` using [`KEYBLOB_HMAC_KEY`].
+fn keyblob_hmac(keyblob: &[u8]) -> Result<Vec<u8>, keystore2_crypto::Error> {
+    KEYBLOB_HMAC.as_ref().map_err(|_| keystore2_crypto::Error::HmacSha256Failed)?.sign(keyblob)
+}
+
 /// Wrap the provided keyblob:
 /// - prefix it with an identifier specific to this wrapper
 /// - suffix it with an HMAC tag, using the [`KEYBLOB_HMAC_KEY`] and `keyblob`.
@@ -81,8 +93,7 @@ fn wrap_keyblob(keyblob: &[u8]) -> anyhow::Result<Vec<u8>> {
     let mut result = Vec::with_capacity(KEYBLOB_PREFIX.len() + keyblob.len() + HMAC_SHA256_LEN);
     result.extend_from_slice(KEYBLOB_PREFIX);
     result.extend_from_slice(keyblob);
-    let tag = hmac_sha256(KEYBLOB_HMAC_KEY, keyblob)
-        .context(ks_err!("failed to calculate HMAC-SHA256"))?;
+    let tag = keyblob_hmac(keyblob).context(ks_err!("failed to calculate HMAC-SHA256"))?;
     result.extend_from_slice(&tag);
     Ok(result)
 }
@@ -98,7 +109,7 @@ fn unwrap_keyblob(keyblob: &[u8]) -> KeyBlob {
         return KeyBlob::Raw(keyblob);
     }
     let (inner_keyblob, want_tag) = without_prefix.split_at(without_prefix.len() - HMAC_SHA256_LEN);
-    let got_tag = match hmac_sha256(KEYBLOB_HMAC_KEY, inner_keyblob) {
+    let got_tag = match keyblob_hmac(inner_keyblob) {
         Ok(tag) => tag,
         Err(e) => {
             log::error!("Error calculating HMAC-SHA256 for keyblob unwrap: {:?}", e);
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "km_compat.h"
+
+using ::aidl::android::hardware::security::keymint::SecurityLevel;
+
+static std::vector<KeyCharacteristics> makeCharacteristics(SecurityLevel securityLevel) {
+    return {KeyCharacteristics{securityLevel, {}}};
+}
+
+TEST(KeyCharacteristicsCacheTest, HitsAndMisses) {
+    KeyCharacteristicsCache cache(4);
+    std::vector<uint8_t> blob = {1, 2, 3};
+    std::vector<uint8_t> appId = {4};
+    std::vector<uint8_t> appData = {5};
+
+    ASSERT_FALSE(cache.get(blob, appId, appData));
+    cache.put(blob, appId, appData, makeCharacteristics(SecurityLevel::TRUSTED_ENVIRONMENT),
+              cache.generation());
+    auto cached = cache.get(blob, appId, appData);
+    ASSERT_TRUE(cached);
+    ASSERT_EQ(cached->size(), 1u);
+    ASSERT_EQ((*cached)[0].securityLevel, SecurityLevel::TRUSTED_ENVIRONMENT);
+
+    // Application id and data are part of the key, including where one ends and the other begins.
+    ASSERT_FALSE(cache.get(blob, {}, appData));
+    ASSERT_FALSE(cache.get(blob, {4, 5}, {}));
+
+    ASSERT_EQ(cache.hits(), 1u);
+    ASSERT_EQ(cache.misses(), 3u);
+}
+
+TEST(KeyCharacteristicsCacheTest, EvictsLeastRecentlyUsed) {
+    KeyCharacteristicsCache cache(2);
+    std::vector<uint8_t> blob1 = {1};
+    std::vector<uint8_t> blob2 = {2};
+    std::vector<uint8_t> blob3 = {3};
+
+    cache.put(blob1, {}, {}, makeCharacteristics(SecurityLevel::TRUSTED_ENVIRONMENT),
+              cache.generation());
+    cache.put(blob2, {}, {}, makeCharacteristics(SecurityLevel::TRUSTED_ENVIRONMENT),
+              cache.generation());
+    // Touch blob1 so that blob2 becomes the least recently used entry.
+    ASSERT_TRUE(cache.get(blob1, {}, {}));
+    cache.put(blob3, {}, {}, makeCharacteristics(SecurityLevel::TRUSTED_ENVIRONMENT),
+              cache.generation());
+
+    ASSERT_TRUE(cache.get(blob1, {}, {}));
+    ASSERT_FALSE(cache.get(blob2, {}, {}));
+    ASSERT_TRUE(cache.get(blob3, {}, {}));
+}
+
+TEST(KeyCharacteristicsCacheTest, Invalidation) {
+    KeyCharacteristicsCache cache(4);
+    std::vector<uint8_t> blob1 = {1};
+    std::vector<uint8_t> blob2 = {2};
+
+    cache.put(blob1, {}, {}, makeCharacteristics(SecurityLevel::TRUSTED_ENVIRONMENT),
+              cache.generation());
+    cache.put(blob1, {7}, {}, makeCharacteristics(SecurityLevel::TRUSTED_ENVIRONMENT),
+              cache.generation());
+    cache.put(blob2, {}, {}, makeCharacteristics(SecurityLevel::TRUSTED_ENVIRONMENT),
+              cache.generation());
+
+    // Invalidating a blob drops it for every application id and data.
+    cache.invalidate(blob1);
+    ASSERT_FALSE(cache.get(blob1, {}, {}));
+    ASSERT_FALSE(cache.get(blob1, {7}, {}));
+    ASSERT_TRUE(cache.get(blob2, {}, {}));
+
+    cache.clear();
+    ASSERT_FALSE(cache.get(blob2, {}, {}));
+}
+
+TEST(KeyCharacteristicsCacheTest, StalePutAfterInvalidationIsDropped) {
+    KeyCharacteristicsCache cache(4);
+    std::vector<uint8_t> blob = {1};
+
+    // A lookup misses and asks the device, while the blob is deleted concurrently.
+    ASSERT_FALSE(cache.get(blob, {}, {}));
+    auto generation = cache.generation();
+    cache.invalidate(blob);
+    cache.put(blob, {}, {}, makeCharacteristics(SecurityLevel::TRUSTED_ENVIRONMENT), generation);
+    ASSERT_FALSE(cache.get(blob, {}, {}));
+
+    generation = cache.generation();
+    cache.clear();
+    cache.put(blob, {}, {}, makeCharacteristics(SecurityLevel::TRUSTED_ENVIRONMENT), generation);
+    ASSERT_FALSE(cache.get(blob, {}, {}));
+}
@@ -25,6 +25,8 @@
 #include <aidl/android/hardware/security/keymint/PaddingMode.h>
 #include <aidl/android/system/keystore2/ResponseCode.h>
 #include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <android-base/scopeguard.h>
 #include <android/hidl/manager/1.2/IServiceManager.h>
 #include <binder/IServiceManager.h>
 #include <hardware/keymaster_defs.h>
@@ -33,6 +35,8 @@
 #include <keymasterV4_1/Keymaster4.h>
 
 #include <chrono>
+#include <map>
+#include <tuple>
 
 #include "certificate_utils.h"
 
@@ -386,15 +390,60 @@ convertSharedSecretParametersToLegacy(const std::vector<SharedSecretParameters>&
 }
 
 void OperationSlotManager::setNumFreeSlots(uint8_t numFreeSlots) {
-    std::lock_guard<std::mutex> lock(mNumFreeSlotsMutex);
-    mNumFreeSlots = numFreeSlots;
+    mNumFreeSlots.store(numFreeSlots);
+    notifyWaiters(true /* all */);
+}
+
+bool OperationSlotManager::tryClaimSlot() {
+    uint8_t numFreeSlots = mNumFreeSlots.load(std::memory_order_relaxed);
+    do {
+        if (numFreeSlots == 0) {
+            return false;
+        }
+    } while (!mNumFreeSlots.compare_exchange_weak(numFreeSlots,
+                                                  static_cast<uint8_t>(numFreeSlots - 1)));
+    return true;
+}
+
+void OperationSlotManager::notifyWaiters(bool all) {
+    // Waiters register themselves before checking for a free slot, so if nobody is
+    // registered here, any future waiter is guaranteed to observe the slot we just freed.
+    if (mNumWaiters.load() == 0) {
+        return;
+    }
+    // Taking the mutex orders the notification after a concurrent waiter has either
+    // observed the free slot or started waiting on the condition variable.
+    std::lock_guard<std::mutex> lock(mWaitMutex);
+    if (all) {
+        mSlotFreed.notify_all();
+    } else {
+        mSlotFreed.notify_one();
+    }
 }
 
 std::optional<OperationSlot>
 OperationSlotManager::claimSlot(std::shared_ptr<OperationSlotManager> operationSlots) {
-    std::lock_guard<std::mutex> lock(operationSlots->mNumFreeSlotsMutex);
-    if (operationSlots->mNumFreeSlots > 0) {
-        operationSlots->mNumFreeSlots--;
+    if (operationSlots->tryClaimSlot()) {
+        return OperationSlot(std::move(operationSlots), std::nullopt);
+    }
+    return std::nullopt;
+}
+
+std::optional<OperationSlot>
+OperationSlotManager::claimSlot(std::shared_ptr<OperationSlotManager> operationSlots,
+                                std::chrono::steady_clock::time_point deadline) {
+    if (operationSlots->tryClaimSlot()) {
+        return OperationSlot(std::move(operationSlots), std::nullopt);
+    }
+    operationSlots->mNumWaiters++;
+    bool claimed;
+    {
+        std::unique_lock<std::mutex> lock(operationSlots->mWaitMutex);
+        claimed = operationSlots->mSlotFreed.wait_until(
+            lock, deadline, [&] { return operationSlots->tryClaimSlot(); });
+    }
+    operationSlots->mNumWaiters--;
+    if (claimed) {
         return OperationSlot(std::move(operationSlots), std::nullopt);
     }
     return std::nullopt;
@@ -411,8 +460,8 @@ OperationSlot::OperationSlot(std::shared_ptr<OperationSlotManager> slots,
     : mOperationSlots(std::move(slots)), mReservedGuard(std::move(reservedGuard)) {}
 
 void OperationSlotManager::freeSlot() {
-    std::lock_guard<std::mutex> lock(mNumFreeSlotsMutex);
     mNumFreeSlots++;
+    notifyWaiters(false /* all */);
 }
 
 OperationSlot::~OperationSlot() {
@@ -421,6 +470,106 @@ OperationSlot::~OperationSlot() {
     }
 }
 
+// KeyCharacteristicsCache implementation
+
+// Number of converted key characteristics kept per device.
+static const size_t kKeyCharacteristicsCacheSize = 64;
+
+size_t KeyCharacteristicsCache::DigestHash::operator()(const Digest& digest) const {
+    size_t result;
+    std::memcpy(&result, digest.data(), sizeof(result));
+    return result;
+}
+
+KeyCharacteristicsCache::Digest
+KeyCharacteristicsCache::blobDigest(const std::vector<uint8_t>& prefixedKeyBlob) {
+    Digest digest;
+    SHA256(prefixedKeyBlob.data(), prefixedKeyBlob.size(), digest.data());
+    return digest;
+}
+
+KeyCharacteristicsCache::Digest
+KeyCharacteristicsCache::entryKey(const Digest& blobDigest, const std::vector<uint8_t>& appId,
+                                  const std::vector<uint8_t>& appData) {
+    // The lengths are hashed as well, so that moving bytes between the application id and the
+    // application data yields a different key.
+    uint64_t appIdSize = appId.size();
+    uint64_t appDataSize = appData.size();
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, blobDigest.data(), blobDigest.size());
+    SHA256_Update(&ctx, &appIdSize, sizeof(appIdSize));
+    SHA256_Update(&ctx, appId.data(), appId.size());
+    SHA256_Update(&ctx, &appDataSize, sizeof(appDataSize));
+    SHA256_Update(&ctx, appData.data(), appData.size());
+    Digest digest;
+    SHA256_Final(digest.data(), &ctx);
+    return digest;
+}
+
+std::optional<std::vector<KeyCharacteristics>>
+KeyCharacteristicsCache::get(const std::vector<uint8_t>& prefixedKeyBlob,
+                             const std::vector<uint8_t>& appId,
+                             const std::vector<uint8_t>& appData) {
+    auto key = entryKey(blobDigest(prefixedKeyBlob), appId, appData);
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto i = mIndex.find(key);
+    if (i == mIndex.end()) {
+        mMisses++;
+        return std::nullopt;
+    }
+    mHits++;
+    mEntries.splice(mEntries.begin(), mEntries, i->second);
+    return i->second->characteristics;
+}
+
+void KeyCharacteristicsCache::put(const std::vector<uint8_t>& prefixedKeyBlob,
+                                  const std::vector<uint8_t>& appId,
+                                  const std::vector<uint8_t>& appData,
+                                  std::vector<KeyCharacteristics> characteristics,
+                                  uint64_t generation) {
+    if (mCapacity == 0) return;
+    auto blob = blobDigest(prefixedKeyBlob);
+    auto key = entryKey(blob, appId, appData);
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mGeneration != generation) {
+        // The characteristics may belong to a blob that was invalidated in the meantime.
+        return;
+    }
+    if (auto i = mIndex.find(key); i != mIndex.end()) {
+        i->second->characteristics = std::move(characteristics);
+        mEntries.splice(mEntries.begin(), mEntries, i->second);
+        return;
+    }
+    if (mEntries.size() >= mCapacity) {
+        mIndex.erase(mEntries.back().key);
+        mEntries.pop_back();
+    }
+    mEntries.push_front({key, blob, std::move(characteristics)});
+    mIndex.emplace(key, mEntries.begin());
+}
+
+void KeyCharacteristicsCache::invalidate(const std::vector<uint8_t>& prefixedKeyBlob) {
+    auto blob = blobDigest(prefixedKeyBlob);
+    std::lock_guard<std::mutex> lock(mMutex);
+    mGeneration++;
+    for (auto i = mEntries.begin(); i != mEntries.end();) {
+        if (i->blobDigest == blob) {
+            mIndex.erase(i->key);
+            i = mEntries.erase(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void KeyCharacteristicsCache::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mGeneration++;
+    mIndex.clear();
+    mEntries.clear();
+}
+
 // KeyMintDevice implementation
 
 ScopedAStatus KeyMintDevice::getHardwareInfo(KeyMintHardwareInfo* _aidl_return) {
@@ -610,6 +759,11 @@ ScopedAStatus KeyMintDevice::upgradeKey(const std::vector<uint8_t>& in_inKeyBlob
     auto legacyUpgradeParams = convertKeyParametersToLegacy(in_inUpgradeParams);
     V4_0_ErrorCode errorCode;
 
+    // The old blob becomes stale. Invalidating once the device is done makes sure that
+    // characteristics cached by a concurrent getKeyCharacteristics() don't survive.
+    auto invalidateCache = android::base::make_scope_guard(
+        [&] { mKeyCharacteristicsCache.invalidate(in_inKeyBlobToUpgrade); });
+
     if (prefixedKeyBlobIsSoftKeyMint(in_inKeyBlobToUpgrade)) {
         auto status = softKeyMintDevice_->upgradeKey(
             prefixedKeyBlobRemovePrefix(in_inKeyBlobToUpgrade), in_inUpgradeParams, _aidl_return);
@@ -635,6 +789,10 @@ ScopedAStatus KeyMintDevice::upgradeKey(const std::vector<uint8_t>& in_inKeyBlob
 }
 
 ScopedAStatus KeyMintDevice::deleteKey(const std::vector<uint8_t>& prefixedKeyBlob) {
+    // See upgradeKey().
+    auto invalidateCache = android::base::make_scope_guard(
+        [&] { mKeyCharacteristicsCache.invalidate(prefixedKeyBlob); });
+
     const std::vector<uint8_t>& keyBlob = prefixedKeyBlobRemovePrefix(prefixedKeyBlob);
     if (prefixedKeyBlobIsSoftKeyMint(prefixedKeyBlob)) {
         return softKeyMintDevice_->deleteKey(keyBlob);
@@ -649,6 +807,9 @@ ScopedAStatus KeyMintDevice::deleteKey(const std::vector<uint8_t>& prefixedKeyBl
 }
 
 ScopedAStatus KeyMintDevice::deleteAllKeys() {
+    // See upgradeKey().
+    auto clearCache = android::base::make_scope_guard([&] { mKeyCharacteristicsCache.clear(); });
+
     auto result = mDevice->deleteAllKeys();
     if (!result.isOk()) {
         LOG(ERROR) << __func__ << " transaction failed. " << result.description();
@@ -691,7 +852,12 @@ ScopedAStatus KeyMintDevice::beginInternal(KeyPurpose in_inPurpose,
         // the reserved slot becomes available.
         slot = OperationSlotManager::claimReservedSlot(mOperationSlots);
     } else {
-        if (auto opt_slot = OperationSlotManager::claimSlot(mOperationSlots)) {
+        auto opt_slot =
+            mSlotWaitTimeout.count() > 0
+                ? OperationSlotManager::claimSlot(
+                      mOperationSlots, std::chrono::steady_clock::now() + mSlotWaitTimeout)
+                : OperationSlotManager::claimSlot(mOperationSlots);
+        if (opt_slot) {
             slot = std::move(*opt_slot);
         } else {
             return convertErrorCode(V4_0_ErrorCode::TOO_MANY_OPERATIONS);
@@ -793,6 +959,12 @@ ScopedAStatus KeyMintDevice::getKeyCharacteristics(
         return softKeyMintDevice_->getKeyCharacteristics(strippedKeyBlob, appId, appData,
                                                          keyCharacteristics);
     } else {
+        if (auto cached = mKeyCharacteristicsCache.get(prefixedKeyBlob, appId, appData)) {
+            *keyCharacteristics = std::move(*cached);
+            return ScopedAStatus::ok();
+        }
+
+        auto cacheGeneration = mKeyCharacteristicsCache.generation();
         KMV1::ErrorCode km_error;
         auto ret = mDevice->getKeyCharacteristics(
             strippedKeyBlob, appId, appData,
@@ -810,6 +982,9 @@ ScopedAStatus KeyMintDevice::getKeyCharacteristics(
         if (km_error != KMV1::ErrorCode::OK) {
             LOG(ERROR) << __func__
                        << " getKeyCharacteristics failed with code: " << toString(km_error);
+        } else {
+            mKeyCharacteristicsCache.put(prefixedKeyBlob, appId, appData, *keyCharacteristics,
+                                         cacheGeneration);
         }
 
         return convertErrorCode(km_error);
@@ -868,6 +1043,14 @@ KeyMintOperation::getExtendedUpdateBuffer(const std::vector<uint8_t>& suffix) {
     }
 }
 
+// Returns a hidl_vec that refers to the given range without copying it. The returned
+// vector must not outlive the underlying buffer.
+static hidl_vec<uint8_t> makeHidlVecView(const uint8_t* data, size_t size) {
+    hidl_vec<uint8_t> view;
+    view.setToExternal(const_cast<uint8_t*>(data), size, false /* shouldOwn */);
+    return view;
+}
+
 ScopedAStatus KeyMintOperation::update(const std::vector<uint8_t>& input_raw,
                                        const std::optional<HardwareAuthToken>& optAuthToken,
                                        const std::optional<TimeStampToken>& optTimeStampToken,
@@ -878,19 +1061,32 @@ ScopedAStatus KeyMintOperation::update(const std::vector<uint8_t>& input_raw,
     size_t inputPos = 0;
     *out_output = {};
     KMV1::ErrorCode errorCode = KMV1::ErrorCode::OK;
-    auto input = getExtendedUpdateBuffer(input_raw);
+    const auto& input = getExtendedUpdateBuffer(input_raw);
 
+    // Legacy HALs may consume less input than offered per call. Once we know how much the HAL
+    // is willing to take, we only send slices of that size instead of the entire remainder,
+    // which would be marshaled again on every iteration.
+    size_t chunkLimit = 0;
+    bool outputReserved = false;
     while (inputPos < input.size() && errorCode == KMV1::ErrorCode::OK) {
         uint32_t consumed = 0;
-        auto result =
-            mDevice->update(mOperationHandle, {} /* inParams */,
-                            {input.begin() + inputPos, input.end()}, authToken, verificationToken,
-                            [&](V4_0_ErrorCode error, uint32_t inputConsumed, auto /* outParams */,
-                                const hidl_vec<uint8_t>& output) {
-                                errorCode = convert(error);
-                                out_output->insert(out_output->end(), output.begin(), output.end());
-                                consumed = inputConsumed;
-                            });
+        size_t remaining = input.size() - inputPos;
+        size_t chunkSize = chunkLimit == 0 ? remaining : std::min(chunkLimit, remaining);
+        auto result = mDevice->update(
+            mOperationHandle, {} /* inParams */,
+            makeHidlVecView(input.data() + inputPos, chunkSize), authToken, verificationToken,
+            [&](V4_0_ErrorCode error, uint32_t inputConsumed, auto /* outParams */,
+                const hidl_vec<uint8_t>& output) {
+                errorCode = convert(error);
+                if (output.size() > 0 && !outputReserved) {
+                    // Ciphers produce roughly as much output as they get input, so make room
+                    // for all of it at once.
+                    out_output->reserve(remaining + output.size());
+                    outputReserved = true;
+                }
+                out_output->insert(out_output->end(), output.begin(), output.end());
+                consumed = inputConsumed;
+            });
 
         if (!result.isOk()) {
             LOG(ERROR) << __func__ << " transaction failed. " << result.description();
@@ -898,6 +1094,12 @@ ScopedAStatus KeyMintOperation::update(const std::vector<uint8_t>& input_raw,
         }
 
         if (errorCode == KMV1::ErrorCode::OK && consumed == 0) {
+            if (chunkSize < remaining) {
+                // The slice may have been too short for the HAL to make progress. Offer the
+                // entire remainder before concluding that it needs more input.
+                chunkLimit = 0;
+                continue;
+            }
             // Some very old KM implementations do not buffer sub blocks in certain block modes,
             // instead, the simply return consumed == 0. So we buffer the input here in the
             // hope that we complete the bock in a future call to update.
@@ -905,7 +1107,10 @@ ScopedAStatus KeyMintOperation::update(const std::vector<uint8_t>& input_raw,
             return convertErrorCode(errorCode);
         }
         inputPos += consumed;
+        chunkLimit = std::max(chunkLimit, static_cast<size_t>(consumed));
     }
+    // All buffered input has been passed on to the HAL.
+    mUpdateBuffer.clear();
 
     // Operation slot is no longer occupied.
     if (errorCode != KMV1::ErrorCode::OK) {
@@ -922,9 +1127,9 @@ KeyMintOperation::finish(const std::optional<std::vector<uint8_t>>& in_input,
                          const std::optional<TimeStampToken>& in_timeStampToken,
                          const std::optional<std::vector<uint8_t>>& in_confirmationToken,
                          std::vector<uint8_t>* out_output) {
-    auto input_raw = in_input.value_or(std::vector<uint8_t>());
-    auto input = getExtendedUpdateBuffer(input_raw);
-    auto signature = in_signature.value_or(std::vector<uint8_t>());
+    static const std::vector<uint8_t> empty_vector;
+    const auto& input = getExtendedUpdateBuffer(in_input ? *in_input : empty_vector);
+    const auto& signature = in_signature ? *in_signature : empty_vector;
     V4_0_HardwareAuthToken authToken = convertAuthTokenToLegacy(in_authToken);
     V4_0_VerificationToken verificationToken = convertTimestampTokenToLegacy(in_timeStampToken);
 
@@ -935,11 +1140,13 @@ KeyMintOperation::finish(const std::optional<std::vector<uint8_t>>& in_input,
 
     KMV1::ErrorCode errorCode;
     auto result = mDevice->finish(
-        mOperationHandle, inParams, input, signature, authToken, verificationToken,
+        mOperationHandle, inParams, makeHidlVecView(input.data(), input.size()),
+        makeHidlVecView(signature.data(), signature.size()), authToken, verificationToken,
         [&](V4_0_ErrorCode error, auto /* outParams */, const hidl_vec<uint8_t>& output) {
             errorCode = convert(error);
             *out_output = output;
         });
+    mUpdateBuffer.clear();
 
     if (!result.isOk()) {
         LOG(ERROR) << __func__ << " transaction failed. " << result.description();
@@ -1067,10 +1274,52 @@ getMaximum(const std::vector<KeyParameter>& keyParams, T tag,
     return *bestSoFar;
 }
 
+// Prepares the self signed certificate from the key parameters alone, i.e., everything but the
+// public key and the signature.
+static std::variant<keystore::X509_Ptr, KMV1::ErrorCode>
+makeCertRump(const std::vector<KeyParameter>& keyParams) {
+    std::optional<std::reference_wrapper<const std::vector<uint8_t>>> subject;
+    if (auto blob = getParam(keyParams, KMV1::TAG_CERTIFICATE_SUBJECT)) {
+        subject = *blob;
+    }
+
+    std::optional<std::reference_wrapper<const std::vector<uint8_t>>> serial;
+    if (auto blob = getParam(keyParams, KMV1::TAG_CERTIFICATE_SERIAL)) {
+        serial = *blob;
+    }
+
+    int64_t activation;
+    if (auto date = getParam(keyParams, KMV1::TAG_CERTIFICATE_NOT_BEFORE)) {
+        activation = static_cast<int64_t>(*date);
+    } else {
+        return KMV1::ErrorCode::MISSING_NOT_BEFORE;
+    }
+
+    int64_t expiration;
+    if (auto date = getParam(keyParams, KMV1::TAG_CERTIFICATE_NOT_AFTER)) {
+        expiration = static_cast<int64_t>(*date);
+    } else {
+        return KMV1::ErrorCode::MISSING_NOT_AFTER;
+    }
+
+    auto certOrError = keystore::makeCertRump(serial, subject, activation, expiration);
+    if (std::holds_alternative<keystore::CertUtilsError>(certOrError)) {
+        LOG(ERROR) << __func__ << ": Failed to make certificate";
+        return KMV1::ErrorCode::UNKNOWN_ERROR;
+    }
+    auto cert = std::move(std::get<keystore::X509_Ptr>(certOrError));
+
+    // The certificate is self signed, so the issuer is the subject we just set.
+    if (keystore::setIssuer(&*cert, &*cert, false)) {
+        LOG(ERROR) << __func__ << ": Set issuer failed.";
+        return KMV1::ErrorCode::UNKNOWN_ERROR;
+    }
+    return cert;
+}
+
 static std::variant<keystore::X509_Ptr, KMV1::ErrorCode>
 makeCert(::android::sp<Keymaster> mDevice, const std::vector<KeyParameter>& keyParams,
          const std::vector<uint8_t>& keyBlob) {
-    // Start generating the certificate.
     // Get public key for makeCert.
     KMV1::ErrorCode errorCode;
     std::vector<uint8_t> key;
@@ -1095,44 +1344,22 @@ makeCert(::android::sp<Keymaster> mDevice, const std::vector<KeyParameter>& keyP
     if (errorCode != KMV1::ErrorCode::OK) {
         return errorCode;
     }
-    // Get pkey for makeCert.
-    CBS cbs;
-    CBS_init(&cbs, key.data(), key.size());
-    auto pkey = EVP_parse_public_key(&cbs);
-
-    // makeCert
-    std::optional<std::reference_wrapper<const std::vector<uint8_t>>> subject;
-    if (auto blob = getParam(keyParams, KMV1::TAG_CERTIFICATE_SUBJECT)) {
-        subject = *blob;
-    }
-
-    std::optional<std::reference_wrapper<const std::vector<uint8_t>>> serial;
-    if (auto blob = getParam(keyParams, KMV1::TAG_CERTIFICATE_SERIAL)) {
-        serial = *blob;
-    }
-
-    int64_t activation;
-    if (auto date = getParam(keyParams, KMV1::TAG_CERTIFICATE_NOT_BEFORE)) {
-        activation = static_cast<int64_t>(*date);
-    } else {
-        return KMV1::ErrorCode::MISSING_NOT_BEFORE;
-    }
 
-    int64_t expiration;
-    if (auto date = getParam(keyParams, KMV1::TAG_CERTIFICATE_NOT_AFTER)) {
-        expiration = static_cast<int64_t>(*date);
-    } else {
-        return KMV1::ErrorCode::MISSING_NOT_AFTER;
+    auto certOrError = makeCertRump(keyParams);
+    if (std::holds_alternative<KMV1::ErrorCode>(certOrError)) {
+        return std::get<KMV1::ErrorCode>(certOrError);
     }
+    auto cert = std::move(std::get<keystore::X509_Ptr>(certOrError));
 
-    auto certOrError = keystore::makeCert(
-        pkey, serial, subject, activation, expiration, false /* intentionally left blank */,
-        std::nullopt /* intentionally left blank */, std::nullopt /* intentionally left blank */);
-    if (std::holds_alternative<keystore::CertUtilsError>(certOrError)) {
+    // Get pkey for makeCert.
+    CBS cbs;
+    CBS_init(&cbs, key.data(), key.size());
+    keystore::EVP_PKEY_Ptr pkey(EVP_parse_public_key(&cbs));
+    if (!pkey || !X509_set_pubkey(&*cert, pkey.get())) {
         LOG(ERROR) << __func__ << ": Failed to make certificate";
         return KMV1::ErrorCode::UNKNOWN_ERROR;
     }
-    return std::move(std::get<keystore::X509_Ptr>(certOrError));
+    return cert;
 }
 
 static std::variant<keystore::Algo, KMV1::ErrorCode> getKeystoreAlgorithm(Algorithm algorithm) {
@@ -1177,6 +1404,33 @@ static std::variant<keystore::Digest, KMV1::ErrorCode> getKeystoreDigest(Digest
     }
 }
 
+// The signature algorithm identifier only depends on the (algorithm, padding, digest) triplet, of
+// which there are few. So we build each one once and share it between all certificates.
+static std::variant<const X509_ALGOR*, KMV1::ErrorCode>
+getSignatureAlgorithm(keystore::Algo algo, keystore::Padding padding, keystore::Digest digest) {
+    static std::mutex mutex;
+    static std::map<std::tuple<keystore::Algo, keystore::Padding, keystore::Digest>,
+                    keystore::X509_ALGOR_Ptr>
+        algorithms;
+
+    if (algo == keystore::Algo::ECDSA) {
+        padding = keystore::Padding::Ignored;
+    }
+    auto key = std::make_tuple(algo, padding, digest);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = algorithms.find(key);
+    if (it == algorithms.end()) {
+        auto algorOrError = keystore::makeAlgo(algo, padding, digest);
+        if (std::holds_alternative<keystore::CertUtilsError>(algorOrError)) {
+            LOG(ERROR) << __func__ << ": makeAlgo failed.";
+            return KMV1::ErrorCode::UNKNOWN_ERROR;
+        }
+        it = algorithms.emplace(key, std::move(std::get<keystore::X509_ALGOR_Ptr>(algorOrError)))
+                 .first;
+    }
+    return it->second.get();
+}
+
 std::optional<KMV1::ErrorCode>
 KeyMintDevice::signCertificate(const std::vector<KeyParameter>& keyParams,
                                const std::vector<uint8_t>& prefixedKeyBlob, X509* cert) {
@@ -1202,6 +1456,10 @@ KeyMintDevice::signCertificate(const std::vector<KeyParameter>& keyParams,
         return std::get<KMV1::ErrorCode>(digestOrError);
     }
     auto digest = std::get<keystore::Digest>(digestOrError);
+    auto algorOrError = getSignatureAlgorithm(algo, padding, digest);
+    if (std::holds_alternative<KMV1::ErrorCode>(algorOrError)) {
+        return std::get<KMV1::ErrorCode>(algorOrError);
+    }
 
     KMV1::ErrorCode errorCode = KMV1::ErrorCode::OK;
     auto error = keystore::signCertWith(
@@ -1235,7 +1493,7 @@ KeyMintDevice::signCertificate(const std::vector<KeyParameter>& keyParams,
             }
             return result;
         },
-        algo, padding, digest);
+        std::get<const X509_ALGOR*>(algorOrError));
     if (error) {
         LOG(ERROR) << __func__
                    << ": signCertWith failed. (Callback diagnosed: " << toString(errorCode) << ")";
@@ -1298,13 +1556,6 @@ KeyMintDevice::getCertificate(const std::vector<KeyParameter>& keyParams,
     }
     auto cert = std::move(std::get<keystore::X509_Ptr>(certOrError));
 
-    // setIssuer
-    auto error = keystore::setIssuer(&*cert, &*cert, false);
-    if (error) {
-        LOG(ERROR) << __func__ << ": Set issuer failed.";
-        return KMV1::ErrorCode::UNKNOWN_ERROR;
-    }
-
     // Signing
     auto canSelfSign =
         std::find_if(keyParams.begin(), keyParams.end(), [&](const KeyParameter& kp) {
@@ -1324,7 +1575,7 @@ KeyMintDevice::getCertificate(const std::vector<KeyParameter>& keyParams,
         EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pkey_ctx.get(), NID_X9_62_prime256v1);
         EVP_PKEY* pkey_ptr = nullptr;
         EVP_PKEY_keygen(pkey_ctx.get(), &pkey_ptr);
-        error = keystore::signCert(&*cert, pkey_ptr);
+        auto error = keystore::signCert(&*cert, pkey_ptr);
         if (error) {
             LOG(ERROR) << __func__ << ": signCert failed.";
             return KMV1::ErrorCode::UNKNOWN_ERROR;
@@ -1459,7 +1710,9 @@ void KeyMintDevice::setNumFreeSlots(uint8_t numFreeSlots) {
 
 KeyMintDevice::KeyMintDevice(sp<Keymaster> device, KeyMintSecurityLevel securityLevel)
     : mDevice(device), mOperationSlots(std::make_shared<OperationSlotManager>()),
-      securityLevel_(securityLevel) {
+      mSlotWaitTimeout(
+          android::base::GetUintProperty<uint64_t>("keystore.km_compat.slot_wait_ms", 0)),
+      securityLevel_(securityLevel), mKeyCharacteristicsCache(kKeyCharacteristicsCacheSize) {
     if (securityLevel == KeyMintSecurityLevel::STRONGBOX) {
         setNumFreeSlots(3);
     } else {
@@ -23,6 +23,13 @@
 #include <aidl/android/hardware/security/sharedsecret/BnSharedSecret.h>
 #include <aidl/android/security/compat/BnKeystoreCompatService.h>
 #include <keymasterV4_1/Keymaster4.h>
+#include <openssl/sha.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <list>
 #include <unordered_map>
 #include <variant>
 
@@ -75,24 +82,92 @@ class OperationSlot {
     ~OperationSlot();
 };
 
+// Keeps track of the number of operation slots available on the legacy device.
+// Claiming and freeing regular slots is lock free. Callers that would rather wait for
+// a slot than fail immediately may use the deadline variant of claimSlot, which parks
+// them on a wait queue that is only signaled if someone is actually waiting.
 class OperationSlotManager {
   private:
-    uint8_t mNumFreeSlots;
-    std::mutex mNumFreeSlotsMutex;
+    std::atomic<uint8_t> mNumFreeSlots = 0;
+    std::atomic<uint32_t> mNumWaiters = 0;
+    // Only used to park callers of the deadline variant of claimSlot.
+    std::mutex mWaitMutex;
+    std::condition_variable mSlotFreed;
     std::mutex mReservedSlotMutex;
 
+    bool tryClaimSlot();
+    void notifyWaiters(bool all);
+
   public:
     void setNumFreeSlots(uint8_t numFreeSlots);
     static std::optional<OperationSlot>
     claimSlot(std::shared_ptr<OperationSlotManager> operationSlots);
+    // Like claimSlot, but blocks until a slot becomes available or the deadline expires.
+    static std::optional<OperationSlot>
+    claimSlot(std::shared_ptr<OperationSlotManager> operationSlots,
+              std::chrono::steady_clock::time_point deadline);
     static OperationSlot claimReservedSlot(std::shared_ptr<OperationSlotManager> operationSlots);
     void freeSlot();
 };
 
+// A bounded LRU cache of converted key characteristics. Entries are keyed by a digest of the
+// prefixed key blob, the application id and the application data, so that the cache never holds
+// on to key material itself.
+class KeyCharacteristicsCache {
+  public:
+    using Digest = std::array<uint8_t, SHA256_DIGEST_LENGTH>;
+
+    explicit KeyCharacteristicsCache(size_t capacity) : mCapacity(capacity) {}
+
+    std::optional<std::vector<KeyCharacteristics>> get(const std::vector<uint8_t>& prefixedKeyBlob,
+                                                       const std::vector<uint8_t>& appId,
+                                                       const std::vector<uint8_t>& appData);
+    // Returns a value that changes whenever entries are invalidated. Callers take it before
+    // asking the device for characteristics and pass it to put(), so that characteristics
+    // obtained before a concurrent invalidation are not cached after it.
+    uint64_t generation() const { return mGeneration; }
+    void put(const std::vector<uint8_t>& prefixedKeyBlob, const std::vector<uint8_t>& appId,
+             const std::vector<uint8_t>& appData, std::vector<KeyCharacteristics> characteristics,
+             uint64_t generation);
+    // Drops all entries for the given key blob regardless of application id and data.
+    void invalidate(const std::vector<uint8_t>& prefixedKeyBlob);
+    void clear();
+
+    uint64_t hits() const { return mHits; }
+    uint64_t misses() const { return mMisses; }
+
+  private:
+    struct Entry {
+        Digest key;
+        Digest blobDigest;
+        std::vector<KeyCharacteristics> characteristics;
+    };
+    struct DigestHash {
+        size_t operator()(const Digest& digest) const;
+    };
+
+    static Digest blobDigest(const std::vector<uint8_t>& prefixedKeyBlob);
+    static Digest entryKey(const Digest& blobDigest, const std::vector<uint8_t>& appId,
+                           const std::vector<uint8_t>& appData);
+
+    const size_t mCapacity;
+    std::mutex mMutex;
+    // Most recently used entries first.
+    std::list<Entry> mEntries;
+    std::unordered_map<Digest, std::list<Entry>::iterator, DigestHash> mIndex;
+    // Only changed with mMutex held, so put() can check it under the same lock.
+    std::atomic<uint64_t> mGeneration = 0;
+    std::atomic<uint64_t> mHits = 0;
+    std::atomic<uint64_t> mMisses = 0;
+};
+
 class KeyMintDevice : public aidl::android::hardware::security::keymint::BnKeyMintDevice {
   private:
     ::android::sp<Keymaster> mDevice;
     std::shared_ptr<OperationSlotManager> mOperationSlots;
+    // How long begin() waits for an operation slot before failing with TOO_MANY_OPERATIONS.
+    // Set from the keystore.km_compat.slot_wait_ms property, 0 fails right away.
+    const std::chrono::milliseconds mSlotWaitTimeout;
 
   public:
     explicit KeyMintDevice(::android::sp<Keymaster>, KeyMintSecurityLevel);
@@ -154,6 +229,10 @@ class KeyMintDevice : public aidl::android::hardware::security::keymint::BnKeyMi
 
     void setNumFreeSlots(uint8_t numFreeSlots);
 
+    const KeyCharacteristicsCache& keyCharacteristicsCache() const {
+        return mKeyCharacteristicsCache;
+    }
+
   private:
     std::optional<KMV1_ErrorCode> signCertificate(const std::vector<KeyParameter>& keyParams,
                                                   const std::vector<uint8_t>& keyBlob, X509* cert);
@@ -161,6 +240,9 @@ class KeyMintDevice : public aidl::android::hardware::security::keymint::BnKeyMi
 
     // Software-based KeyMint device used to implement ECDH.
     std::shared_ptr<IKeyMintDevice> softKeyMintDevice_;
+
+    // Characteristics of recently queried legacy key blobs.
+    KeyCharacteristicsCache mKeyCharacteristicsCache;
 };
 
 class KeyMintOperation : public aidl::android::hardware::security::keymint::BnKeyMintOperation {
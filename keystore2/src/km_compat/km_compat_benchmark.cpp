@@ -0,0 +1,236 @@
+/*
+ * Copyright 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "km_compat.h"
+#include "km_compat_type_conversion.h"
+#include <keymint_support/keymint_tags.h>
+
+#include <aidl/android/hardware/security/keymint/Algorithm.h>
+#include <aidl/android/hardware/security/keymint/BlockMode.h>
+#include <aidl/android/hardware/security/keymint/PaddingMode.h>
+
+using ::aidl::android::hardware::security::keymint::Algorithm;
+using ::aidl::android::hardware::security::keymint::BlockMode;
+using ::aidl::android::hardware::security::keymint::Digest;
+using ::aidl::android::hardware::security::keymint::EcCurve;
+using ::aidl::android::hardware::security::keymint::PaddingMode;
+using ::aidl::android::hardware::security::keymint::SecurityLevel;
+
+namespace KMV1 = ::aidl::android::hardware::security::keymint;
+
+static std::shared_ptr<KeyMintDevice> getDevice() {
+    static std::shared_ptr<KeyMintDevice> device =
+        KeyMintDevice::getWrappedKeymasterDevice(SecurityLevel::TRUSTED_ENVIRONMENT);
+    return device;
+}
+
+static std::vector<uint8_t> generateAesGcmKey(std::shared_ptr<KeyMintDevice> device) {
+    auto keyParams = std::vector<KeyParameter>({
+        KMV1::makeKeyParameter(KMV1::TAG_ALGORITHM, Algorithm::AES),
+        KMV1::makeKeyParameter(KMV1::TAG_KEY_SIZE, 256),
+        KMV1::makeKeyParameter(KMV1::TAG_BLOCK_MODE, BlockMode::GCM),
+        KMV1::makeKeyParameter(KMV1::TAG_PADDING, PaddingMode::NONE),
+        KMV1::makeKeyParameter(KMV1::TAG_MIN_MAC_LENGTH, 128),
+        KMV1::makeKeyParameter(KMV1::TAG_NO_AUTH_REQUIRED, true),
+        KMV1::makeKeyParameter(KMV1::TAG_PURPOSE, KeyPurpose::ENCRYPT),
+    });
+    KeyCreationResult creationResult;
+    auto status = device->generateKey(keyParams, std::nullopt /* attest_key */, &creationResult);
+    if (!status.isOk()) {
+        return {};
+    }
+    return creationResult.keyBlob;
+}
+
+// Measures the throughput of update() for AES-GCM encryption of a single input of the given size.
+static void BM_AesGcmUpdateThroughput(benchmark::State& state) {
+    auto device = getDevice();
+    if (!device) {
+        state.SkipWithError("No legacy Keymaster device found.");
+        return;
+    }
+    auto keyBlob = generateAesGcmKey(device);
+    if (keyBlob.empty()) {
+        state.SkipWithError("Failed to generate key.");
+        return;
+    }
+    std::vector<uint8_t> input(state.range(0), 0xa5);
+    auto params = std::vector<KeyParameter>({
+        KMV1::makeKeyParameter(KMV1::TAG_BLOCK_MODE, BlockMode::GCM),
+        KMV1::makeKeyParameter(KMV1::TAG_PADDING, PaddingMode::NONE),
+        KMV1::makeKeyParameter(KMV1::TAG_MAC_LENGTH, 128),
+    });
+
+    for (auto _ : state) {
+        BeginResult beginResult;
+        auto status = device->begin(KeyPurpose::ENCRYPT, keyBlob, params, HardwareAuthToken(),
+                                    &beginResult);
+        if (!status.isOk()) {
+            state.SkipWithError("begin failed.");
+            return;
+        }
+        std::vector<uint8_t> output;
+        status = beginResult.operation->update(input, std::nullopt /* authToken */,
+                                               std::nullopt /* timestampToken */, &output);
+        if (!status.isOk()) {
+            state.SkipWithError("update failed.");
+            return;
+        }
+        benchmark::DoNotOptimize(output.data());
+        beginResult.operation->abort();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_AesGcmUpdateThroughput)->RangeMultiplier(4)->Range(1 << 10, 64 << 20);
+
+// Measures claiming and freeing regular operation slots from many threads at once, with fewer
+// slots than threads, as with bursts of begin() calls from many apps.
+static void BM_ClaimSlotContention(benchmark::State& state) {
+    static std::shared_ptr<OperationSlotManager> slots = [] {
+        auto slots = std::make_shared<OperationSlotManager>();
+        slots->setNumFreeSlots(15);
+        return slots;
+    }();
+    int64_t failed = 0;
+    for (auto _ : state) {
+        auto slot = OperationSlotManager::claimSlot(slots);
+        if (!slot) {
+            failed++;
+        }
+        benchmark::DoNotOptimize(slot);
+    }
+    state.counters["failed"] = benchmark::Counter(failed, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_ClaimSlotContention)->ThreadRange(1, 32)->UseRealTime();
+
+// Measures generateKey latency for self signed asymmetric keys, including the certificate.
+// On devices with a software Keymaster behind the TEE HAL this is dominated by key generation and
+// the certificate round trips, exportKey and the self signing operation.
+static void BM_GenerateKeyLatency(benchmark::State& state, Algorithm algorithm) {
+    auto device = getDevice();
+    if (!device) {
+        state.SkipWithError("No legacy Keymaster device found.");
+        return;
+    }
+    uint64_t now_ms = (uint64_t)time(nullptr) * 1000;
+    auto keyParams = std::vector<KeyParameter>({
+        KMV1::makeKeyParameter(KMV1::TAG_ALGORITHM, algorithm),
+        KMV1::makeKeyParameter(KMV1::TAG_PURPOSE, KeyPurpose::SIGN),
+        KMV1::makeKeyParameter(KMV1::TAG_DIGEST, Digest::SHA_2_256),
+        KMV1::makeKeyParameter(KMV1::TAG_NO_AUTH_REQUIRED, true),
+        KMV1::makeKeyParameter(KMV1::TAG_CERTIFICATE_NOT_BEFORE, now_ms),
+        KMV1::makeKeyParameter(KMV1::TAG_CERTIFICATE_NOT_AFTER, now_ms + 60 * 60 * 1000),
+    });
+    if (algorithm == Algorithm::RSA) {
+        keyParams.push_back(KMV1::makeKeyParameter(KMV1::TAG_KEY_SIZE, 2048));
+        keyParams.push_back(KMV1::makeKeyParameter(KMV1::TAG_RSA_PUBLIC_EXPONENT, 65537));
+        keyParams.push_back(
+            KMV1::makeKeyParameter(KMV1::TAG_PADDING, PaddingMode::RSA_PKCS1_1_5_SIGN));
+    } else {
+        keyParams.push_back(KMV1::makeKeyParameter(KMV1::TAG_EC_CURVE, EcCurve::P_256));
+    }
+
+    for (auto _ : state) {
+        KeyCreationResult creationResult;
+        auto status =
+            device->generateKey(keyParams, std::nullopt /* attest_key */, &creationResult);
+        if (!status.isOk() || creationResult.certificateChain.empty()) {
+            state.SkipWithError("generateKey failed.");
+            return;
+        }
+        benchmark::DoNotOptimize(creationResult.certificateChain.data());
+    }
+}
+BENCHMARK_CAPTURE(BM_GenerateKeyLatency, RSA_2048, Algorithm::RSA)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_GenerateKeyLatency, EC_P256, Algorithm::EC)->Unit(benchmark::kMillisecond);
+
+// Returns a key parameter set like the ones keystore2 passes to generateKey, with |count| entries.
+static std::vector<KeyParameter> makeKeyParameters(size_t count) {
+    uint64_t now_ms = (uint64_t)time(nullptr) * 1000;
+    std::vector<KeyParameter> params = {
+        KMV1::makeKeyParameter(KMV1::TAG_ALGORITHM, Algorithm::EC),
+        KMV1::makeKeyParameter(KMV1::TAG_EC_CURVE, EcCurve::P_256),
+        KMV1::makeKeyParameter(KMV1::TAG_KEY_SIZE, 256),
+        KMV1::makeKeyParameter(KMV1::TAG_PURPOSE, KeyPurpose::SIGN),
+        KMV1::makeKeyParameter(KMV1::TAG_PURPOSE, KeyPurpose::VERIFY),
+        KMV1::makeKeyParameter(KMV1::TAG_DIGEST, Digest::NONE),
+        KMV1::makeKeyParameter(KMV1::TAG_DIGEST, Digest::SHA_2_256),
+        KMV1::makeKeyParameter(KMV1::TAG_DIGEST, Digest::SHA_2_512),
+        KMV1::makeKeyParameter(KMV1::TAG_PADDING, PaddingMode::NONE),
+        KMV1::makeKeyParameter(KMV1::TAG_NO_AUTH_REQUIRED, true),
+        KMV1::makeKeyParameter(KMV1::TAG_USER_ID, 0),
+        KMV1::makeKeyParameter(KMV1::TAG_OS_VERSION, 130000),
+        KMV1::makeKeyParameter(KMV1::TAG_OS_PATCHLEVEL, 202301),
+        KMV1::makeKeyParameter(KMV1::TAG_VENDOR_PATCHLEVEL, 20230101),
+        KMV1::makeKeyParameter(KMV1::TAG_BOOT_PATCHLEVEL, 20230101),
+        KMV1::makeKeyParameter(KMV1::TAG_CREATION_DATETIME, now_ms),
+        KMV1::makeKeyParameter(KMV1::TAG_CERTIFICATE_NOT_BEFORE, now_ms),
+        KMV1::makeKeyParameter(KMV1::TAG_CERTIFICATE_NOT_AFTER, now_ms + 60 * 60 * 1000),
+        KMV1::makeKeyParameter(KMV1::TAG_APPLICATION_ID, std::vector<uint8_t>(16, 0x11)),
+        KMV1::makeKeyParameter(KMV1::TAG_ATTESTATION_CHALLENGE, std::vector<uint8_t>(32, 0x22)),
+    };
+    std::vector<KeyParameter> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        result.push_back(params[i % params.size()]);
+    }
+    return result;
+}
+
+template <V4_0::KeyParameter (*convertToLegacy)(const KeyParameter&)>
+static void BM_ConvertKeyParametersToLegacy(benchmark::State& state) {
+    auto params = makeKeyParameters(state.range(0));
+    for (auto _ : state) {
+        std::vector<V4_0::KeyParameter> legacyParams;
+        legacyParams.reserve(params.size());
+        for (const auto& param : params) {
+            legacyParams.push_back(convertToLegacy(param));
+        }
+        benchmark::DoNotOptimize(legacyParams.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_ConvertKeyParametersToLegacy, convertKeyParameterToLegacy)->Arg(20)->Arg(40);
+BENCHMARK_TEMPLATE(BM_ConvertKeyParametersToLegacy, convertKeyParameterToLegacyBySwitch)
+    ->Arg(20)
+    ->Arg(40);
+
+template <KeyParameter (*convertFromLegacy)(const V4_0::KeyParameter&)>
+static void BM_ConvertKeyParametersFromLegacy(benchmark::State& state) {
+    std::vector<V4_0::KeyParameter> legacyParams;
+    for (const auto& param : makeKeyParameters(state.range(0))) {
+        legacyParams.push_back(convertKeyParameterToLegacy(param));
+    }
+    for (auto _ : state) {
+        std::vector<KeyParameter> params;
+        params.reserve(legacyParams.size());
+        for (const auto& legacyParam : legacyParams) {
+            params.push_back(convertFromLegacy(legacyParam));
+        }
+        benchmark::DoNotOptimize(params.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_ConvertKeyParametersFromLegacy, convertKeyParameterFromLegacy)
+    ->Arg(20)
+    ->Arg(40);
+BENCHMARK_TEMPLATE(BM_ConvertKeyParametersFromLegacy, convertKeyParameterFromLegacyBySwitch)
+    ->Arg(20)
+    ->Arg(40);
+
+BENCHMARK_MAIN();
@@ -16,7 +16,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <optional>
+#include <type_traits>
 
 #include <aidl/android/hardware/security/keymint/EcCurve.h>
 #include <aidl/android/hardware/security/keymint/ErrorCode.h>
@@ -448,7 +451,11 @@ static KMV1::KeyOrigin convert(V4_0::KeyOrigin o) {
     }
 }
 
-static V4_0::KeyParameter convertKeyParameterToLegacy(const KMV1::KeyParameter& kp) {
+// The switch based key parameter conversions below are the reference implementation of the table
+// driven convertKeyParameterToLegacy() and convertKeyParameterFromLegacy() further down. They are
+// kept for tests and benchmarks only.
+
+static V4_0::KeyParameter convertKeyParameterToLegacyBySwitch(const KMV1::KeyParameter& kp) {
     switch (kp.tag) {
     case KMV1::Tag::INVALID:
         break;
@@ -760,7 +767,7 @@ static V4_0::KeyParameter convertKeyParameterToLegacy(const KMV1::KeyParameter&
     return V4_0::KeyParameter{.tag = V4_0::Tag::INVALID};
 }
 
-static KMV1::KeyParameter convertKeyParameterFromLegacy(const V4_0::KeyParameter& kp) {
+static KMV1::KeyParameter convertKeyParameterFromLegacyBySwitch(const V4_0::KeyParameter& kp) {
     auto unwrapper = [](auto v) -> auto {
         if (v.isOk()) {
             return std::optional(std::reference_wrapper(v.value()));
@@ -1075,3 +1082,250 @@ static KMV1::KeyParameter convertKeyParameterFromLegacy(const V4_0::KeyParameter
 
     return KMV1::makeKeyParameter(KMV1::TAG_INVALID);
 }
+
+// Table driven key parameter conversion.
+//
+// kTagConversions is the single list of all KeyMint tags. Each tag is either mapped to its
+// Keymaster 4.x counterpart or explicitly marked as unmapped. The converters for mapped tags are
+// instantiated from the typed tags, and the lookup indices for both directions are derived from
+// the list at compile time.
+
+namespace km_compat_internal {
+
+template <typename T> struct IsOptional : std::false_type {};
+template <typename T> struct IsOptional<std::optional<T>> : std::true_type {};
+
+template <typename TypedTag> struct TypedTagValue;
+template <KMV1::TagType type, KMV1::Tag tag> struct TypedTagValue<KMV1::TypedTag<type, tag>> {
+    static constexpr KMV1::Tag value = tag;
+};
+template <V4_0::TagType type, V4_0::Tag tag> struct TypedTagValue<V4_0::TypedTag<type, tag>> {
+    static constexpr V4_0::Tag value = tag;
+};
+
+// Enumerations are translated with the matching convert() overload, everything else is passed
+// through as is.
+template <typename T> static decltype(auto) convertValue(const T& value) {
+    if constexpr (std::is_enum_v<T>) {
+        return convert(value);
+    } else {
+        return (value);
+    }
+}
+
+template <typename KMV1TypedTag, typename LegacyTypedTag>
+static V4_0::KeyParameter convertTypedKeyParameterToLegacy(const KMV1::KeyParameter& kp) {
+    if (auto v = KMV1::authorizationValue(KMV1TypedTag(), kp)) {
+        decltype(auto) value = convertValue(v->get());
+        if constexpr (IsOptional<std::decay_t<decltype(value)>>::value) {
+            // Some enum values have no legacy counterpart.
+            if (value) {
+                return V4_0::makeKeyParameter(LegacyTypedTag(), *value);
+            }
+        } else {
+            return V4_0::makeKeyParameter(LegacyTypedTag(), value);
+        }
+    }
+    return V4_0::KeyParameter{.tag = V4_0::Tag::INVALID};
+}
+
+template <typename KMV1TypedTag, typename LegacyTypedTag>
+static KMV1::KeyParameter convertTypedKeyParameterFromLegacy(const V4_0::KeyParameter& kp) {
+    auto v = V4_0::authorizationValue(LegacyTypedTag(), kp);
+    if (v.isOk()) {
+        return KMV1::makeKeyParameter(KMV1TypedTag(), convertValue(v.value()));
+    }
+    return KMV1::makeKeyParameter(KMV1::TAG_INVALID);
+}
+
+struct TagConversion {
+    KMV1::Tag tag;
+    // V4_0::Tag::INVALID if the tag is unmapped.
+    V4_0::Tag legacyTag;
+    V4_0::KeyParameter (*toLegacy)(const KMV1::KeyParameter&);
+    KMV1::KeyParameter (*fromLegacy)(const V4_0::KeyParameter&);
+};
+
+template <typename KMV1TypedTag, typename LegacyTypedTag> constexpr TagConversion mappedTag() {
+    return {TypedTagValue<KMV1TypedTag>::value, TypedTagValue<LegacyTypedTag>::value,
+            &convertTypedKeyParameterToLegacy<KMV1TypedTag, LegacyTypedTag>,
+            &convertTypedKeyParameterFromLegacy<KMV1TypedTag, LegacyTypedTag>};
+}
+
+constexpr TagConversion unmappedTag(KMV1::Tag tag) {
+    return {tag, V4_0::Tag::INVALID, nullptr, nullptr};
+}
+
+}  // namespace km_compat_internal
+
+#define KM_COMPAT_MAPPED_TAG(legacy_ns, name)                                                      \
+    km_compat_internal::mappedTag<std::remove_cv_t<decltype(KMV1::TAG_##name)>,                    \
+                                  std::remove_cv_t<decltype(legacy_ns::TAG_##name)>>()
+#define KM_COMPAT_UNMAPPED_TAG(name) km_compat_internal::unmappedTag(KMV1::Tag::name)
+
+static constexpr km_compat_internal::TagConversion kTagConversions[] = {
+    KM_COMPAT_UNMAPPED_TAG(INVALID),
+    KM_COMPAT_MAPPED_TAG(V4_0, PURPOSE),
+    KM_COMPAT_MAPPED_TAG(V4_0, ALGORITHM),
+    KM_COMPAT_MAPPED_TAG(V4_0, KEY_SIZE),
+    KM_COMPAT_MAPPED_TAG(V4_0, BLOCK_MODE),
+    KM_COMPAT_MAPPED_TAG(V4_0, DIGEST),
+    KM_COMPAT_MAPPED_TAG(V4_0, PADDING),
+    KM_COMPAT_MAPPED_TAG(V4_0, CALLER_NONCE),
+    KM_COMPAT_MAPPED_TAG(V4_0, MIN_MAC_LENGTH),
+    KM_COMPAT_MAPPED_TAG(V4_0, EC_CURVE),
+    KM_COMPAT_MAPPED_TAG(V4_0, RSA_PUBLIC_EXPONENT),
+    KM_COMPAT_MAPPED_TAG(V4_0, INCLUDE_UNIQUE_ID),
+    KM_COMPAT_MAPPED_TAG(V4_0, BOOTLOADER_ONLY),
+    KM_COMPAT_MAPPED_TAG(V4_0, ROLLBACK_RESISTANCE),
+    KM_COMPAT_MAPPED_TAG(V4_0, HARDWARE_TYPE),
+    KM_COMPAT_MAPPED_TAG(V4_1, EARLY_BOOT_ONLY),
+    KM_COMPAT_MAPPED_TAG(V4_0, ACTIVE_DATETIME),
+    KM_COMPAT_MAPPED_TAG(V4_0, ORIGINATION_EXPIRE_DATETIME),
+    KM_COMPAT_MAPPED_TAG(V4_0, USAGE_EXPIRE_DATETIME),
+    KM_COMPAT_MAPPED_TAG(V4_0, MIN_SECONDS_BETWEEN_OPS),
+    KM_COMPAT_MAPPED_TAG(V4_0, MAX_USES_PER_BOOT),
+    KM_COMPAT_UNMAPPED_TAG(USAGE_COUNT_LIMIT),
+    KM_COMPAT_MAPPED_TAG(V4_0, USER_ID),
+    KM_COMPAT_MAPPED_TAG(V4_0, USER_SECURE_ID),
+    KM_COMPAT_MAPPED_TAG(V4_0, NO_AUTH_REQUIRED),
+    KM_COMPAT_MAPPED_TAG(V4_0, USER_AUTH_TYPE),
+    KM_COMPAT_MAPPED_TAG(V4_0, AUTH_TIMEOUT),
+    KM_COMPAT_MAPPED_TAG(V4_0, ALLOW_WHILE_ON_BODY),
+    KM_COMPAT_MAPPED_TAG(V4_0, TRUSTED_USER_PRESENCE_REQUIRED),
+    KM_COMPAT_MAPPED_TAG(V4_0, TRUSTED_CONFIRMATION_REQUIRED),
+    KM_COMPAT_MAPPED_TAG(V4_0, UNLOCKED_DEVICE_REQUIRED),
+    KM_COMPAT_MAPPED_TAG(V4_0, APPLICATION_ID),
+    KM_COMPAT_MAPPED_TAG(V4_0, APPLICATION_DATA),
+    KM_COMPAT_MAPPED_TAG(V4_0, CREATION_DATETIME),
+    KM_COMPAT_MAPPED_TAG(V4_0, ORIGIN),
+    KM_COMPAT_MAPPED_TAG(V4_0, ROOT_OF_TRUST),
+    KM_COMPAT_MAPPED_TAG(V4_0, OS_VERSION),
+    KM_COMPAT_MAPPED_TAG(V4_0, OS_PATCHLEVEL),
+    KM_COMPAT_MAPPED_TAG(V4_0, UNIQUE_ID),
+    KM_COMPAT_MAPPED_TAG(V4_0, ATTESTATION_CHALLENGE),
+    KM_COMPAT_MAPPED_TAG(V4_0, ATTESTATION_APPLICATION_ID),
+    KM_COMPAT_MAPPED_TAG(V4_0, ATTESTATION_ID_BRAND),
+    KM_COMPAT_MAPPED_TAG(V4_0, ATTESTATION_ID_DEVICE),
+    KM_COMPAT_MAPPED_TAG(V4_0, ATTESTATION_ID_PRODUCT),
+    KM_COMPAT_MAPPED_TAG(V4_0, ATTESTATION_ID_SERIAL),
+    KM_COMPAT_MAPPED_TAG(V4_0, ATTESTATION_ID_IMEI),
+    KM_COMPAT_MAPPED_TAG(V4_0, ATTESTATION_ID_MEID),
+    KM_COMPAT_MAPPED_TAG(V4_0, ATTESTATION_ID_MANUFACTURER),
+    KM_COMPAT_MAPPED_TAG(V4_0, ATTESTATION_ID_MODEL),
+    KM_COMPAT_MAPPED_TAG(V4_0, VENDOR_PATCHLEVEL),
+    KM_COMPAT_MAPPED_TAG(V4_0, BOOT_PATCHLEVEL),
+    KM_COMPAT_MAPPED_TAG(V4_1, DEVICE_UNIQUE_ATTESTATION),
+    KM_COMPAT_MAPPED_TAG(V4_1, IDENTITY_CREDENTIAL_KEY),
+    KM_COMPAT_MAPPED_TAG(V4_1, STORAGE_KEY),
+    KM_COMPAT_MAPPED_TAG(V4_0, ASSOCIATED_DATA),
+    KM_COMPAT_MAPPED_TAG(V4_0, NONCE),
+    KM_COMPAT_MAPPED_TAG(V4_0, MAC_LENGTH),
+    KM_COMPAT_MAPPED_TAG(V4_0, RESET_SINCE_ID_ROTATION),
+    KM_COMPAT_MAPPED_TAG(V4_0, CONFIRMATION_TOKEN),
+    KM_COMPAT_UNMAPPED_TAG(RSA_OAEP_MGF_DIGEST),
+    KM_COMPAT_UNMAPPED_TAG(CERTIFICATE_SERIAL),
+    KM_COMPAT_UNMAPPED_TAG(CERTIFICATE_SUBJECT),
+    KM_COMPAT_UNMAPPED_TAG(CERTIFICATE_NOT_BEFORE),
+    KM_COMPAT_UNMAPPED_TAG(CERTIFICATE_NOT_AFTER),
+    KM_COMPAT_UNMAPPED_TAG(ATTESTATION_ID_SECOND_IMEI),
+    KM_COMPAT_UNMAPPED_TAG(MAX_BOOT_LEVEL),
+};
+
+#undef KM_COMPAT_MAPPED_TAG
+#undef KM_COMPAT_UNMAPPED_TAG
+
+namespace km_compat_internal {
+
+constexpr uint32_t tagNumber(uint32_t tag) {
+    // The upper four bits of a tag encode its type.
+    return tag & 0x0FFFFFFF;
+}
+
+constexpr size_t maxTagNumber() {
+    uint32_t result = 0;
+    for (const auto& c : kTagConversions) {
+        result = std::max({result, tagNumber(static_cast<uint32_t>(c.tag)),
+                           tagNumber(static_cast<uint32_t>(c.legacyTag))});
+    }
+    return result;
+}
+
+constexpr uint8_t kNoTagConversion = 0xff;
+static_assert(std::size(kTagConversions) < kNoTagConversion);
+
+using TagIndex = std::array<uint8_t, maxTagNumber() + 1>;
+
+// Maps tag numbers to positions in kTagConversions.
+constexpr TagIndex makeTagIndex(bool legacy) {
+    TagIndex index{};
+    for (auto& i : index) {
+        i = kNoTagConversion;
+    }
+    for (size_t i = 0; i < std::size(kTagConversions); i++) {
+        const auto& c = kTagConversions[i];
+        if (legacy) {
+            if (c.fromLegacy) {
+                index[tagNumber(static_cast<uint32_t>(c.legacyTag))] = static_cast<uint8_t>(i);
+            }
+        } else {
+            index[tagNumber(static_cast<uint32_t>(c.tag))] = static_cast<uint8_t>(i);
+        }
+    }
+    return index;
+}
+
+static constexpr TagIndex kTagIndex = makeTagIndex(false /* legacy */);
+static constexpr TagIndex kLegacyTagIndex = makeTagIndex(true /* legacy */);
+
+constexpr bool allTagConversionsIndexed() {
+    for (size_t i = 0; i < std::size(kTagConversions); i++) {
+        const auto& c = kTagConversions[i];
+        if (kTagIndex[tagNumber(static_cast<uint32_t>(c.tag))] != i) return false;
+        if (c.fromLegacy && kLegacyTagIndex[tagNumber(static_cast<uint32_t>(c.legacyTag))] != i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr bool allKeyMintTagsListed() {
+    for (auto tag : ndk::enum_range<KMV1::Tag>()) {
+        uint32_t number = tagNumber(static_cast<uint32_t>(tag));
+        if (number >= kTagIndex.size()) return false;
+        auto i = kTagIndex[number];
+        if (i == kNoTagConversion || kTagConversions[i].tag != tag) return false;
+    }
+    return true;
+}
+
+static_assert(allTagConversionsIndexed(), "Tags must be listed exactly once in kTagConversions.");
+static_assert(allKeyMintTagsListed(),
+              "Every KeyMint tag must be listed in kTagConversions, mapped or unmapped.");
+
+}  // namespace km_compat_internal
+
+static V4_0::KeyParameter convertKeyParameterToLegacy(const KMV1::KeyParameter& kp) {
+    using namespace km_compat_internal;
+    uint32_t number = tagNumber(static_cast<uint32_t>(kp.tag));
+    if (number < kTagIndex.size()) {
+        auto i = kTagIndex[number];
+        if (i != kNoTagConversion && kTagConversions[i].tag == kp.tag &&
+            kTagConversions[i].toLegacy) {
+            return kTagConversions[i].toLegacy(kp);
+        }
+    }
+    return V4_0::KeyParameter{.tag = V4_0::Tag::INVALID};
+}
+
+static KMV1::KeyParameter convertKeyParameterFromLegacy(const V4_0::KeyParameter& kp) {
+    using namespace km_compat_internal;
+    uint32_t number = tagNumber(static_cast<uint32_t>(kp.tag));
+    if (number < kLegacyTagIndex.size()) {
+        auto i = kLegacyTagIndex[number];
+        if (i != kNoTagConversion && kTagConversions[i].legacyTag == kp.tag) {
+            return kTagConversions[i].fromLegacy(kp);
+        }
+    }
+    return KMV1::makeKeyParameter(KMV1::TAG_INVALID);
+}
@@ -78,6 +78,10 @@ TEST(KmCompatTypeConversionTest, testEnumCoversion) {
             V4_0::tag, V4_0::TypedTag2ValueType<decltype(V4_0::tag)>::type{});                     \
         ASSERT_EQ(legacy_param, convertKeyParameterToLegacy(kmv1_param));                          \
         ASSERT_EQ(kmv1_param, convertKeyParameterFromLegacy(legacy_param));                        \
+        ASSERT_EQ(convertKeyParameterToLegacyBySwitch(kmv1_param),                                 \
+                  convertKeyParameterToLegacy(kmv1_param));                                        \
+        ASSERT_EQ(convertKeyParameterFromLegacyBySwitch(legacy_param),                             \
+                  convertKeyParameterFromLegacy(legacy_param));                                    \
     } while (false)
 
 #define TEST_KEY_PARAMETER_CONVERSION_V4_1(tag)                                                    \
@@ -88,6 +92,10 @@ TEST(KmCompatTypeConversionTest, testEnumCoversion) {
             V4_1::tag, V4_0::TypedTag2ValueType<decltype(V4_1::tag)>::type{});                     \
         ASSERT_EQ(legacy_param, convertKeyParameterToLegacy(kmv1_param));                          \
         ASSERT_EQ(kmv1_param, convertKeyParameterFromLegacy(legacy_param));                        \
+        ASSERT_EQ(convertKeyParameterToLegacyBySwitch(kmv1_param),                                 \
+                  convertKeyParameterToLegacy(kmv1_param));                                        \
+        ASSERT_EQ(convertKeyParameterFromLegacyBySwitch(legacy_param),                             \
+                  convertKeyParameterFromLegacy(legacy_param));                                    \
     } while (false)
 
 TEST(KmCompatTypeConversionTest, testKeyParameterConversion) {
@@ -151,6 +159,57 @@ TEST(KmCompatTypeConversionTest, testKeyParameterConversion) {
     TEST_KEY_PARAMETER_CONVERSION_V4_0(TAG_VENDOR_PATCHLEVEL);
 }
 
+TEST(KmCompatTypeConversionTest, testTableMatchesSwitchConversion) {
+    // A realistic set of key parameters, including values and tags that have no legacy
+    // counterpart.
+    std::vector<KMV1::KeyParameter> params = {
+        KMV1::makeKeyParameter(KMV1::TAG_PURPOSE, KMV1::KeyPurpose::SIGN),
+        KMV1::makeKeyParameter(KMV1::TAG_PURPOSE, KMV1::KeyPurpose::VERIFY),
+        KMV1::makeKeyParameter(KMV1::TAG_PURPOSE, KMV1::KeyPurpose::AGREE_KEY),
+        KMV1::makeKeyParameter(KMV1::TAG_ALGORITHM, KMV1::Algorithm::EC),
+        KMV1::makeKeyParameter(KMV1::TAG_KEY_SIZE, 256),
+        KMV1::makeKeyParameter(KMV1::TAG_EC_CURVE, KMV1::EcCurve::P_256),
+        KMV1::makeKeyParameter(KMV1::TAG_EC_CURVE, KMV1::EcCurve::CURVE_25519),
+        KMV1::makeKeyParameter(KMV1::TAG_DIGEST, KMV1::Digest::SHA_2_256),
+        KMV1::makeKeyParameter(KMV1::TAG_DIGEST, KMV1::Digest::NONE),
+        KMV1::makeKeyParameter(KMV1::TAG_PADDING, KMV1::PaddingMode::RSA_PSS),
+        KMV1::makeKeyParameter(KMV1::TAG_BLOCK_MODE, KMV1::BlockMode::GCM),
+        KMV1::makeKeyParameter(KMV1::TAG_MIN_MAC_LENGTH, 128),
+        KMV1::makeKeyParameter(KMV1::TAG_RSA_PUBLIC_EXPONENT, 65537),
+        KMV1::makeKeyParameter(KMV1::TAG_NO_AUTH_REQUIRED, true),
+        KMV1::makeKeyParameter(KMV1::TAG_USER_SECURE_ID, 0x1234567890),
+        KMV1::makeKeyParameter(KMV1::TAG_USER_AUTH_TYPE,
+                               KMV1::HardwareAuthenticatorType::FINGERPRINT),
+        KMV1::makeKeyParameter(KMV1::TAG_AUTH_TIMEOUT, 300),
+        KMV1::makeKeyParameter(KMV1::TAG_ORIGIN, KMV1::KeyOrigin::GENERATED),
+        KMV1::makeKeyParameter(KMV1::TAG_HARDWARE_TYPE, KMV1::SecurityLevel::STRONGBOX),
+        KMV1::makeKeyParameter(KMV1::TAG_OS_VERSION, 130000),
+        KMV1::makeKeyParameter(KMV1::TAG_OS_PATCHLEVEL, 202301),
+        KMV1::makeKeyParameter(KMV1::TAG_APPLICATION_ID, std::vector<uint8_t>{1, 2, 3}),
+        KMV1::makeKeyParameter(KMV1::TAG_ATTESTATION_CHALLENGE, std::vector<uint8_t>(32, 0xa5)),
+        KMV1::makeKeyParameter(KMV1::TAG_CREATION_DATETIME, 1600000000000),
+        KMV1::makeKeyParameter(KMV1::TAG_EARLY_BOOT_ONLY, true),
+        KMV1::makeKeyParameter(KMV1::TAG_STORAGE_KEY, true),
+        KMV1::makeKeyParameter(KMV1::TAG_USAGE_COUNT_LIMIT, 1),
+        KMV1::makeKeyParameter(KMV1::TAG_MAX_BOOT_LEVEL, 10),
+        KMV1::makeKeyParameter(KMV1::TAG_CERTIFICATE_NOT_BEFORE, 0),
+        KMV1::makeKeyParameter(KMV1::TAG_RSA_OAEP_MGF_DIGEST, KMV1::Digest::SHA1),
+        KMV1::makeKeyParameter(KMV1::TAG_INVALID),
+    };
+    for (const auto& param : params) {
+        auto legacy = convertKeyParameterToLegacy(param);
+        ASSERT_EQ(convertKeyParameterToLegacyBySwitch(param), legacy) << toString(param.tag);
+        ASSERT_EQ(convertKeyParameterFromLegacyBySwitch(legacy),
+                  convertKeyParameterFromLegacy(legacy))
+            << toString(param.tag);
+    }
+
+    // Tags unknown to KeyMint must not be converted.
+    V4_0::KeyParameter unknown = {.tag = static_cast<V4_0::Tag>((7 << 28) | 16201)};
+    ASSERT_EQ(convertKeyParameterFromLegacyBySwitch(unknown),
+              convertKeyParameterFromLegacy(unknown));
+}
+
 #define TEST_ERROR_CODE_CONVERSION(variant)                                                        \
     ASSERT_EQ(KMV1::ErrorCode::variant, convert(V4_0::ErrorCode::variant))
 
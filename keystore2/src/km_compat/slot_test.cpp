@@ -22,6 +22,8 @@
 #include <aidl/android/hardware/security/keymint/ErrorCode.h>
 #include <aidl/android/hardware/security/keymint/IKeyMintOperation.h>
 
+#include <thread>
+
 using ::aidl::android::hardware::security::keymint::Algorithm;
 using ::aidl::android::hardware::security::keymint::BlockMode;
 using ::aidl::android::hardware::security::keymint::Certificate;
@@ -233,3 +235,68 @@ TEST(SlotTest, TestSlots) {
     result = begin(device, true);
     ASSERT_TRUE(std::holds_alternative<BeginResult>(result));
 }
+
+TEST(SlotTest, TestConcurrentClaimsDoNotOversubscribe) {
+    static const int kNumThreads = 16;
+    static const int kIterations = 10000;
+    auto slots = std::make_shared<OperationSlotManager>();
+    slots->setNumFreeSlots(NUM_SLOTS);
+
+    std::atomic<int> inUse = 0;
+    std::atomic<int> maxInUse = 0;
+    std::atomic<int> claimed = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kNumThreads; t++) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < kIterations; i++) {
+                auto slot = OperationSlotManager::claimSlot(slots);
+                if (!slot) continue;
+                claimed++;
+                int current = ++inUse;
+                int max = maxInUse.load();
+                while (current > max && !maxInUse.compare_exchange_weak(max, current)) {
+                }
+                inUse--;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_LE(maxInUse.load(), NUM_SLOTS);
+    EXPECT_GT(claimed.load(), 0);
+
+    // All slots must have been returned.
+    std::vector<OperationSlot> held;
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        auto slot = OperationSlotManager::claimSlot(slots);
+        ASSERT_TRUE(slot.has_value());
+        held.push_back(std::move(*slot));
+    }
+    ASSERT_FALSE(OperationSlotManager::claimSlot(slots).has_value());
+}
+
+TEST(SlotTest, TestClaimSlotWithDeadline) {
+    auto slots = std::make_shared<OperationSlotManager>();
+    slots->setNumFreeSlots(1);
+
+    auto held = OperationSlotManager::claimSlot(slots);
+    ASSERT_TRUE(held.has_value());
+
+    // With no slot being freed the caller gives up once the deadline expires.
+    auto slot = OperationSlotManager::claimSlot(
+        slots, std::chrono::steady_clock::now() + std::chrono::milliseconds(20));
+    ASSERT_FALSE(slot.has_value());
+
+    // A slot freed while waiting is handed to the waiter.
+    std::thread releaser([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        held = std::nullopt;
+    });
+    slot = OperationSlotManager::claimSlot(
+        slots, std::chrono::steady_clock::now() + std::chrono::seconds(5));
+    releaser.join();
+    ASSERT_TRUE(slot.has_value());
+    ASSERT_FALSE(OperationSlotManager::claimSlot(slots).has_value());
+}
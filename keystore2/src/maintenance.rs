@@ -133,6 +133,11 @@ impl Maintenance {
             .context(ks_err!("Trying to delete legacy keys."))?;
         DB.with(|db| db.borrow_mut().unbind_keys_for_namespace(domain, nspace))
             .context(ks_err!("Trying to delete keys from db."))?;
+        // The namespace of an app is cleared when its package is removed or its data is cleared,
+        // so its cached attestation application id may be stale.
+        if domain == Domain::APP {
+            keystore2_aaid::invalidate_aaid(nspace as u32);
+        }
         self.delete_listener
             .delete_namespace(domain, nspace)
             .context(ks_err!("While invoking the delete listener."))
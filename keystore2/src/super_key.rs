@@ -42,8 +42,8 @@ use android_system_keystore2::aidl::android::system::keystore2::{
 };
 use anyhow::{Context, Result};
 use keystore2_crypto::{
-    aes_gcm_decrypt, aes_gcm_encrypt, generate_aes256_key, generate_salt, Password, ZVec,
-    AES_256_KEY_LENGTH,
+    aes_gcm_decrypt, aes_gcm_encrypt, clear_password_key_cache, generate_aes256_key, generate_salt,
+    Password, ZVec, AES_256_KEY_LENGTH,
 };
 use rustutils::system_properties::PropertyWatcher;
 use std::{
@@ -350,6 +350,7 @@ impl SuperKeyManager {
 
     pub fn forget_all_keys_for_user(&mut self, user: UserId) {
         self.data.user_keys.remove(&user);
+        clear_password_key_cache();
     }
 
     fn install_per_boot_key_for_user(
@@ -995,6 +996,7 @@ impl SuperKeyManager {
         }
         entry.screen_lock_bound = None;
         entry.screen_lock_bound_private = None;
+        clear_password_key_cache();
     }
 
     /// User has unlocked, not using a password. See if any of our stored auth tokens can be used
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DigestTable.h"
+
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using android::base::Error;
+using android::base::Result;
+
+namespace {
+
+constexpr char kMagic[4] = {'O', 'D', 'S', 'D'};
+constexpr uint32_t kVersion = 2;
+
+// All fields are little-endian, like every device odsign runs on.
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t paths_size;
+};
+static_assert(sizeof(Header) == 16);
+
+struct RawEntry {
+    uint32_t path_offset;
+    uint32_t path_size;
+    uint8_t digest[DigestTable::kDigestSize];
+};
+static_assert(sizeof(RawEntry) == 40);
+
+Result<void> parseHexDigest(const std::string& hex, uint8_t* out) {
+    if (hex.size() != 2 * DigestTable::kDigestSize) {
+        return Error() << "Unexpected digest size " << hex.size();
+    }
+    for (size_t i = 0; i < DigestTable::kDigestSize; ++i) {
+        auto [end, ec] = std::from_chars(&hex[2 * i], &hex[2 * i + 2], out[i], 16);
+        if (ec != std::errc() || end != &hex[2 * i + 2]) {
+            return Error() << "Malformed digest " << hex;
+        }
+    }
+    return {};
+}
+
+}  // namespace
+
+Result<std::string> DigestTable::serialize(const std::map<std::string, std::string>& digests) {
+    std::string paths;
+    std::vector<RawEntry> entries;
+    entries.reserve(digests.size());
+    // std::map iterates in the order that parse() requires.
+    for (const auto& [path, digest] : digests) {
+        RawEntry entry = {};
+        if (paths.size() + path.size() > std::numeric_limits<uint32_t>::max()) {
+            return Error() << "Too many artifacts";
+        }
+        entry.path_offset = paths.size();
+        entry.path_size = path.size();
+        paths += path;
+        if (auto result = parseHexDigest(digest, entry.digest); !result.ok()) {
+            return Error() << path << ": " << result.error();
+        }
+        entries.push_back(entry);
+    }
+
+    Header header = {};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.entry_count = entries.size();
+    header.paths_size = paths.size();
+
+    std::string out;
+    out.reserve(sizeof(header) + entries.size() * sizeof(RawEntry) + paths.size());
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(RawEntry));
+    out += paths;
+    return out;
+}
+
+Result<DigestTable> DigestTable::parse(std::string data) {
+    if (data.size() < sizeof(Header)) {
+        return Error() << "Digest table is truncated";
+    }
+    Header header;
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) {
+        return Error() << "Digest table has an unknown format";
+    }
+    uint64_t entriesSize = uint64_t{header.entry_count} * sizeof(RawEntry);
+    if (sizeof(Header) + entriesSize + header.paths_size != data.size()) {
+        return Error() << "Digest table has an unexpected size";
+    }
+    DigestTable table(std::move(data), header.entry_count);
+
+    // Validate the entries once, so that entry() can trust them, and so that lookups can rely
+    // on the order.
+    for (size_t i = 0; i < table.mEntryCount; ++i) {
+        RawEntry raw;
+        memcpy(&raw, table.mData.data() + sizeof(Header) + i * sizeof(RawEntry), sizeof(raw));
+        if (uint64_t{raw.path_offset} + raw.path_size > header.paths_size) {
+            return Error() << "Digest table entry " << i << " is out of bounds";
+        }
+        if (i > 0 && !(table.entry(i - 1).path < table.entry(i).path)) {
+            return Error() << "Digest table entry " << i << " is out of order";
+        }
+    }
+    return table;
+}
+
+DigestTable::Entry DigestTable::entry(size_t i) const {
+    const char* raw = mData.data() + sizeof(Header) + i * sizeof(RawEntry);
+    uint32_t pathOffset;
+    uint32_t pathSize;
+    memcpy(&pathOffset, raw + offsetof(RawEntry, path_offset), sizeof(pathOffset));
+    memcpy(&pathSize, raw + offsetof(RawEntry, path_size), sizeof(pathSize));
+    const char* paths = mData.data() + sizeof(Header) + mEntryCount * sizeof(RawEntry);
+    return Entry{
+        .path = std::string_view(paths + pathOffset, pathSize),
+        .digest = std::span<const uint8_t, kDigestSize>(
+            reinterpret_cast<const uint8_t*>(raw + offsetof(RawEntry, digest)), kDigestSize),
+    };
+}
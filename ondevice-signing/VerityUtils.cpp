@@ -14,14 +14,27 @@
  * limitations under the License.
  */
 
+#include "VerityUtils.h"
+
+#include "DigestTable.h"
+
+#include <algorithm>
+#include <atomic>
 #include <charconv>
 #include <filesystem>
 #include <map>
+#include <mutex>
+#include <optional>
 #include <span>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <fcntl.h>
 #include <linux/fs.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -34,6 +47,7 @@
 #include <asm/byteorder.h>
 #include <libfsverity.h>
 #include <linux/fsverity.h>
+#include <openssl/sha.h>
 
 #define FS_VERITY_MAX_DIGEST_SIZE 64
 
@@ -118,7 +132,7 @@ static trailing_unique_ptr<T> makeUniqueWithTrailingData(size_t trailing_data_si
     return trailing_unique_ptr<T>{ptr};
 }
 
-static Result<std::string> measureFsVerity(int fd) {
+static Result<std::vector<uint8_t>> measureFsVerityRaw(int fd) {
     auto d = makeUniqueWithTrailingData<fsverity_digest>(FS_VERITY_MAX_DIGEST_SIZE);
     d->digest_size = FS_VERITY_MAX_DIGEST_SIZE;
 
@@ -130,7 +144,11 @@ static Result<std::string> measureFsVerity(int fd) {
         }
     }
 
-    return toHex({&d->digest[0], &d->digest[d->digest_size]});
+    return std::vector<uint8_t>(&d->digest[0], &d->digest[d->digest_size]);
+}
+
+static Result<std::string> measureFsVerity(int fd) {
+    return toHex(OR_RETURN(measureFsVerityRaw(fd)));
 }
 
 static Result<std::string> measureFsVerity(const std::string& path) {
@@ -176,37 +194,365 @@ static Result<bool> isFileInVerity(int fd) {
     return (flags & FS_VERITY_FL) != 0;
 }
 
+namespace {
+
+std::atomic<unsigned int> gFsVerityThreadCount{0};
+
+template <typename Fn> void* runWorker(void* worker) {
+    (*static_cast<const Fn*>(worker))();
+    return nullptr;
+}
+
+// Runs worker on up to gFsVerityThreadCount threads, but on no more than maxThreads, including the
+// calling thread. Returns once all of them have returned. The workers must share their work, as
+// the threads that could be started, possibly only the calling one, are left to do all of it.
+template <typename Fn> void runOnThreads(size_t maxThreads, const Fn& worker) {
+    unsigned int threadCount = gFsVerityThreadCount;
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadCount = std::min<size_t>(threadCount, maxThreads);
+
+    std::vector<pthread_t> threads;
+    for (unsigned int i = 1; i < threadCount; ++i) {
+        pthread_t thread;
+        int error = pthread_create(&thread, nullptr, runWorker<Fn>,
+                                   const_cast<void*>(static_cast<const void*>(&worker)));
+        if (error != 0) {
+            LOG(WARNING) << "Could not start thread, continuing on " << threads.size() + 1
+                         << " threads: " << strerror(error);
+            break;
+        }
+        threads.push_back(thread);
+    }
+    worker();
+    for (pthread_t thread : threads) {
+        pthread_join(thread, nullptr);
+    }
+}
+
+// Runs processFile on every file in files, on up to gFsVerityThreadCount threads. The result for
+// files[i] is stored in results[i]. Once a file fails, files that come after it are skipped, but
+// files that come before it are still processed, so that the first failure in files order is the
+// same no matter how the work was scheduled.
+template <typename T, typename File, typename Fn>
+std::vector<std::optional<Result<T>>> processFilesInParallel(const std::vector<File>& files,
+                                                             Fn processFile) {
+    std::vector<std::optional<Result<T>>> results(files.size());
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> firstFailure{files.size()};
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            if (i > firstFailure) {
+                continue;
+            }
+            results[i] = processFile(files[i]);
+            if (!results[i]->ok()) {
+                size_t failure = firstFailure;
+                while (i < failure && !firstFailure.compare_exchange_weak(failure, i)) {
+                }
+            }
+        }
+    };
+
+    runOnThreads(files.size(), worker);
+    return results;
+}
+
+// Returns the error of the first file that failed, if any.
+template <typename T>
+Result<void> firstError(const std::vector<std::optional<Result<T>>>& results) {
+    for (const auto& result : results) {
+        if (result && !result->ok()) {
+            return result->error();
+        }
+    }
+    return {};
+}
+
+}  // namespace
+
+void setFsVerityThreadCount(unsigned int count) {
+    gFsVerityThreadCount = count;
+}
+
+namespace {
+
+constexpr size_t kFsVerityBlockSize = 4096;
+constexpr uint8_t kFsVerityLogBlockSize = 12;
+// Number of data blocks hashed as one unit of work by createDigests.
+constexpr size_t kBlocksPerChunk = 256;
+
+// struct fsverity_descriptor from the kernel's fs-verity documentation. The fs-verity digest of
+// a file is the hash of this structure.
+struct __attribute__((packed)) FsVerityDescriptor {
+    uint8_t version;
+    uint8_t hash_algorithm;
+    uint8_t log_blocksize;
+    uint8_t salt_size;
+    __le32 sig_size;
+    __le64 data_size;
+    uint8_t root_hash[64];
+    uint8_t salt[32];
+    uint8_t reserved[144];
+};
+static_assert(sizeof(FsVerityDescriptor) == 256);
+
+// Hashes one block of a Merkle tree, padding data to the block size with zeros.
+void hashBlock(const uint8_t* data, size_t size, uint8_t* out) {
+    static const uint8_t kZeros[kFsVerityBlockSize] = {};
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, data, size);
+    SHA256_Update(&ctx, kZeros, kFsVerityBlockSize - size);
+    SHA256_Final(out, &ctx);
+}
+
+// Computes the fs-verity digest of a file of size dataSize from the hashes of its data blocks.
+std::vector<uint8_t> digestFromLeafHashes(std::vector<uint8_t> hashes, uint64_t dataSize) {
+    // Each level of the tree is the hashes of the blocks of the level below, until a single
+    // hash is left. That hash is the root hash. It is all zeros for an empty file.
+    while (hashes.size() > SHA256_DIGEST_LENGTH) {
+        size_t blocks = (hashes.size() + kFsVerityBlockSize - 1) / kFsVerityBlockSize;
+        std::vector<uint8_t> next(blocks * SHA256_DIGEST_LENGTH);
+        for (size_t i = 0; i < blocks; ++i) {
+            size_t offset = i * kFsVerityBlockSize;
+            hashBlock(&hashes[offset], std::min(kFsVerityBlockSize, hashes.size() - offset),
+                      &next[i * SHA256_DIGEST_LENGTH]);
+        }
+        hashes = std::move(next);
+    }
+
+    FsVerityDescriptor descriptor = {};
+    descriptor.version = 1;
+    descriptor.hash_algorithm = FS_VERITY_HASH_ALG_SHA256;
+    descriptor.log_blocksize = kFsVerityLogBlockSize;
+    descriptor.data_size = __cpu_to_le64(dataSize);
+    std::copy(hashes.begin(), hashes.end(), descriptor.root_hash);
+
+    std::vector<uint8_t> digest(SHA256_DIGEST_LENGTH);
+    SHA256(reinterpret_cast<const uint8_t*>(&descriptor), sizeof(descriptor), digest.data());
+    return digest;
+}
+
+// A file whose digest is being computed by createDigests. The file is opened and mapped when the
+// first chunk of it is claimed, and unmapped when the last chunk of it has been hashed, so that
+// only the files currently being worked on take up file descriptors and address space.
+struct DigestJob {
+    std::filesystem::path path;
+    uint64_t size = 0;
+    size_t blocks = 0;
+
+    std::once_flag mapOnce;
+    const uint8_t* data = nullptr;
+    // The step that failed and its errno, if opening or mapping the file failed.
+    const char* failedStep = nullptr;
+    int failedErrno = 0;
+    std::atomic<size_t> chunksLeft{0};
+
+    std::vector<uint8_t> leafHashes;
+    std::vector<uint8_t> digest;
+
+    ~DigestJob() { unmap(); }
+
+    void map() {
+        unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (!fd.ok()) {
+            fail("Unable to open");
+            return;
+        }
+        // The chunks were scheduled from the size the file had when it was listed.
+        struct stat filestat;
+        if (fstat(fd.get(), &filestat) < 0) {
+            fail("Failed to fstat");
+            return;
+        }
+        if (static_cast<uint64_t>(filestat.st_size) != size) {
+            errno = EBUSY;
+            fail("File changed size");
+            return;
+        }
+        // The mapping stays valid after fd is closed.
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+        if (mapped == MAP_FAILED) {
+            fail("Failed to mmap");
+        } else {
+            data = static_cast<const uint8_t*>(mapped);
+        }
+    }
+
+    void fail(const char* step) {
+        failedStep = step;
+        failedErrno = errno;
+    }
+
+    void unmap() {
+        if (data != nullptr) {
+            munmap(const_cast<uint8_t*>(data), size);
+            data = nullptr;
+        }
+    }
+};
+
+}  // namespace
+
+Result<std::map<std::string, std::vector<uint8_t>>>
+createDigests(const std::vector<std::string>& paths) {
+    std::vector<DigestJob> jobs(paths.size());
+    // (job, first block) of every chunk, in the order of the files.
+    std::vector<std::pair<size_t, size_t>> chunks;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        auto& job = jobs[i];
+        job.path = paths[i];
+        // Only the size is needed to schedule the chunks; the file is opened once a worker
+        // claims its first chunk.
+        struct stat filestat;
+        if (stat(paths[i].c_str(), &filestat) < 0) {
+            return ErrnoError() << "Failed to compute digest for " << job.path
+                                << ": Failed to stat";
+        }
+        job.size = filestat.st_size;
+        job.blocks = (job.size + kFsVerityBlockSize - 1) / kFsVerityBlockSize;
+        job.leafHashes.resize(job.blocks * SHA256_DIGEST_LENGTH);
+        for (size_t block = 0; block < job.blocks; block += kBlocksPerChunk) {
+            chunks.emplace_back(i, block);
+            ++job.chunksLeft;
+        }
+        if (job.blocks == 0) {
+            job.digest = digestFromLeafHashes({}, 0);
+        }
+    }
+
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < chunks.size(); i = next++) {
+            auto& job = jobs[chunks[i].first];
+            std::call_once(job.mapOnce, [&job] { job.map(); });
+            if (job.data != nullptr) {
+                size_t end = std::min(chunks[i].second + kBlocksPerChunk, job.blocks);
+                for (size_t block = chunks[i].second; block < end; ++block) {
+                    size_t offset = block * kFsVerityBlockSize;
+                    hashBlock(job.data + offset, std::min<uint64_t>(kFsVerityBlockSize,
+                                                                    job.size - offset),
+                              &job.leafHashes[block * SHA256_DIGEST_LENGTH]);
+                }
+            }
+            // The upper levels are small, so the thread that hashes the last chunk of a file
+            // builds them.
+            if (--job.chunksLeft == 0) {
+                job.unmap();
+                if (job.failedStep == nullptr) {
+                    job.digest = digestFromLeafHashes(std::move(job.leafHashes), job.size);
+                }
+            }
+        }
+    };
+    runOnThreads(chunks.size(), worker);
+
+    std::map<std::string, std::vector<uint8_t>> digests;
+    for (auto& job : jobs) {
+        if (job.failedStep != nullptr) {
+            errno = job.failedErrno;
+            return ErrnoError() << "Failed to compute digest for " << job.path << ": "
+                                << job.failedStep;
+        }
+        digests[job.path] = std::move(job.digest);
+    }
+    return digests;
+}
+
 Result<std::map<std::string, std::string>> addFilesToVerityRecursive(const std::string& path) {
-    std::map<std::string, std::string> digests;
+    std::vector<std::filesystem::path> files;
 
     std::error_code ec;
     auto it = std::filesystem::recursive_directory_iterator(path, ec);
     for (auto end = std::filesystem::recursive_directory_iterator(); it != end; it.increment(ec)) {
         if (it->is_regular_file()) {
-            unique_fd fd(TEMP_FAILURE_RETRY(open(it->path().c_str(), O_RDONLY | O_CLOEXEC)));
+            files.push_back(it->path());
+        }
+    }
+    if (ec) {
+        return Error() << "Failed to iterate " << path << ": " << ec.message();
+    }
+
+    auto results = processFilesInParallel<std::string>(
+        files, [&path](const std::filesystem::path& file) -> Result<std::string> {
+            unique_fd fd(TEMP_FAILURE_RETRY(open(file.c_str(), O_RDONLY | O_CLOEXEC)));
             if (!fd.ok()) {
                 return ErrnoError() << "Failed to open " << path;
             }
             auto enabled = OR_RETURN(isFileInVerity(fd));
             if (!enabled) {
-                LOG(INFO) << "Adding " << it->path() << " to fs-verity...";
+                LOG(INFO) << "Adding " << file << " to fs-verity...";
                 OR_RETURN(enableFsVerity(fd));
             } else {
-                LOG(INFO) << it->path() << " was already in fs-verity.";
+                LOG(INFO) << file << " was already in fs-verity.";
             }
-            auto digest = OR_RETURN(measureFsVerity(fd));
-            digests[it->path()] = digest;
+            return measureFsVerity(fd);
+        });
+    OR_RETURN(firstError(results));
+
+    std::map<std::string, std::string> digests;
+    for (size_t i = 0; i < files.size(); ++i) {
+        digests[files[i]] = **results[i];
+    }
+    return digests;
+}
+
+Result<std::map<std::string, std::string>> verifyAllFilesInVerity(const std::string& path) {
+    std::vector<std::filesystem::path> files;
+    // An entry that is rejected while walking the tree. It is reported only if none of the files
+    // before it failed, as if the files had been checked while walking.
+    Result<void> walkResult;
+    std::error_code ec;
+
+    auto it = std::filesystem::recursive_directory_iterator(path, ec);
+    auto end = std::filesystem::recursive_directory_iterator();
+
+    while (!ec && it != end) {
+        if (it->is_regular_file()) {
+            files.push_back(it->path());
+        } else if (it->is_directory()) {
+            // These are fine to ignore
+        } else if (it->is_symlink()) {
+            walkResult = Error() << "Rejecting artifacts, symlink at " << it->path();
+            break;
+        } else {
+            walkResult = Error() << "Rejecting artifacts, unexpected file type for " << it->path();
+            break;
         }
+        ++it;
     }
+
+    auto results = processFilesInParallel<std::string>(
+        files, [](const std::filesystem::path& file) -> Result<std::string> {
+            // Verify the file is in fs-verity
+            return measureFsVerity(file);
+        });
+    OR_RETURN(firstError(results));
+    OR_RETURN(walkResult);
     if (ec) {
-        return Error() << "Failed to iterate " << path << ": " << ec.message();
+        return Error() << "Failed to iterate " << path << ": " << ec;
     }
 
+    std::map<std::string, std::string> digests;
+    for (size_t i = 0; i < files.size(); ++i) {
+        digests[files[i]] = **results[i];
+    }
     return digests;
 }
 
-Result<std::map<std::string, std::string>> verifyAllFilesInVerity(const std::string& path) {
-    std::map<std::string, std::string> digests;
+Result<size_t> verifyAllFilesAgainstDigestTable(const std::string& path, const DigestTable& table,
+                                                bool supportsFsVerity) {
+    struct File {
+        std::string path;
+        DigestTable::Entry trusted;
+    };
+    std::vector<std::string> paths;
+    // An entry that is rejected while walking the tree. Without fs-verity, entries other than
+    // regular files are ignored, like computeDigests does.
+    Result<void> walkResult;
     std::error_code ec;
 
     auto it = std::filesystem::recursive_directory_iterator(path, ec);
@@ -214,70 +560,138 @@ Result<std::map<std::string, std::string>> verifyAllFilesInVerity(const std::str
 
     while (!ec && it != end) {
         if (it->is_regular_file()) {
-            // Verify the file is in fs-verity
-            auto result = OR_RETURN(measureFsVerity(it->path()));
-            digests[it->path()] = result;
-        } else if (it->is_directory()) {
+            paths.push_back(it->path());
+        } else if (it->is_directory() || !supportsFsVerity) {
             // These are fine to ignore
         } else if (it->is_symlink()) {
-            return Error() << "Rejecting artifacts, symlink at " << it->path();
+            walkResult = Error() << "Rejecting artifacts, symlink at " << it->path();
+            break;
         } else {
-            return Error() << "Rejecting artifacts, unexpected file type for " << it->path();
+            walkResult = Error() << "Rejecting artifacts, unexpected file type for " << it->path();
+            break;
         }
         ++it;
     }
+    // The artifacts are rejected either way, so don't spend time measuring them.
+    OR_RETURN(walkResult);
     if (ec) {
         return Error() << "Failed to iterate " << path << ": " << ec;
     }
 
-    return digests;
+    // Both the walked paths and the table are sorted, so a single pass finds the entry of every
+    // file.
+    std::sort(paths.begin(), paths.end());
+    std::vector<File> files;
+    files.reserve(paths.size());
+    size_t next = 0;
+    for (const auto& filePath : paths) {
+        while (next < table.size() && table.entry(next).path < filePath) {
+            ++next;
+        }
+        if (next == table.size() || table.entry(next).path != filePath) {
+            return Error() << "Couldn't find digest for " << filePath;
+        }
+        files.push_back({filePath, table.entry(next)});
+    }
+
+    auto matches = [](const std::vector<uint8_t>& digest, const DigestTable::Entry& entry) {
+        return std::equal(digest.begin(), digest.end(), entry.digest.begin(), entry.digest.end());
+    };
+
+    if (supportsFsVerity) {
+        auto results =
+            processFilesInParallel<void>(files, [&matches](const File& file) -> Result<void> {
+                unique_fd fd(TEMP_FAILURE_RETRY(open(file.path.c_str(), O_RDONLY | O_CLOEXEC)));
+                if (!fd.ok()) {
+                    return ErrnoError() << "Failed to open " << file.path;
+                }
+                // Measuring fails if the file is not in fs-verity.
+                auto digest = OR_RETURN(measureFsVerityRaw(fd));
+                if (!matches(digest, file.trusted)) {
+                    return Error() << "Digest mismatch for " << file.path;
+                }
+                return {};
+            });
+        OR_RETURN(firstError(results));
+    } else {
+        // Without fs-verity, every digest has to be recomputed.
+        auto digests = OR_RETURN(createDigests(paths));
+        for (const auto& file : files) {
+            if (!matches(digests[file.path], file.trusted)) {
+                return Error() << "Digest mismatch for " << file.path;
+            }
+        }
+    }
+
+    if (!files.empty()) {
+        LOG(INFO) << "All root hashes match.";
+    }
+    return files.size();
 }
 
 Result<void> verifyAllFilesUsingCompOs(const std::string& directory_path,
                                        const std::map<std::string, std::string>& digests) {
+    struct File {
+        std::filesystem::path path;
+        const std::string* compos_digest;
+    };
+    std::vector<File> files;
+    // An entry that is rejected while walking the tree.
+    Result<void> walkResult;
     std::error_code ec;
-    size_t verified_count = 0;
     auto it = std::filesystem::recursive_directory_iterator(directory_path, ec);
     for (auto end = std::filesystem::recursive_directory_iterator(); it != end; it.increment(ec)) {
         auto& path = it->path();
         if (it->is_regular_file()) {
             auto entry = digests.find(path);
             if (entry == digests.end()) {
-                return Error() << "Unexpected file found: " << path;
-            }
-            auto& compos_digest = entry->second;
-
-            unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
-            if (!fd.ok()) {
-                return ErrnoError() << "Can't open " << path;
-            }
-
-            bool enabled = OR_RETURN(isFileInVerity(fd));
-            if (!enabled) {
-                LOG(INFO) << "Enabling fs-verity for " << path;
-                OR_RETURN(enableFsVerity(fd));
-            }
-
-            auto actual_digest = OR_RETURN(measureFsVerity(fd));
-            // Make sure the file's fs-verity digest matches the known value.
-            if (actual_digest == compos_digest) {
-                ++verified_count;
-            } else {
-                return Error() << "fs-verity digest does not match CompOS digest: " << path;
+                walkResult = Error() << "Unexpected file found: " << path;
+                break;
             }
+            files.push_back({path, &entry->second});
         } else if (it->is_directory()) {
             // These are fine to ignore
         } else if (it->is_symlink()) {
-            return Error() << "Rejecting artifacts, symlink at " << path;
+            walkResult = Error() << "Rejecting artifacts, symlink at " << path;
+            break;
         } else {
-            return Error() << "Rejecting artifacts, unexpected file type for " << path;
+            walkResult = Error() << "Rejecting artifacts, unexpected file type for " << path;
+            break;
         }
     }
+
+    // Rejected artifacts are not worth enabling fs-verity on.
+    OR_RETURN(walkResult);
     if (ec) {
         return Error() << "Failed to iterate " << directory_path << ": " << ec.message();
     }
 
+    // The digest is checked as part of processing each file, so that a mismatch stops the
+    // scheduling of the files after it and fs-verity is not enabled on them.
+    auto results = processFilesInParallel<void>(files, [](const File& file) -> Result<void> {
+        const auto& path = file.path;
+        unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (!fd.ok()) {
+            return ErrnoError() << "Can't open " << path;
+        }
+
+        bool enabled = OR_RETURN(isFileInVerity(fd));
+        if (!enabled) {
+            LOG(INFO) << "Enabling fs-verity for " << path;
+            OR_RETURN(enableFsVerity(fd));
+        }
+
+        auto actual_digest = OR_RETURN(measureFsVerity(fd));
+        // Make sure the file's fs-verity digest matches the known value.
+        if (actual_digest != *file.compos_digest) {
+            return Error() << "fs-verity digest does not match CompOS digest: " << path;
+        }
+        return {};
+    });
+    OR_RETURN(firstError(results));
+
     // Make sure all the files we expected have been seen
+    size_t verified_count = files.size();
     if (verified_count != digests.size()) {
         return Error() << "Verified " << verified_count << " files, but expected "
                        << digests.size();
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/result.h>
+
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+
+// A compact binary form of the artifact digests.
+//
+// The file starts with a header, followed by one fixed-size entry per artifact, sorted by path,
+// followed by a table holding the paths of all entries. Entries refer to their path by offset
+// into that table. Digests are stored as raw SHA-256 bytes.
+class DigestTable {
+  public:
+    static constexpr size_t kDigestSize = 32;
+
+    struct Entry {
+        std::string_view path;
+        std::span<const uint8_t, kDigestSize> digest;
+    };
+
+    // Serializes digests, which maps paths to hex digests.
+    static android::base::Result<std::string>
+    serialize(const std::map<std::string, std::string>& digests);
+
+    // Validates the serialized table in data and takes ownership of it. The signature of data
+    // must be verified before calling this, so that the table is parsed from the same bytes that
+    // were verified.
+    static android::base::Result<DigestTable> parse(std::string data);
+
+    size_t size() const { return mEntryCount; }
+    Entry entry(size_t i) const;
+
+  private:
+    DigestTable(std::string data, size_t entryCount)
+        : mData(std::move(data)), mEntryCount(entryCount) {}
+
+    std::string mData;
+    size_t mEntryCount;
+};
@@ -24,11 +24,32 @@
 
 android::base::Result<void> addCertToFsVerityKeyring(const std::string& path, const char* keyName);
 android::base::Result<std::vector<uint8_t>> createDigest(const std::string& path);
-android::base::Result<std::string> enableFsVerity(int fd);
+
+// Computes the same digests as createDigest for all the given files. The files are memory-mapped
+// and their data blocks are hashed in parallel, across and within files, on the threads set by
+// setFsVerityThreadCount. The result maps each path to its digest.
+android::base::Result<std::map<std::string, std::vector<uint8_t>>>
+createDigests(const std::vector<std::string>& paths);
 bool SupportsFsVerity();
+
+// Sets the number of threads that addFilesToVerityRecursive, verifyAllFilesInVerity and
+// verifyAllFilesUsingCompOs use to enable and measure fs-verity. Errors are reported the same
+// way regardless of the count. 0, the default, uses one thread per CPU; 1 processes one file at
+// a time.
+void setFsVerityThreadCount(unsigned int count);
 android::base::Result<std::map<std::string, std::string>>
 verifyAllFilesInVerity(const std::string& path);
 
+class DigestTable;
+
+// Verifies the files under path against table, which holds their trusted digests. The sorted
+// directory walk is merged with the table in a single pass. With fs-verity, the measured digest of
+// every file is compared with the table; without it, all digests are recomputed with
+// createDigests. Returns the number of files verified.
+android::base::Result<size_t> verifyAllFilesAgainstDigestTable(const std::string& path,
+                                                               const DigestTable& table,
+                                                               bool supportsFsVerity);
+
 // Note that this function will skip files that are already in fs-verity, and
 // for those files it will return the existing digest.
 android::base::Result<std::map<std::string, std::string>>
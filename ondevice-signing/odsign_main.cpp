@@ -14,12 +14,13 @@
  * limitations under the License.
  */
 
+#include <chrono>
 #include <fcntl.h>
 #include <filesystem>
-#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <optional>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -32,6 +33,7 @@
 #include <odrefresh/odrefresh.h>
 
 #include "CertUtils.h"
+#include "DigestTable.h"
 #include "KeystoreKey.h"
 #include "StatsReporter.h"
 #include "VerityUtils.h"
@@ -55,6 +57,8 @@ constexpr int kKeyNspace = 101;  // odsign_key
 const std::string kSigningKeyCert = "/data/misc/odsign/key.cert";
 const std::string kOdsignInfo = "/data/misc/odsign/odsign.info";
 const std::string kOdsignInfoSignature = "/data/misc/odsign/odsign.info.signature";
+const std::string kOdsignDigests = "/data/misc/odsign/odsign.digests";
+const std::string kOdsignDigestsSignature = "/data/misc/odsign/odsign.digests.signature";
 
 const std::string kArtArtifactsDir = "/data/misc/apexdata/com.android.art/dalvik-cache";
 
@@ -82,6 +86,9 @@ constexpr const char* kOdsignVerificationStatusError = "0";
 
 constexpr const char* kStopServiceProp = "ctl.stop";
 
+// Number of threads used to enable and measure fs-verity, see setFsVerityThreadCount.
+constexpr const char* kOdsignVerityThreadsProp = "odsign.verity.threads";
+
 enum class CompOsInstance { kCurrent, kPending };
 
 namespace {
@@ -179,19 +186,14 @@ Result<void> createX509RootCert(const SigningKey& key, const std::string& outPat
 
 Result<std::map<std::string, std::string>> computeDigests(const std::string& path) {
     std::error_code ec;
-    std::map<std::string, std::string> digests;
+    std::vector<std::string> files;
 
     auto it = std::filesystem::recursive_directory_iterator(path, ec);
     auto end = std::filesystem::recursive_directory_iterator();
 
     while (!ec && it != end) {
         if (it->is_regular_file()) {
-            auto digest = createDigest(it->path());
-            if (!digest.ok()) {
-                return Error() << "Failed to compute digest for " << it->path() << ": "
-                               << digest.error();
-            }
-            digests[it->path()] = toHex(*digest);
+            files.push_back(it->path());
         }
         ++it;
     }
@@ -199,6 +201,11 @@ Result<std::map<std::string, std::string>> computeDigests(const std::string& pat
         return Error() << "Failed to iterate " << path << ": " << ec;
     }
 
+    auto fileDigests = OR_RETURN(createDigests(files));
+    std::map<std::string, std::string> digests;
+    for (const auto& [file, digest] : fileDigests) {
+        digests[file] = toHex(digest);
+    }
     return digests;
 }
 
@@ -242,91 +249,161 @@ Result<void> verifyIntegrityNoFsVerity(const std::map<std::string, std::string>&
     return verifyDigests(*result, trusted_digests);
 }
 
+int64_t microsecondsSince(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
 Result<OdsignInfo> getAndVerifyOdsignInfo(const SigningKey& key) {
     std::string persistedSignature;
     OdsignInfo odsignInfo;
 
+    // Read the file once; the signature is verified over, and the proto parsed from, the same
+    // buffer.
+    auto start = std::chrono::steady_clock::now();
     if (!android::base::ReadFileToString(kOdsignInfoSignature, &persistedSignature)) {
         return ErrnoError() << "Failed to read " << kOdsignInfoSignature;
     }
-
-    std::fstream odsign_info(kOdsignInfo, std::ios::in | std::ios::binary);
-    if (!odsign_info) {
-        return Error() << "Failed to open " << kOdsignInfo;
+    std::string odsign_info_str;
+    if (!android::base::ReadFileToString(kOdsignInfo, &odsign_info_str)) {
+        return ErrnoError() << "Failed to read " << kOdsignInfo;
     }
-    odsign_info.seekg(0);
-    // Verify the hash
-    std::string odsign_info_str((std::istreambuf_iterator<char>(odsign_info)),
-                                std::istreambuf_iterator<char>());
+    int64_t read_us = microsecondsSince(start);
 
+    start = std::chrono::steady_clock::now();
     auto publicKey = key.getPublicKey();
     auto signResult = verifySignature(odsign_info_str, persistedSignature, *publicKey);
+    int64_t verify_us = microsecondsSince(start);
     if (!signResult.ok()) {
         return Error() << kOdsignInfoSignature << " does not match.";
     } else {
         LOG(INFO) << kOdsignInfoSignature << " matches.";
     }
 
-    odsign_info.seekg(0);
-    if (!odsignInfo.ParseFromIstream(&odsign_info)) {
+    start = std::chrono::steady_clock::now();
+    bool parsed = odsignInfo.ParseFromString(odsign_info_str);
+    int64_t parse_us = microsecondsSince(start);
+    if (!parsed) {
         return Error() << "Failed to parse " << kOdsignInfo;
     }
 
-    LOG(INFO) << "Loaded " << kOdsignInfo;
+    LOG(INFO) << "Loaded " << kOdsignInfo << " (" << odsign_info_str.size() << " bytes): read "
+              << read_us << "us, verify " << verify_us << "us, parse " << parse_us << "us";
     return odsignInfo;
 }
 
-std::map<std::string, std::string> getTrustedDigests(const SigningKey& key) {
-    std::map<std::string, std::string> trusted_digests;
+Result<DigestTable> getAndVerifyDigestTable(const SigningKey& key) {
+    std::string persistedSignature;
+    if (!android::base::ReadFileToString(kOdsignDigestsSignature, &persistedSignature)) {
+        return ErrnoError() << "Failed to read " << kOdsignDigestsSignature;
+    }
 
+    // Like odsign.info, the table is read once into memory; the signature is verified over, and
+    // the table parsed from, that same buffer.
+    std::string table_str;
+    if (!android::base::ReadFileToString(kOdsignDigests, &table_str)) {
+        return ErrnoError() << "Failed to read " << kOdsignDigests;
+    }
+    auto publicKey = key.getPublicKey();
+    auto signResult = verifySignature(table_str, persistedSignature, *publicKey);
+    if (!signResult.ok()) {
+        return Error() << kOdsignDigestsSignature << " does not match.";
+    }
+
+    auto table = DigestTable::parse(std::move(table_str));
+    if (!table.ok()) {
+        return Error() << "Failed to parse " << kOdsignDigests << ": " << table.error();
+    }
+    LOG(INFO) << "Loaded " << kOdsignDigests;
+    return std::move(*table);
+}
+
+OdsignInfo getTrustedInfo(const SigningKey& key) {
     if (access(kOdsignInfo.c_str(), F_OK) != 0) {
         // no odsign info file, which is not necessarily an error - just return
         // an empty list of digests.
         LOG(INFO) << kOdsignInfo << " not found.";
-        return trusted_digests;
+        return {};
     }
     auto signInfo = getAndVerifyOdsignInfo(key);
 
-    if (signInfo.ok()) {
-        trusted_digests.insert(signInfo->file_hashes().begin(), signInfo->file_hashes().end());
-    } else {
+    if (!signInfo.ok()) {
         // This is not expected, since the file did exist. Log an error and
         // return an empty list of digests.
         LOG(ERROR) << "Couldn't load trusted digests: " << signInfo.error();
+        return {};
     }
 
-    return trusted_digests;
+    return std::move(*signInfo);
+}
+
+Result<void> persistDigestTable(const std::map<std::string, std::string>& digests,
+                                const SigningKey& key) {
+    auto table = OR_RETURN(DigestTable::serialize(digests));
+    auto signResult = key.sign(table);
+    if (!signResult.ok()) {
+        return Error() << "Failed to sign " << kOdsignDigests;
+    }
+    // Write the signature last, so that a table is never accepted without its matching signature.
+    if (!android::base::WriteStringToFile(table, kOdsignDigests) ||
+        !android::base::WriteStringToFile(*signResult, kOdsignDigestsSignature)) {
+        return ErrnoError() << "Failed to persist " << kOdsignDigests;
+    }
+    return {};
 }
 
 Result<void> persistDigests(const std::map<std::string, std::string>& digests,
                             const SigningKey& key) {
+    // Remove the digest table first; if anything below fails, the next boot must not accept a
+    // table that doesn't match odsign.info.
+    if (unlink(kOdsignDigestsSignature.c_str()) != 0 && errno != ENOENT) {
+        return ErrnoError() << "Failed to remove " << kOdsignDigestsSignature;
+    }
+    unlink(kOdsignDigests.c_str());
+
     OdsignInfo signInfo;
     google::protobuf::Map<std::string, std::string> proto_hashes(digests.begin(), digests.end());
     auto map = signInfo.mutable_file_hashes();
     *map = proto_hashes;
 
-    std::fstream odsign_info(kOdsignInfo,
-                             std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
-    if (!signInfo.SerializeToOstream(&odsign_info)) {
+    std::string odsign_info_str;
+    if (!signInfo.SerializeToString(&odsign_info_str) ||
+        !android::base::WriteStringToFile(odsign_info_str, kOdsignInfo)) {
         return Error() << "Failed to persist root hashes in " << kOdsignInfo;
     }
 
-    // Sign the signatures with our key itself, and write that to storage
-    odsign_info.seekg(0, std::ios::beg);
-    std::string odsign_info_str((std::istreambuf_iterator<char>(odsign_info)),
-                                std::istreambuf_iterator<char>());
+    // Sign the serialized digests with our key itself, and write that to storage
     auto signResult = key.sign(odsign_info_str);
     if (!signResult.ok()) {
         return Error() << "Failed to sign " << kOdsignInfo;
     }
     android::base::WriteStringToFile(*signResult, kOdsignInfoSignature);
+
+    // odsign.info stays the source of truth, so failing to write the table is not fatal; the next
+    // boot falls back to odsign.info.
+    auto tableStatus = persistDigestTable(digests, key);
+    if (!tableStatus.ok()) {
+        LOG(WARNING) << tableStatus.error();
+    }
     return {};
 }
 
-Result<void> verifyArtifactsIntegrity(const std::map<std::string, std::string>& trusted_digests,
-                                      bool supportsFsVerity) {
-    Result<void> integrityStatus;
+// Verifies the artifacts against trusted_table if it is set, and against trusted_info otherwise.
+Result<void> verifyArtifactsIntegrity(const std::optional<DigestTable>& trusted_table,
+                                      const OdsignInfo& trusted_info, bool supportsFsVerity) {
+    auto start = std::chrono::steady_clock::now();
 
+    if (trusted_table) {
+        auto files = OR_RETURN(verifyAllFilesAgainstDigestTable(kArtArtifactsDir, *trusted_table,
+                                                                supportsFsVerity));
+        LOG(INFO) << "Verified " << files << " artifacts against " << kOdsignDigests << " in "
+                  << microsecondsSince(start) << "us";
+        return {};
+    }
+
+    std::map<std::string, std::string> trusted_digests(trusted_info.file_hashes().begin(),
+                                                       trusted_info.file_hashes().end());
+    Result<void> integrityStatus;
     if (supportsFsVerity) {
         integrityStatus = verifyIntegrityFsVerity(trusted_digests);
     } else {
@@ -335,7 +412,8 @@ Result<void> verifyArtifactsIntegrity(const std::map<std::string, std::string>&
     if (!integrityStatus.ok()) {
         return integrityStatus.error();
     }
-
+    LOG(INFO) << "Verified artifacts against " << kOdsignInfo << " in " << microsecondsSince(start)
+              << "us";
     return {};
 }
 
@@ -490,6 +568,8 @@ int main(int /* argc */, char** argv) {
     auto stats_reporter = std::make_unique<StatsReporter>();
     StatsReporter::OdsignRecord* odsign_record = stats_reporter->GetOdsignRecord();
 
+    setFsVerityThreadCount(android::base::GetUintProperty(kOdsignVerityThreadsProp, 0u));
+
     if (!android::base::GetBoolProperty("ro.apex.updatable", false)) {
         LOG(INFO) << "Device doesn't support updatable APEX, exiting.";
         stats_reporter->SetOdsignRecordEnabled(false);
@@ -550,7 +630,16 @@ int main(int /* argc */, char** argv) {
         // also if odrefresh said that a recompile is required. In the latter
         // case, odrefresh may use partial compilation, and leave some
         // artifacts unchanged.
-        auto trusted_digests = getTrustedDigests(*key);
+        // Prefer the digest table, which is cheaper to load; odsign.info is only read if the table
+        // is missing or invalid, for example because it was written by an older version.
+        std::optional<DigestTable> trusted_table;
+        OdsignInfo trusted_info;
+        if (auto table = getAndVerifyDigestTable(*key); table.ok()) {
+            trusted_table.emplace(std::move(*table));
+        } else {
+            LOG(INFO) << "Not using digest table: " << table.error();
+            trusted_info = getTrustedInfo(*key);
+        }
 
         if (odrefresh_status == art::odrefresh::ExitCode::kOkay) {
             // Tell init we're done with the key; this is a boot time optimization
@@ -565,7 +654,8 @@ int main(int /* argc */, char** argv) {
             SetProperty(kOdsignKeyDoneProp, "1");
         }
 
-        auto verificationResult = verifyArtifactsIntegrity(trusted_digests, supportsFsVerity);
+        auto verificationResult =
+            verifyArtifactsIntegrity(trusted_table, trusted_info, supportsFsVerity);
         if (!verificationResult.ok()) {
             int num_removed = removeDirectory(kArtArtifactsDir);
             if (num_removed == 0) {
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+#include "VerityUtils.h"
+
+namespace {
+
+// Must be on a filesystem with fs-verity enabled.
+const std::string kArtifactsDir = "/data/local/tmp/odsign_benchmark/dalvik-cache";
+
+struct Artifact {
+    const char* suffix;
+    size_t size;
+};
+
+// Roughly the shape of a dalvik-cache: a boot image and the system server jars, each with an
+// .art, .oat and .vdex file.
+constexpr int kBootImageJars = 12;
+constexpr int kSystemServerJars = 10;
+constexpr Artifact kBootImageArtifacts[] = {
+    {".art", 512 * 1024}, {".oat", 2 * 1024 * 1024}, {".vdex", 1024 * 1024}};
+constexpr Artifact kSystemServerArtifacts[] = {
+    {".art", 1024 * 1024}, {".odex", 4 * 1024 * 1024}, {".vdex", 2 * 1024 * 1024}};
+
+size_t createArtifacts() {
+    std::filesystem::remove_all(kArtifactsDir);
+    std::filesystem::create_directories(kArtifactsDir + "/arm64");
+
+    std::mt19937 rng(42);
+    size_t total = 0;
+    auto write = [&](const std::string& path, size_t size) {
+        std::string data(size, '\0');
+        for (auto& c : data) {
+            c = static_cast<char>(rng());
+        }
+        android::base::WriteStringToFile(data, path);
+        total += size;
+    };
+    for (int i = 0; i < kBootImageJars; ++i) {
+        for (const auto& artifact : kBootImageArtifacts) {
+            write(kArtifactsDir + "/arm64/boot-" + std::to_string(i) + artifact.suffix,
+                  artifact.size);
+        }
+    }
+    for (int i = 0; i < kSystemServerJars; ++i) {
+        for (const auto& artifact : kSystemServerArtifacts) {
+            write(kArtifactsDir + "/arm64/system@framework@service-" + std::to_string(i) +
+                      ".jar@classes" + artifact.suffix,
+                  artifact.size);
+        }
+    }
+    sync();
+    return total;
+}
+
+// Wall time of the serial run, as the baseline for boot_time_saved_ms.
+double gSerialMs = 0;
+
+// Measures addFilesToVerityRecursive on a freshly written artifacts directory, as odsign runs it
+// after odrefresh compiled new artifacts. range(0) is the thread count, 0 meaning one per CPU.
+void BM_AddFilesToVerity(benchmark::State& state) {
+    if (!SupportsFsVerity()) {
+        state.SkipWithError("fs-verity is not supported");
+        return;
+    }
+    setFsVerityThreadCount(state.range(0));
+
+    size_t bytes = 0;
+    double totalMs = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        bytes = createArtifacts();
+        state.ResumeTiming();
+
+        auto start = std::chrono::steady_clock::now();
+        auto digests = addFilesToVerityRecursive(kArtifactsDir);
+        totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                             start)
+                       .count();
+        if (!digests.ok()) {
+            state.SkipWithError(digests.error().message().c_str());
+            break;
+        }
+    }
+
+    double meanMs = totalMs / state.iterations();
+    if (state.range(0) == 1) {
+        gSerialMs = meanMs;
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+    if (gSerialMs > 0) {
+        state.counters["boot_time_saved_ms"] = gSerialMs - meanMs;
+    }
+    std::filesystem::remove_all(kArtifactsDir);
+}
+BENCHMARK(BM_AddFilesToVerity)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->Arg(0)
+    ->Iterations(5)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Measures verifyAllFilesInVerity, as odsign runs it on every boot with existing artifacts.
+void BM_VerifyAllFilesInVerity(benchmark::State& state) {
+    if (!SupportsFsVerity()) {
+        state.SkipWithError("fs-verity is not supported");
+        return;
+    }
+    createArtifacts();
+    setFsVerityThreadCount(1);
+    if (!addFilesToVerityRecursive(kArtifactsDir).ok()) {
+        state.SkipWithError("Failed to enable fs-verity");
+        return;
+    }
+    setFsVerityThreadCount(state.range(0));
+
+    for (auto _ : state) {
+        auto digests = verifyAllFilesInVerity(kArtifactsDir);
+        if (!digests.ok()) {
+            state.SkipWithError(digests.error().message().c_str());
+            break;
+        }
+    }
+    std::filesystem::remove_all(kArtifactsDir);
+}
+BENCHMARK(BM_VerifyAllFilesInVerity)->Arg(1)->Arg(0)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// A gigabyte-scale artifact set for the digest benchmarks, which do not need fs-verity.
+const std::string kDigestArtifactsDir = "/data/local/tmp/odsign_benchmark/digests";
+constexpr int kDigestArtifacts = 64;
+constexpr size_t kDigestArtifactSize = 16 * 1024 * 1024;
+
+const std::vector<std::string>& digestArtifacts() {
+    static std::vector<std::string> paths = [] {
+        std::filesystem::remove_all(kDigestArtifactsDir);
+        std::filesystem::create_directories(kDigestArtifactsDir);
+        std::mt19937 rng(42);
+        std::string data(kDigestArtifactSize, '\0');
+        std::vector<std::string> result;
+        for (int i = 0; i < kDigestArtifacts; ++i) {
+            for (auto& c : data) {
+                c = static_cast<char>(rng());
+            }
+            result.push_back(kDigestArtifactsDir + "/artifact-" + std::to_string(i) + ".oat");
+            android::base::WriteStringToFile(data, result.back());
+        }
+        sync();
+        return result;
+    }();
+    return paths;
+}
+
+// Measures the digests of all artifacts through createDigest, one file at a time, as odsign
+// computed them before createDigests existed.
+void BM_CreateDigestSerial(benchmark::State& state) {
+    const auto& paths = digestArtifacts();
+    for (auto _ : state) {
+        for (const auto& path : paths) {
+            auto digest = createDigest(path);
+            if (!digest.ok()) {
+                state.SkipWithError(digest.error().message().c_str());
+                return;
+            }
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * kDigestArtifacts * kDigestArtifactSize);
+}
+BENCHMARK(BM_CreateDigestSerial)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Measures the digests of all artifacts through createDigests. range(0) is the thread count, 0
+// meaning one per CPU.
+void BM_CreateDigests(benchmark::State& state) {
+    const auto& paths = digestArtifacts();
+    setFsVerityThreadCount(state.range(0));
+    for (auto _ : state) {
+        auto digests = createDigests(paths);
+        if (!digests.ok()) {
+            state.SkipWithError(digests.error().message().c_str());
+            return;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * kDigestArtifacts * kDigestArtifactSize);
+}
+BENCHMARK(BM_CreateDigests)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->Arg(0)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();